@@ -0,0 +1,1049 @@
+/*
+ * This file was generated automatically by ExtUtils::ParseXS version 3.45 from the
+ * contents of XS.xs. Do not edit this file, edit XS.xs instead.
+ *
+ *    ANY CHANGES MADE HERE WILL BE LOST!
+ *
+ */
+
+#line 1 "XS.xs"
+#include "src/xh_config.h"
+#include "src/xh_core.h"
+#include "src/xh_h2x.h"
+
+#define MY_CXT_KEY "XML::Hash::XS::_guts" XS_VERSION
+
+typedef struct {
+    /* options and warm state of the functional interface */
+    xh_h2x_conv_t *conv;
+    /* the options match the package variables */
+    xh_bool_t      valid;
+    /* globs of the package variables and their scalars the options are read from */
+    GV            *gvs[XH_H2X_GLOBALS];
+    SV            *svs[XH_H2X_GLOBALS];
+} my_cxt_t;
+
+START_MY_CXT
+
+/* an assignment to a package variable invalidates the cached options */
+static int
+xh_global_set(pTHX_ SV *sv, MAGIC *mg)
+{
+    dMY_CXT;
+
+    MY_CXT.valid = FALSE;
+
+    return 0;
+}
+
+static MGVTBL xh_global_vtbl = { NULL, xh_global_set, NULL, NULL, NULL };
+
+static void
+xh_global_init(pTHX_ my_cxt_t *cxt)
+{
+    xh_uint_t i;
+
+    if ((cxt->conv = xh_h2x_create(aTHX)) == NULL) {
+        croak("Malloc error in BOOT");
+    }
+    xh_h2x_hold_opts(aTHX_ &cxt->conv->opts);
+    cxt->valid = FALSE;
+
+    for (i = 0; i < XH_H2X_GLOBALS; i++) {
+        cxt->gvs[i] = (GV *) SvREFCNT_inc(gv_fetchpv(xh_h2x_global_names[i], GV_ADD, SVt_PV));
+        cxt->svs[i] = NULL;
+    }
+}
+
+static void
+xh_global_free(pTHX_ void *ptr)
+{
+    xh_uint_t i;
+    dMY_CXT;
+
+    xh_h2x_destroy(aTHX_ MY_CXT.conv);
+    MY_CXT.conv = NULL;
+
+    for (i = 0; i < XH_H2X_GLOBALS; i++) {
+        SvREFCNT_dec(MY_CXT.gvs[i]);
+    }
+}
+
+/*
+ * Remembers the scalars of the package variables and watches assignments
+ * to them. A variable replaced through its glob is a new scalar.
+ */
+static void
+xh_global_watch(pTHX_ my_cxt_t *cxt)
+{
+    xh_uint_t  i;
+    SV        *sv;
+
+    for (i = 0; i < XH_H2X_GLOBALS; i++) {
+        sv = cxt->svs[i] = GvSV(cxt->gvs[i]);
+        if (sv != NULL
+            && (SvTYPE(sv) < SVt_PVMG || mg_findext(sv, PERL_MAGIC_ext, &xh_global_vtbl) == NULL)) {
+            sv_magicext(sv, NULL, PERL_MAGIC_ext, &xh_global_vtbl, NULL, 0);
+        }
+    }
+}
+
+/* NULL - the options are stale but held by an outer call */
+static xh_h2x_conv_t *
+xh_global_conv(pTHX)
+{
+    xh_uint_t i;
+    dMY_CXT;
+
+    for (i = 0; MY_CXT.valid && i < XH_H2X_GLOBALS; i++) {
+        if (GvSV(MY_CXT.gvs[i]) != MY_CXT.svs[i]) {
+            MY_CXT.valid = FALSE;
+        }
+    }
+
+    if (!MY_CXT.valid) {
+        if (MY_CXT.conv->ctx.busy) {
+            return NULL;
+        }
+        xh_h2x_reload_opts(aTHX_ MY_CXT.conv);
+        xh_global_watch(aTHX_ &MY_CXT);
+        MY_CXT.valid = TRUE;
+    }
+
+    return MY_CXT.conv;
+}
+
+/*
+ * The output handle of $XML::Hash::XS::output is not kept after the call,
+ * it is closed once it goes out of scope of the caller.
+ */
+static void
+xh_global_release(pTHX_ void *ptr)
+{
+    dMY_CXT;
+
+    if (MY_CXT.conv != NULL && !MY_CXT.conv->ctx.busy && MY_CXT.conv->opts.output != NULL) {
+        xh_h2x_release_output(aTHX_ MY_CXT.conv);
+        MY_CXT.valid = FALSE;
+    }
+}
+
+#line 132 "XS.c"
+#ifndef PERL_UNUSED_VAR
+#  define PERL_UNUSED_VAR(var) if (0) var = var
+#endif
+
+#ifndef dVAR
+#  define dVAR		dNOOP
+#endif
+
+
+/* This stuff is not part of the API! You have been warned. */
+#ifndef PERL_VERSION_DECIMAL
+#  define PERL_VERSION_DECIMAL(r,v,s) (r*1000000 + v*1000 + s)
+#endif
+#ifndef PERL_DECIMAL_VERSION
+#  define PERL_DECIMAL_VERSION \
+	  PERL_VERSION_DECIMAL(PERL_REVISION,PERL_VERSION,PERL_SUBVERSION)
+#endif
+#ifndef PERL_VERSION_GE
+#  define PERL_VERSION_GE(r,v,s) \
+	  (PERL_DECIMAL_VERSION >= PERL_VERSION_DECIMAL(r,v,s))
+#endif
+#ifndef PERL_VERSION_LE
+#  define PERL_VERSION_LE(r,v,s) \
+	  (PERL_DECIMAL_VERSION <= PERL_VERSION_DECIMAL(r,v,s))
+#endif
+
+/* XS_INTERNAL is the explicit static-linkage variant of the default
+ * XS macro.
+ *
+ * XS_EXTERNAL is the same as XS_INTERNAL except it does not include
+ * "STATIC", ie. it exports XSUB symbols. You probably don't want that
+ * for anything but the BOOT XSUB.
+ *
+ * See XSUB.h in core!
+ */
+
+
+/* TODO: This might be compatible further back than 5.10.0. */
+#if PERL_VERSION_GE(5, 10, 0) && PERL_VERSION_LE(5, 15, 1)
+#  undef XS_EXTERNAL
+#  undef XS_INTERNAL
+#  if defined(__CYGWIN__) && defined(USE_DYNAMIC_LOADING)
+#    define XS_EXTERNAL(name) __declspec(dllexport) XSPROTO(name)
+#    define XS_INTERNAL(name) STATIC XSPROTO(name)
+#  endif
+#  if defined(__SYMBIAN32__)
+#    define XS_EXTERNAL(name) EXPORT_C XSPROTO(name)
+#    define XS_INTERNAL(name) EXPORT_C STATIC XSPROTO(name)
+#  endif
+#  ifndef XS_EXTERNAL
+#    if defined(HASATTRIBUTE_UNUSED) && !defined(__cplusplus)
+#      define XS_EXTERNAL(name) void name(pTHX_ CV* cv __attribute__unused__)
+#      define XS_INTERNAL(name) STATIC void name(pTHX_ CV* cv __attribute__unused__)
+#    else
+#      ifdef __cplusplus
+#        define XS_EXTERNAL(name) extern "C" XSPROTO(name)
+#        define XS_INTERNAL(name) static XSPROTO(name)
+#      else
+#        define XS_EXTERNAL(name) XSPROTO(name)
+#        define XS_INTERNAL(name) STATIC XSPROTO(name)
+#      endif
+#    endif
+#  endif
+#endif
+
+/* perl >= 5.10.0 && perl <= 5.15.1 */
+
+
+/* The XS_EXTERNAL macro is used for functions that must not be static
+ * like the boot XSUB of a module. If perl didn't have an XS_EXTERNAL
+ * macro defined, the best we can do is assume XS is the same.
+ * Dito for XS_INTERNAL.
+ */
+#ifndef XS_EXTERNAL
+#  define XS_EXTERNAL(name) XS(name)
+#endif
+#ifndef XS_INTERNAL
+#  define XS_INTERNAL(name) XS(name)
+#endif
+
+/* Now, finally, after all this mess, we want an ExtUtils::ParseXS
+ * internal macro that we're free to redefine for varying linkage due
+ * to the EXPORT_XSUB_SYMBOLS XS keyword. This is internal, use
+ * XS_EXTERNAL(name) or XS_INTERNAL(name) in your code if you need to!
+ */
+
+#undef XS_EUPXS
+#if defined(PERL_EUPXS_ALWAYS_EXPORT)
+#  define XS_EUPXS(name) XS_EXTERNAL(name)
+#else
+   /* default to internal */
+#  define XS_EUPXS(name) XS_INTERNAL(name)
+#endif
+
+#ifndef PERL_ARGS_ASSERT_CROAK_XS_USAGE
+#define PERL_ARGS_ASSERT_CROAK_XS_USAGE assert(cv); assert(params)
+
+/* prototype to pass -Wmissing-prototypes */
+STATIC void
+S_croak_xs_usage(const CV *const cv, const char *const params);
+
+STATIC void
+S_croak_xs_usage(const CV *const cv, const char *const params)
+{
+    const GV *const gv = CvGV(cv);
+
+    PERL_ARGS_ASSERT_CROAK_XS_USAGE;
+
+    if (gv) {
+        const char *const gvname = GvNAME(gv);
+        const HV *const stash = GvSTASH(gv);
+        const char *const hvname = stash ? HvNAME(stash) : NULL;
+
+        if (hvname)
+	    Perl_croak_nocontext("Usage: %s::%s(%s)", hvname, gvname, params);
+        else
+	    Perl_croak_nocontext("Usage: %s(%s)", gvname, params);
+    } else {
+        /* Pants. I don't think that it should be possible to get here. */
+	Perl_croak_nocontext("Usage: CODE(0x%" UVxf ")(%s)", PTR2UV(cv), params);
+    }
+}
+#undef  PERL_ARGS_ASSERT_CROAK_XS_USAGE
+
+#define croak_xs_usage        S_croak_xs_usage
+
+#endif
+
+/* NOTE: the prototype of newXSproto() is different in versions of perls,
+ * so we define a portable version of newXSproto()
+ */
+#ifdef newXS_flags
+#define newXSproto_portable(name, c_impl, file, proto) newXS_flags(name, c_impl, file, proto, 0)
+#else
+#define newXSproto_portable(name, c_impl, file, proto) (PL_Sv=(SV*)newXS(name, c_impl, file), sv_setpv(PL_Sv, proto), (CV*)PL_Sv)
+#endif /* !defined(newXS_flags) */
+
+#if PERL_VERSION_LE(5, 21, 5)
+#  define newXS_deffile(a,b) Perl_newXS(aTHX_ a,b,file)
+#else
+#  define newXS_deffile(a,b) Perl_newXS_deffile(aTHX_ a,b)
+#endif
+
+#line 276 "XS.c"
+
+XS_EUPXS(XS_XML__Hash__XS_CLONE); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS_CLONE)
+{
+    dVAR; dXSARGS;
+    PERL_UNUSED_VAR(cv); /* -W */
+    PERL_UNUSED_VAR(items); /* -W */
+    {
+#line 139 "XS.xs"
+        MY_CXT_CLONE;
+        /* the state of the parent interpreter is not ours */
+        xh_global_init(aTHX_ &MY_CXT);
+#line 289 "XS.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS_new); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS_new)
+{
+    dVAR; dXSARGS;
+    if (items < 1)
+       croak_xs_usage(cv,  "CLASS, ...");
+    {
+#line 146 "XS.xs"
+        xh_h2x_conv_t  *conv;
+#line 304 "XS.c"
+	xh_h2x_conv_t *	RETVAL;
+#line 148 "XS.xs"
+        dXCPT;
+
+        if ((conv = xh_h2x_create(aTHX)) == NULL) {
+            croak("Malloc error in new()");
+        }
+
+        XCPT_TRY_START
+        {
+            xh_h2x_parse_param(aTHX_ &conv->opts, 1, ax, items);
+            xh_h2x_hold_opts(aTHX_ &conv->opts);
+        } XCPT_TRY_END
+
+        XCPT_CATCH
+        {
+            /* the options are not held yet */
+            memset(&conv->opts, 0, sizeof(xh_h2x_opts_t));
+            xh_h2x_destroy(aTHX_ conv);
+            XCPT_RETHROW;
+        }
+
+        RETVAL = conv;
+#line 328 "XS.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = sv_newmortal();
+    sv_setref_pv(RETVALSV, "XML::Hash::XS", (void *) RETVAL);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS_hash2xml); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS_hash2xml)
+{
+    dVAR; dXSARGS;
+    dXSI32;
+    PERL_UNUSED_VAR(cv); /* -W */
+    PERL_UNUSED_VAR(items); /* -W */
+    PERL_UNUSED_VAR(ax); /* -Wall */
+    SP -= items;
+    {
+#line 179 "XS.xs"
+        xh_h2x_conv_t *conv = NULL;
+        xh_h2x_ctx_t   tmp_ctx, *ctx;
+        xh_h2x_opts_t *opts;
+        SV         *p, *hash, *result;
+        xh_int_t    nparam    = 0;
+#line 356 "XS.c"
+#line 185 "XS.xs"
+        /* get object reference */
+        if (nparam >= items)
+            croak("Invalid parameters");
+
+        p = ST(nparam);
+        if ( sv_isa(p, "XML::Hash::XS") ) {
+            /* reference to object */
+            IV tmp = SvIV((SV *) SvRV(p));
+            conv = INT2PTR(xh_h2x_conv_t *, tmp);
+            nparam++;
+        }
+        else if ( SvTYPE(p) == SVt_PV && !SvROK(p) ) {
+            /* class name */
+            nparam++;
+        }
+
+        /* get hash reference */
+        if (nparam >= items)
+            croak("Invalid parameters");
+
+        p = ST(nparam);
+        if (ix == 2) {
+            /* array of hashes */
+            if (!SvROK(p) || SvTYPE(SvRV(p)) != SVt_PVAV) {
+                croak("Parameter is not array reference");
+            }
+            hash = p;
+            nparam++;
+        }
+        else if (SvROK(p) && SvTYPE(SvRV(p)) == SVt_PVHV) {
+            hash = p;
+            nparam++;
+        }
+        else {
+            croak("Parameter is not hash reference");
+        }
+
+        ENTER;
+
+        /* functions share the cached global options */
+        if (conv == NULL) {
+            conv = xh_global_conv(aTHX);
+            if (conv != NULL && conv->opts.output != NULL) {
+                SAVEDESTRUCTOR_X(xh_global_release, NULL);
+            }
+        }
+
+        /* set options */
+        if (conv != NULL && !conv->ctx.busy) {
+            /* warm state of the object, the same arguments are parsed once */
+            ctx  = &conv->ctx;
+            opts = nparam < items ? xh_h2x_memo_opts(aTHX_ conv, nparam, ax, items) : NULL;
+            if (opts != NULL) {
+                nparam = items;
+            }
+            else {
+                opts = &conv->opts;
+            }
+            memcpy(&ctx->opts, opts, sizeof(xh_h2x_opts_t));
+        }
+        else {
+            ctx = &tmp_ctx;
+            memset(ctx, 0, sizeof(xh_h2x_ctx_t));
+            if (conv == NULL) {
+                /* read global options */
+                xh_h2x_init_opts(aTHX_ &ctx->opts);
+            }
+            else {
+                /* read options from object, it is busy by an outer call */
+                memcpy(&ctx->opts, &conv->opts, sizeof(xh_h2x_opts_t));
+            }
+        }
+        if (nparam < items) {
+            xh_h2x_parse_param(aTHX_ &ctx->opts, nparam, ax, items);
+        }
+
+        /* size only: serialize into nowhere */
+        if (ix == 1) {
+            ctx->opts.dry_run  = TRUE;
+            ctx->opts.checksum = XH_CHECKSUM_NONE;
+            (void) xh_h2x(aTHX_ ctx, hash);
+            LEAVE;
+            XSRETURN_UV((UV) ctx->bytes);
+        }
+
+        /* run */
+        if (ix == 2) {
+            result = xh_h2x_many(aTHX_ ctx, (AV *) SvRV(hash));
+        }
+#ifdef XH_HAVE_DOM
+        else if (ctx->opts.doc) {
+            result = xh_h2d(aTHX_ ctx, hash);
+        }
+        else {
+            result = xh_h2x(aTHX_ ctx, hash);
+        }
+#else
+        else {
+            result = xh_h2x(aTHX_ ctx, hash);
+        }
+#endif
+
+        if (ctx->opts.output != NULL || ctx->opts.output_fd >= 0
+            || (ctx->opts.output_file != NULL && SvOK(ctx->opts.output_file))) {
+            result = &PL_sv_undef;
+        }
+        else if (result == NULL) {
+            warn("Failed to convert");
+            result = &PL_sv_undef;
+        }
+        else {
+            result = sv_2mortal(result);
+        }
+
+        XPUSHs(result);
+
+        /* hash2xml_checksum: document, checksum and byte count */
+        if (ix == 3) {
+            XPUSHs(ctx->checksum[0] != '\0' ? sv_2mortal(newSVpv(ctx->checksum, 0)) : &PL_sv_undef);
+            XPUSHs(sv_2mortal(newSVuv((UV) ctx->bytes)));
+        }
+
+        LEAVE;
+#line 481 "XS.c"
+	PUTBACK;
+	return;
+    }
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS_checksum); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS_checksum)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "conv");
+    {
+	xh_h2x_conv_t *	conv;
+	SV *	RETVAL;
+
+    if (sv_isa(ST(0), "XML::Hash::XS")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        conv = INT2PTR(xh_h2x_conv_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS",
+            "XML::Hash::XS::checksum",
+            "conv")
+;
+#line 313 "XS.xs"
+        RETVAL = conv->ctx.checksum[0] != '\0' ? newSVpv(conv->ctx.checksum, 0) : &PL_sv_undef;
+#line 508 "XS.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS_bytes); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS_bytes)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "conv");
+    {
+	xh_h2x_conv_t *	conv;
+	UV	RETVAL;
+	dXSTARG;
+
+    if (sv_isa(ST(0), "XML::Hash::XS")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        conv = INT2PTR(xh_h2x_conv_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS",
+            "XML::Hash::XS::bytes",
+            "conv")
+;
+#line 321 "XS.xs"
+        RETVAL = (UV) conv->ctx.bytes;
+#line 537 "XS.c"
+	XSprePUSH;
+	PUSHu((UV)RETVAL);
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS_hash2xml_iter); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS_hash2xml_iter)
+{
+    dVAR; dXSARGS;
+    if (items < 2)
+       croak_xs_usage(cv,  "conv, hash, ...");
+    {
+	xh_h2x_conv_t *	conv;
+	SV *	hash = ST(1)
+;
+#line 330 "XS.xs"
+        xh_h2x_iter_t *iter;
+#line 557 "XS.c"
+	xh_h2x_iter_t *	RETVAL;
+
+    if (sv_isa(ST(0), "XML::Hash::XS")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        conv = INT2PTR(xh_h2x_conv_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS",
+            "XML::Hash::XS::hash2xml_iter",
+            "conv")
+;
+#line 332 "XS.xs"
+        dXCPT;
+
+        if (!SvROK(hash) || SvTYPE(SvRV(hash)) != SVt_PVHV) {
+            croak("Parameter is not hash reference");
+        }
+
+        if ((iter = xh_h2x_iter_create(&conv->opts)) == NULL) {
+            croak("Malloc error in hash2xml_iter()");
+        }
+
+        XCPT_TRY_START
+        {
+            if (items > 2) {
+                xh_h2x_parse_param(aTHX_ &iter->ctx.opts, 2, ax, items);
+            }
+        } XCPT_TRY_END
+
+        XCPT_CATCH
+        {
+            /* the options are not held yet */
+            memset(&iter->ctx.opts, 0, sizeof(xh_h2x_opts_t));
+            xh_h2x_iter_destroy(aTHX_ iter);
+            XCPT_RETHROW;
+        }
+
+        /* the iterator may outlive the object and the arguments */
+        xh_h2x_hold_opts(aTHX_ &iter->ctx.opts);
+
+        xh_h2x_iter_start(aTHX_ iter, hash);
+
+        RETVAL = iter;
+#line 600 "XS.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = sv_newmortal();
+    sv_setref_pv(RETVALSV, "XML::Hash::XS::Iterator", (void *) RETVAL);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS_DESTROY); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS_DESTROY)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "conv");
+    {
+	xh_h2x_conv_t *	conv;
+
+    if (sv_isa(ST(0), "XML::Hash::XS")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        conv = INT2PTR(xh_h2x_conv_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS",
+            "XML::Hash::XS::DESTROY",
+            "conv")
+;
+#line 370 "XS.xs"
+        xh_h2x_destroy(aTHX_ conv);
+#line 631 "XS.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__Iterator_next); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__Iterator_next)
+{
+    dVAR; dXSARGS;
+    if (items < 1 || items > 2)
+       croak_xs_usage(cv,  "iter, size = 0");
+    {
+	xh_h2x_iter_t *	iter;
+	UV	size;
+	SV *	RETVAL;
+
+    if (sv_isa(ST(0), "XML::Hash::XS::Iterator")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        iter = INT2PTR(xh_h2x_iter_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS::Iterator",
+            "XML::Hash::XS::Iterator::next",
+            "iter")
+;
+
+	if (items < 2)
+	    size = 0;
+	else {
+	    size = (UV)SvUV(ST(1))
+;
+	}
+#line 379 "XS.xs"
+        RETVAL = xh_h2x_iter_next(aTHX_ iter, (size_t) size);
+        if (RETVAL == NULL) {
+            XSRETURN_UNDEF;
+        }
+#line 668 "XS.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__Iterator_DESTROY); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__Iterator_DESTROY)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "iter");
+    {
+	xh_h2x_iter_t *	iter;
+
+    if (sv_isa(ST(0), "XML::Hash::XS::Iterator")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        iter = INT2PTR(xh_h2x_iter_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS::Iterator",
+            "XML::Hash::XS::Iterator::DESTROY",
+            "iter")
+;
+#line 390 "XS.xs"
+        xh_h2x_iter_destroy(aTHX_ iter);
+#line 695 "XS.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__Writer_new); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__Writer_new)
+{
+    dVAR; dXSARGS;
+    if (items < 1)
+       croak_xs_usage(cv,  "CLASS, ...");
+    {
+#line 397 "XS.xs"
+        xh_h2x_stream_t *stream;
+#line 710 "XS.c"
+	xh_h2x_stream_t *	RETVAL;
+#line 399 "XS.xs"
+        dXCPT;
+
+        if ((stream = xh_h2x_stream_create(aTHX)) == NULL) {
+            croak("Malloc error in new()");
+        }
+
+        XCPT_TRY_START
+        {
+            xh_h2x_parse_param(aTHX_ &stream->opts, 1, ax, items);
+            xh_h2x_hold_opts(aTHX_ &stream->opts);
+        } XCPT_TRY_END
+
+        XCPT_CATCH
+        {
+            /* the options are not held yet */
+            memset(&stream->opts, 0, sizeof(xh_h2x_opts_t));
+            xh_h2x_stream_destroy(aTHX_ stream);
+            XCPT_RETHROW;
+        }
+
+        RETVAL = stream;
+#line 734 "XS.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = sv_newmortal();
+    sv_setref_pv(RETVALSV, "XML::Hash::XS::Writer", (void *) RETVAL);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__Writer_start); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__Writer_start)
+{
+    dVAR; dXSARGS;
+    if (items < 2)
+       croak_xs_usage(cv,  "stream, root, ...");
+    {
+	xh_h2x_stream_t *	stream;
+	SV *	root = ST(1)
+;
+
+    if (sv_isa(ST(0), "XML::Hash::XS::Writer")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        stream = INT2PTR(xh_h2x_stream_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS::Writer",
+            "XML::Hash::XS::Writer::start",
+            "stream")
+;
+#line 428 "XS.xs"
+        xh_h2x_stream_start(aTHX_ stream, root, &ST(2), items - 2);
+#line 767 "XS.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__Writer_add); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__Writer_add)
+{
+    dVAR; dXSARGS;
+    if (items != 3)
+       croak_xs_usage(cv,  "stream, key, value");
+    {
+	xh_h2x_stream_t *	stream;
+	SV *	key = ST(1)
+;
+	SV *	value = ST(2)
+;
+
+    if (sv_isa(ST(0), "XML::Hash::XS::Writer")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        stream = INT2PTR(xh_h2x_stream_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS::Writer",
+            "XML::Hash::XS::Writer::add",
+            "stream")
+;
+#line 436 "XS.xs"
+        xh_h2x_stream_add(aTHX_ stream, key, value);
+#line 796 "XS.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__Writer_raw); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__Writer_raw)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "stream, content");
+    {
+	xh_h2x_stream_t *	stream;
+	SV *	content = ST(1)
+;
+
+    if (sv_isa(ST(0), "XML::Hash::XS::Writer")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        stream = INT2PTR(xh_h2x_stream_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS::Writer",
+            "XML::Hash::XS::Writer::raw",
+            "stream")
+;
+#line 443 "XS.xs"
+        xh_h2x_stream_raw(aTHX_ stream, content);
+#line 823 "XS.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__Writer_end); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__Writer_end)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "stream");
+    {
+	xh_h2x_stream_t *	stream;
+	SV *	RETVAL;
+
+    if (sv_isa(ST(0), "XML::Hash::XS::Writer")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        stream = INT2PTR(xh_h2x_stream_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS::Writer",
+            "XML::Hash::XS::Writer::end",
+            "stream")
+;
+#line 449 "XS.xs"
+        RETVAL = xh_h2x_stream_end(aTHX_ stream);
+        if (RETVAL == NULL || RETVAL == &PL_sv_undef) {
+            XSRETURN_UNDEF;
+        }
+#line 852 "XS.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__Writer_DESTROY); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__Writer_DESTROY)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "stream");
+    {
+	xh_h2x_stream_t *	stream;
+
+    if (sv_isa(ST(0), "XML::Hash::XS::Writer")) {
+        IV tmp = SvIV((SV *) SvRV(ST(0)));
+        stream = INT2PTR(xh_h2x_stream_t *, tmp);
+    } else
+        Perl_croak(aTHX_ "%s: %s is not of type XML::Hash::XS::Writer",
+            "XML::Hash::XS::Writer::DESTROY",
+            "stream")
+;
+#line 460 "XS.xs"
+        xh_h2x_stream_destroy(aTHX_ stream);
+#line 879 "XS.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__escape_kernels); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__escape_kernels)
+{
+    dVAR; dXSARGS;
+    if (items != 0)
+       croak_xs_usage(cv,  "");
+    PERL_UNUSED_VAR(ax); /* -Wall */
+    SP -= items;
+    {
+#line 467 "XS.xs"
+        const char *name;
+        xh_uint_t   i;
+#line 897 "XS.c"
+#line 470 "XS.xs"
+        for (i = 0; (name = xh_escape_kernel_name(i)) != NULL; i++) {
+            XPUSHs(sv_2mortal(newSVpv(name, 0)));
+        }
+#line 902 "XS.c"
+	PUTBACK;
+	return;
+    }
+}
+
+
+XS_EUPXS(XS_XML__Hash__XS__escape); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_XML__Hash__XS__escape)
+{
+    dVAR; dXSARGS;
+    if (items < 2 || items > 3)
+       croak_xs_usage(cv,  "str, attr, kernel = NULL");
+    {
+	SV *	str = ST(0)
+;
+	int	attr = (int)SvIV(ST(1))
+;
+	char *	kernel;
+#line 480 "XS.xs"
+        xh_buffer_t         buf;
+        xh_escape_kernel_t  saved;
+        const char         *s;
+        STRLEN              len;
+#line 926 "XS.c"
+	SV *	RETVAL;
+
+	if (items < 3)
+	    kernel = NULL;
+	else {
+	    kernel = (char *)SvPV_nolen(ST(2))
+;
+	}
+#line 485 "XS.xs"
+        /* test hook: kernel is undef - the byte by byte macros */
+        s = SvPV(str, len);
+        xh_buffer_init(aTHX_ &buf, len * 6 + 1);
+
+        if (kernel == NULL) {
+            if (attr) {
+                XH_BUFFER_WRITE_ESCAPE_ATTR((&buf), s, len)
+            }
+            else {
+                XH_BUFFER_WRITE_ESCAPE_STRING((&buf), s, len)
+            }
+        }
+        else {
+            saved = xh_escape_kernel;
+            if (!xh_escape_set_kernel(kernel)) {
+                SvREFCNT_dec(buf.scalar);
+                croak("Escape kernel '%s' is not supported", kernel);
+            }
+            if (attr) {
+                xh_escape_write_attr(&buf, s, len);
+            }
+            else {
+                xh_escape_write_text(&buf, s, len);
+            }
+            xh_escape_kernel = saved;
+        }
+
+        RETVAL = xh_writer_write_to_perl_scalar(&buf);
+#line 964 "XS.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+#ifdef __cplusplus
+extern "C"
+#endif
+XS_EXTERNAL(boot_XML__Hash__XS); /* prototype to pass -Wmissing-prototypes */
+XS_EXTERNAL(boot_XML__Hash__XS)
+{
+#if PERL_VERSION_LE(5, 21, 5)
+    dVAR; dXSARGS;
+#else
+    dVAR; dXSBOOTARGSXSAPIVERCHK;
+#endif
+#if PERL_VERSION_LE(5, 8, 999) /* PERL_VERSION_LT is 5.33+ */
+    char* file = __FILE__;
+#else
+    const char* file = __FILE__;
+#endif
+
+    PERL_UNUSED_VAR(file);
+
+    PERL_UNUSED_VAR(cv); /* -W */
+    PERL_UNUSED_VAR(items); /* -W */
+#if PERL_VERSION_LE(5, 21, 5)
+    XS_VERSION_BOOTCHECK;
+#  ifdef XS_APIVERSION_BOOTCHECK
+    XS_APIVERSION_BOOTCHECK;
+#  endif
+#endif
+
+        newXS_deffile("XML::Hash::XS::CLONE", XS_XML__Hash__XS_CLONE);
+        newXS_deffile("XML::Hash::XS::new", XS_XML__Hash__XS_new);
+        cv = newXS_deffile("XML::Hash::XS::hash2xml", XS_XML__Hash__XS_hash2xml);
+        XSANY.any_i32 = 0;
+        cv = newXS_deffile("XML::Hash::XS::hash2xml_checksum", XS_XML__Hash__XS_hash2xml);
+        XSANY.any_i32 = 3;
+        cv = newXS_deffile("XML::Hash::XS::hash2xml_many", XS_XML__Hash__XS_hash2xml);
+        XSANY.any_i32 = 2;
+        cv = newXS_deffile("XML::Hash::XS::hash2xml_size", XS_XML__Hash__XS_hash2xml);
+        XSANY.any_i32 = 1;
+        newXS_deffile("XML::Hash::XS::checksum", XS_XML__Hash__XS_checksum);
+        newXS_deffile("XML::Hash::XS::bytes", XS_XML__Hash__XS_bytes);
+        newXS_deffile("XML::Hash::XS::hash2xml_iter", XS_XML__Hash__XS_hash2xml_iter);
+        newXS_deffile("XML::Hash::XS::DESTROY", XS_XML__Hash__XS_DESTROY);
+        newXS_deffile("XML::Hash::XS::Iterator::next", XS_XML__Hash__XS__Iterator_next);
+        newXS_deffile("XML::Hash::XS::Iterator::DESTROY", XS_XML__Hash__XS__Iterator_DESTROY);
+        newXS_deffile("XML::Hash::XS::Writer::new", XS_XML__Hash__XS__Writer_new);
+        newXS_deffile("XML::Hash::XS::Writer::start", XS_XML__Hash__XS__Writer_start);
+        newXS_deffile("XML::Hash::XS::Writer::add", XS_XML__Hash__XS__Writer_add);
+        newXS_deffile("XML::Hash::XS::Writer::raw", XS_XML__Hash__XS__Writer_raw);
+        newXS_deffile("XML::Hash::XS::Writer::end", XS_XML__Hash__XS__Writer_end);
+        newXS_deffile("XML::Hash::XS::Writer::DESTROY", XS_XML__Hash__XS__Writer_DESTROY);
+        newXS_deffile("XML::Hash::XS::_escape_kernels", XS_XML__Hash__XS__escape_kernels);
+        newXS_deffile("XML::Hash::XS::_escape", XS_XML__Hash__XS__escape);
+
+    /* Initialisation Section */
+
+#line 127 "XS.xs"
+{
+    MY_CXT_INIT;
+
+    xh_escape_init();
+
+    xh_global_init(aTHX_ &MY_CXT);
+    call_atexit(xh_global_free, NULL);
+}
+
+#line 1036 "XS.c"
+
+    /* End of Initialisation Section */
+
+#if PERL_VERSION_LE(5, 21, 5)
+#  if PERL_VERSION_GE(5, 9, 0)
+    if (PL_unitcheckav)
+        call_list(PL_scopestack_ix, PL_unitcheckav);
+#  endif
+    XSRETURN_YES;
+#else
+    Perl_xs_boot_epilog(aTHX_ ax);
+#endif
+}
+
@@ -2,44 +2,186 @@
 #include "src/xh_core.h"
 #include "src/xh_h2x.h"
 
+#define MY_CXT_KEY "XML::Hash::XS::_guts" XS_VERSION
+
+typedef struct {
+    /* options and warm state of the functional interface */
+    xh_h2x_conv_t *conv;
+    /* the options match the package variables */
+    xh_bool_t      valid;
+    /* globs of the package variables and their scalars the options are read from */
+    GV            *gvs[XH_H2X_GLOBALS];
+    SV            *svs[XH_H2X_GLOBALS];
+} my_cxt_t;
+
+START_MY_CXT
+
+/* an assignment to a package variable invalidates the cached options */
+static int
+xh_global_set(pTHX_ SV *sv, MAGIC *mg)
+{
+    dMY_CXT;
+
+    MY_CXT.valid = FALSE;
+
+    return 0;
+}
+
+static MGVTBL xh_global_vtbl = { NULL, xh_global_set, NULL, NULL, NULL };
+
+static void
+xh_global_init(pTHX_ my_cxt_t *cxt)
+{
+    xh_uint_t i;
+
+    if ((cxt->conv = xh_h2x_create(aTHX)) == NULL) {
+        croak("Malloc error in BOOT");
+    }
+    xh_h2x_hold_opts(aTHX_ &cxt->conv->opts);
+    cxt->valid = FALSE;
+
+    for (i = 0; i < XH_H2X_GLOBALS; i++) {
+        cxt->gvs[i] = (GV *) SvREFCNT_inc(gv_fetchpv(xh_h2x_global_names[i], GV_ADD, SVt_PV));
+        cxt->svs[i] = NULL;
+    }
+}
+
+static void
+xh_global_free(pTHX_ void *ptr)
+{
+    xh_uint_t i;
+    dMY_CXT;
+
+    xh_h2x_destroy(aTHX_ MY_CXT.conv);
+    MY_CXT.conv = NULL;
+
+    for (i = 0; i < XH_H2X_GLOBALS; i++) {
+        SvREFCNT_dec(MY_CXT.gvs[i]);
+    }
+}
+
+/*
+ * Remembers the scalars of the package variables and watches assignments
+ * to them. A variable replaced through its glob is a new scalar.
+ */
+static void
+xh_global_watch(pTHX_ my_cxt_t *cxt)
+{
+    xh_uint_t  i;
+    SV        *sv;
+
+    for (i = 0; i < XH_H2X_GLOBALS; i++) {
+        sv = cxt->svs[i] = GvSV(cxt->gvs[i]);
+        if (sv != NULL
+            && (SvTYPE(sv) < SVt_PVMG || mg_findext(sv, PERL_MAGIC_ext, &xh_global_vtbl) == NULL)) {
+            sv_magicext(sv, NULL, PERL_MAGIC_ext, &xh_global_vtbl, NULL, 0);
+        }
+    }
+}
+
+/* NULL - the options are stale but held by an outer call */
+static xh_h2x_conv_t *
+xh_global_conv(pTHX)
+{
+    xh_uint_t i;
+    dMY_CXT;
+
+    for (i = 0; MY_CXT.valid && i < XH_H2X_GLOBALS; i++) {
+        if (GvSV(MY_CXT.gvs[i]) != MY_CXT.svs[i]) {
+            MY_CXT.valid = FALSE;
+        }
+    }
+
+    if (!MY_CXT.valid) {
+        if (MY_CXT.conv->ctx.busy) {
+            return NULL;
+        }
+        xh_h2x_reload_opts(aTHX_ MY_CXT.conv);
+        xh_global_watch(aTHX_ &MY_CXT);
+        MY_CXT.valid = TRUE;
+    }
+
+    return MY_CXT.conv;
+}
+
+/*
+ * The output handle of $XML::Hash::XS::output is not kept after the call,
+ * it is closed once it goes out of scope of the caller.
+ */
+static void
+xh_global_release(pTHX_ void *ptr)
+{
+    dMY_CXT;
+
+    if (MY_CXT.conv != NULL && !MY_CXT.conv->ctx.busy && MY_CXT.conv->opts.output != NULL) {
+        xh_h2x_release_output(aTHX_ MY_CXT.conv);
+        MY_CXT.valid = FALSE;
+    }
+}
+
 MODULE = XML::Hash::XS PACKAGE = XML::Hash::XS
 
 PROTOTYPES: DISABLE
 
-xh_h2x_opts_t *
+BOOT:
+{
+    MY_CXT_INIT;
+
+    xh_escape_init();
+
+    xh_global_init(aTHX_ &MY_CXT);
+    call_atexit(xh_global_free, NULL);
+}
+
+void
+CLONE(...)
+    CODE:
+        MY_CXT_CLONE;
+        /* the state of the parent interpreter is not ours */
+        xh_global_init(aTHX_ &MY_CXT);
+
+xh_h2x_conv_t *
 new(CLASS,...)
     PREINIT:
-        xh_h2x_opts_t  *opts;
+        xh_h2x_conv_t  *conv;
     CODE:
         dXCPT;
 
-        if ((opts = xh_h2x_create()) == NULL) {
+        if ((conv = xh_h2x_create(aTHX)) == NULL) {
             croak("Malloc error in new()");
         }
 
         XCPT_TRY_START
         {
-            xh_h2x_parse_param(opts, 1, ax, items);
+            xh_h2x_parse_param(aTHX_ &conv->opts, 1, ax, items);
+            xh_h2x_hold_opts(aTHX_ &conv->opts);
         } XCPT_TRY_END
 
         XCPT_CATCH
         {
-            xh_h2x_destroy(opts);
+            /* the options are not held yet */
+            memset(&conv->opts, 0, sizeof(xh_h2x_opts_t));
+            xh_h2x_destroy(aTHX_ conv);
             XCPT_RETHROW;
         }
 
-        RETVAL = opts;
+        RETVAL = conv;
     OUTPUT:
         RETVAL
 
-SV *
+void
 hash2xml(...)
+    ALIAS:
+        hash2xml_size = 1
+        hash2xml_many = 2
+        hash2xml_checksum = 3
     PREINIT:
-        xh_h2x_opts_t *opts = NULL;
-        xh_h2x_ctx_t   ctx;
+        xh_h2x_conv_t *conv = NULL;
+        xh_h2x_ctx_t   tmp_ctx, *ctx;
+        xh_h2x_opts_t *opts;
         SV         *p, *hash, *result;
         xh_int_t    nparam    = 0;
-    CODE:
+    PPCODE:
         /* get object reference */
         if (nparam >= items)
             croak("Invalid parameters");
@@ -48,10 +190,10 @@ hash2xml(...)
         if ( sv_isa(p, "XML::Hash::XS") ) {
             /* reference to object */
             IV tmp = SvIV((SV *) SvRV(p));
-            opts = INT2PTR(xh_h2x_opts_t *, tmp);
+            conv = INT2PTR(xh_h2x_conv_t *, tmp);
             nparam++;
         }
-        else if ( SvTYPE(p) == SVt_PV ) {
+        else if ( SvTYPE(p) == SVt_PV && !SvROK(p) ) {
             /* class name */
             nparam++;
         }
@@ -61,7 +203,15 @@ hash2xml(...)
             croak("Invalid parameters");
 
         p = ST(nparam);
-        if (SvROK(p) && SvTYPE(SvRV(p)) == SVt_PVHV) {
+        if (ix == 2) {
+            /* array of hashes */
+            if (!SvROK(p) || SvTYPE(SvRV(p)) != SVt_PVAV) {
+                croak("Parameter is not array reference");
+            }
+            hash = p;
+            nparam++;
+        }
+        else if (SvROK(p) && SvTYPE(SvRV(p)) == SVt_PVHV) {
             hash = p;
             nparam++;
         }
@@ -69,48 +219,306 @@ hash2xml(...)
             croak("Parameter is not hash reference");
         }
 
+        ENTER;
+
+        /* functions share the cached global options */
+        if (conv == NULL) {
+            conv = xh_global_conv(aTHX);
+            if (conv != NULL && conv->opts.output != NULL) {
+                SAVEDESTRUCTOR_X(xh_global_release, NULL);
+            }
+        }
+
         /* set options */
-        memset(&ctx, 0, sizeof(xh_h2x_ctx_t));
-        if (opts == NULL) {
-            /* read global options */
-            xh_h2x_init_opts(&ctx.opts);
+        if (conv != NULL && !conv->ctx.busy) {
+            /* warm state of the object, the same arguments are parsed once */
+            ctx  = &conv->ctx;
+            opts = nparam < items ? xh_h2x_memo_opts(aTHX_ conv, nparam, ax, items) : NULL;
+            if (opts != NULL) {
+                nparam = items;
+            }
+            else {
+                opts = &conv->opts;
+            }
+            memcpy(&ctx->opts, opts, sizeof(xh_h2x_opts_t));
         }
         else {
-            /* read options from object */
-            memcpy(&ctx.opts, opts, sizeof(xh_h2x_opts_t));
+            ctx = &tmp_ctx;
+            memset(ctx, 0, sizeof(xh_h2x_ctx_t));
+            if (conv == NULL) {
+                /* read global options */
+                xh_h2x_init_opts(aTHX_ &ctx->opts);
+            }
+            else {
+                /* read options from object, it is busy by an outer call */
+                memcpy(&ctx->opts, &conv->opts, sizeof(xh_h2x_opts_t));
+            }
         }
         if (nparam < items) {
-            xh_h2x_parse_param(&ctx.opts, nparam, ax, items);
+            xh_h2x_parse_param(aTHX_ &ctx->opts, nparam, ax, items);
+        }
+
+        /* size only: serialize into nowhere */
+        if (ix == 1) {
+            ctx->opts.dry_run  = TRUE;
+            ctx->opts.checksum = XH_CHECKSUM_NONE;
+            (void) xh_h2x(aTHX_ ctx, hash);
+            LEAVE;
+            XSRETURN_UV((UV) ctx->bytes);
         }
 
         /* run */
+        if (ix == 2) {
+            result = xh_h2x_many(aTHX_ ctx, (AV *) SvRV(hash));
+        }
 #ifdef XH_HAVE_DOM
-        if (ctx.opts.doc) {
-            result = xh_h2d(&ctx, hash);
+        else if (ctx->opts.doc) {
+            result = xh_h2d(aTHX_ ctx, hash);
         }
         else {
-            result = xh_h2x(&ctx, hash);
+            result = xh_h2x(aTHX_ ctx, hash);
         }
 #else
-        result = xh_h2x(&ctx, hash);
+        else {
+            result = xh_h2x(aTHX_ ctx, hash);
+        }
 #endif
 
-        if (ctx.opts.output != NULL) {
-            XSRETURN_UNDEF;
+        if (ctx->opts.output != NULL || ctx->opts.output_fd >= 0
+            || (ctx->opts.output_file != NULL && SvOK(ctx->opts.output_file))) {
+            result = &PL_sv_undef;
         }
-
-        if (result == NULL) {
+        else if (result == NULL) {
             warn("Failed to convert");
-            XSRETURN_UNDEF;
+            result = &PL_sv_undef;
+        }
+        else {
+            result = sv_2mortal(result);
+        }
+
+        XPUSHs(result);
+
+        /* hash2xml_checksum: document, checksum and byte count */
+        if (ix == 3) {
+            XPUSHs(ctx->checksum[0] != '\0' ? sv_2mortal(newSVpv(ctx->checksum, 0)) : &PL_sv_undef);
+            XPUSHs(sv_2mortal(newSVuv((UV) ctx->bytes)));
         }
 
-        RETVAL = result;
+        LEAVE;
+
+SV *
+checksum(conv)
+        xh_h2x_conv_t *conv;
+    CODE:
+        RETVAL = conv->ctx.checksum[0] != '\0' ? newSVpv(conv->ctx.checksum, 0) : &PL_sv_undef;
+    OUTPUT:
+        RETVAL
 
+UV
+bytes(conv)
+        xh_h2x_conv_t *conv;
+    CODE:
+        RETVAL = (UV) conv->ctx.bytes;
+    OUTPUT:
+        RETVAL
+
+xh_h2x_iter_t *
+hash2xml_iter(conv, hash, ...)
+        xh_h2x_conv_t *conv;
+        SV            *hash;
+    PREINIT:
+        xh_h2x_iter_t *iter;
+    CODE:
+        dXCPT;
+
+        if (!SvROK(hash) || SvTYPE(SvRV(hash)) != SVt_PVHV) {
+            croak("Parameter is not hash reference");
+        }
+
+        if ((iter = xh_h2x_iter_create(&conv->opts)) == NULL) {
+            croak("Malloc error in hash2xml_iter()");
+        }
+
+        XCPT_TRY_START
+        {
+            if (items > 2) {
+                xh_h2x_parse_param(aTHX_ &iter->ctx.opts, 2, ax, items);
+            }
+            xh_h2x_iter_check_opts(aTHX_ &iter->ctx.opts);
+        } XCPT_TRY_END
+
+        XCPT_CATCH
+        {
+            /* the options are not held yet */
+            memset(&iter->ctx.opts, 0, sizeof(xh_h2x_opts_t));
+            xh_h2x_iter_destroy(aTHX_ iter);
+            XCPT_RETHROW;
+        }
+
+        /* the iterator may outlive the object and the arguments */
+        xh_h2x_hold_opts(aTHX_ &iter->ctx.opts);
+
+        XCPT_TRY_START
+        {
+            xh_h2x_iter_start(aTHX_ iter, hash);
+        } XCPT_TRY_END
+
+        XCPT_CATCH
+        {
+            xh_h2x_iter_destroy(aTHX_ iter);
+            XCPT_RETHROW;
+        }
+
+        RETVAL = iter;
     OUTPUT:
         RETVAL
 
 void
 DESTROY(conv)
-        xh_h2x_opts_t *conv;
+        xh_h2x_conv_t *conv;
+    CODE:
+        xh_h2x_destroy(aTHX_ conv);
+
+MODULE = XML::Hash::XS PACKAGE = XML::Hash::XS::Iterator
+
+SV *
+next(iter, size = 0)
+        xh_h2x_iter_t *iter;
+        UV             size;
+    CODE:
+        RETVAL = xh_h2x_iter_next(aTHX_ iter, (size_t) size);
+        if (RETVAL == NULL) {
+            XSRETURN_UNDEF;
+        }
+    OUTPUT:
+        RETVAL
+
+void
+DESTROY(iter)
+        xh_h2x_iter_t *iter;
+    CODE:
+        xh_h2x_iter_destroy(aTHX_ iter);
+
+MODULE = XML::Hash::XS PACKAGE = XML::Hash::XS::Writer
+
+xh_h2x_stream_t *
+new(CLASS,...)
+    PREINIT:
+        xh_h2x_stream_t *stream;
+    CODE:
+        dXCPT;
+
+        if ((stream = xh_h2x_stream_create(aTHX)) == NULL) {
+            croak("Malloc error in new()");
+        }
+
+        XCPT_TRY_START
+        {
+            xh_h2x_parse_param(aTHX_ &stream->opts, 1, ax, items);
+            xh_h2x_hold_opts(aTHX_ &stream->opts);
+        } XCPT_TRY_END
+
+        XCPT_CATCH
+        {
+            /* the options are not held yet */
+            memset(&stream->opts, 0, sizeof(xh_h2x_opts_t));
+            xh_h2x_stream_destroy(aTHX_ stream);
+            XCPT_RETHROW;
+        }
+
+        RETVAL = stream;
+    OUTPUT:
+        RETVAL
+
+void
+start(stream, root, ...)
+        xh_h2x_stream_t *stream;
+        SV              *root;
+    CODE:
+        xh_h2x_stream_start(aTHX_ stream, root, &ST(2), items - 2);
+
+void
+add(stream, key, value)
+        xh_h2x_stream_t *stream;
+        SV              *key;
+        SV              *value;
+    CODE:
+        xh_h2x_stream_add(aTHX_ stream, key, value);
+
+void
+raw(stream, content)
+        xh_h2x_stream_t *stream;
+        SV              *content;
+    CODE:
+        xh_h2x_stream_raw(aTHX_ stream, content);
+
+SV *
+end(stream)
+        xh_h2x_stream_t *stream;
     CODE:
-        xh_h2x_destroy(conv);
+        RETVAL = xh_h2x_stream_end(aTHX_ stream);
+        if (RETVAL == NULL || RETVAL == &PL_sv_undef) {
+            XSRETURN_UNDEF;
+        }
+    OUTPUT:
+        RETVAL
+
+void
+DESTROY(stream)
+        xh_h2x_stream_t *stream;
+    CODE:
+        xh_h2x_stream_destroy(aTHX_ stream);
+
+MODULE = XML::Hash::XS PACKAGE = XML::Hash::XS
+
+void
+_escape_kernels()
+    PREINIT:
+        const char *name;
+        xh_uint_t   i;
+    PPCODE:
+        for (i = 0; (name = xh_escape_kernel_name(i)) != NULL; i++) {
+            XPUSHs(sv_2mortal(newSVpv(name, 0)));
+        }
+
+SV *
+_escape(str, attr, kernel = NULL)
+        SV         *str;
+        int         attr;
+        char       *kernel;
+    PREINIT:
+        xh_buffer_t         buf;
+        xh_escape_kernel_t  saved;
+        const char         *s;
+        STRLEN              len;
+    CODE:
+        /* test hook: kernel is undef - the byte by byte macros */
+        s = SvPV(str, len);
+        xh_buffer_init(aTHX_ &buf, len * 6 + 1);
+
+        if (kernel == NULL) {
+            if (attr) {
+                XH_BUFFER_WRITE_ESCAPE_ATTR((&buf), s, len)
+            }
+            else {
+                XH_BUFFER_WRITE_ESCAPE_STRING((&buf), s, len)
+            }
+        }
+        else {
+            saved = xh_escape_kernel;
+            if (!xh_escape_set_kernel(kernel)) {
+                SvREFCNT_dec(buf.scalar);
+                croak("Escape kernel '%s' is not supported", kernel);
+            }
+            if (attr) {
+                xh_escape_write_attr(&buf, s, len);
+            }
+            else {
+                xh_escape_write_text(&buf, s, len);
+            }
+            xh_escape_kernel = saved;
+        }
+
+        RETVAL = xh_writer_write_to_perl_scalar(&buf);
+    OUTPUT:
+        RETVAL
@@ -0,0 +1,38 @@
+#!/usr/bin/env perl
+
+# Constant costs of the Perl API on small and nested documents. On perls
+# built with ithreads every API call needs the interpreter, compare the
+# results of two builds on such a perl.
+
+use FindBin;
+use lib ("$FindBin::Bin/../blib/lib", "$FindBin::Bin/../blib/arch");
+use Config;
+use XML::Hash::XS qw();
+use Benchmark qw(:all);
+
+printf "perl %s, %s\n", $], $Config{useithreads} ? 'threaded' : 'not threaded';
+
+my $small = {
+    id    => 12345,
+    name  => 'small document',
+    tags  => [ 'a', 'b', 'c' ],
+    attrs => { x => 1, y => 2 },
+};
+my $nested = {
+    list => { item => [ map { { id => $_, name => "name$_", values => [ 1, 2 ] } } 1 .. 1000 ] },
+};
+
+my $conv = XML::Hash::XS->new(canonical => 1);
+my $lx   = XML::Hash::XS->new(method => 'LX', canonical => 1);
+
+cmpthese -3, {
+	'small' => sub {
+		my $oxml = $conv->hash2xml($small);
+	},
+	'nested' => sub {
+		my $oxml = $conv->hash2xml($nested);
+	},
+	'nested, LX' => sub {
+		my $oxml = $lx->hash2xml($nested);
+	},
+};
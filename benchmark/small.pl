@@ -0,0 +1,35 @@
+#!/usr/bin/env perl
+
+# Per-call overhead on small documents: the object keeps a writer, buffers
+# and an encoder warm, the functional interface shares them for the global
+# options.
+
+use FindBin;
+use lib ("$FindBin::Bin/../blib/lib", "$FindBin::Bin/../blib/arch");
+use XML::Hash::XS qw();
+use Benchmark qw(:all);
+
+my $hash = {
+    id    => 12345,
+    name  => 'small document',
+    tags  => [ 'a', 'b', 'c' ],
+    attrs => { x => 1, y => 2 },
+};
+
+my $conv     = XML::Hash::XS->new();
+my $conv_enc = XML::Hash::XS->new(encoding => 'cp1251');
+
+cmpthese -3, {
+	'function' => sub {
+		my $oxml = XML::Hash::XS::hash2xml($hash);
+	},
+	'object' => sub {
+		my $oxml = $conv->hash2xml($hash);
+	},
+	'function, cp1251' => sub {
+		my $oxml = XML::Hash::XS::hash2xml($hash, encoding => 'cp1251');
+	},
+	'object, cp1251' => sub {
+		my $oxml = $conv_enc->hash2xml($hash);
+	},
+};
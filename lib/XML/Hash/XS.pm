@@ -8,14 +8,15 @@ use warnings;
 use vars qw($VERSION @EXPORT @EXPORT_OK);
 
 use base 'Exporter';
-@EXPORT_OK = @EXPORT = qw( hash2xml );
+@EXPORT    = qw( hash2xml );
+@EXPORT_OK = qw( hash2xml hash2xml_size hash2xml_many hash2xml_checksum );
 
 $VERSION = '0.26';
 
 require XSLoader;
 XSLoader::load('XML::Hash::XS', $VERSION);
 
-use vars qw($method $output $root $version $encoding $indent $canonical
+use vars qw($method $output $output_fd $output_file $separator $output_size $buf_size $huge_size $async $compress $compress_level $checksum $root $version $encoding $indent $canonical
     $use_attr $content $xml_decl $doc $max_depth $attr $text $trim $cdata $comm
 );
 
@@ -24,6 +25,16 @@ our $method    = 'NATIVE';
 
 # native options
 $output    = undef;
+$output_fd   = undef;
+$output_file = undef;
+$separator   = undef;
+$output_size = 0;
+$buf_size    = 16384;
+$huge_size   = 0;
+$async       = 0;
+$compress    = undef;
+$compress_level = -1;
+$checksum    = undef;
 $root      = 'root';
 $version   = '1.0';
 $encoding  = 'utf-8';
@@ -42,6 +53,9 @@ $text      = '#text';
 $cdata     = undef;
 $comm      = undef;
 
+# objects own C state, which can't be shared between threads
+sub CLONE_SKIP { 1 }
+
 1;
 __END__
 =head1 NAME
@@ -62,6 +76,14 @@ Or OOP way:
     my $conv = XML::Hash::XS->new([<options>])
     my $xmlstr = $conv->hash2xml(\%hash, [<options>]);
 
+The object keeps its buffers and encoder between calls. The functions keep
+the same state for the global options, which are parsed again only after one
+of the C<$XML::Hash::XS::*> variables is assigned or replaced through its glob,
+so both ways are equally fast for many small documents. A handle in
+C<$XML::Hash::XS::output> is not kept after the call. The last few lists of per-call options
+are remembered too, repeated calls with the same options don't parse them
+again.
+
 =head1 DESCRIPTION
 
 This module implements simple hash to XML conversion written in C.
@@ -136,9 +158,73 @@ will convert to:
       <node5 node51="value51"/>
     </root>
 
+=head2 hash2xml_size $hash, [ %options ]
+
+returns the exact length in bytes (after encoding and compression) of the document that hash2xml would produce
+with the same options, the document is not stored anywhere and output options are ignored.
+Without encoding and compression only the lengths are counted, nothing is copied or escaped.
+
+    my $length = hash2xml_size(\%hash, indent => 2);
+
+=head2 hash2xml_many \@hashes, [ %options ]
+
+converts every hash of the array with one setup: the options are parsed once, the buffers and the encoder serve
+all documents. It returns an array reference of documents or, if "separator" or an output is set,
+a single stream of documents joined by the separator.
+
+    my $docs   = hash2xml_many(\@messages, xml_decl => 0);
+    my $stream = hash2xml_many(\@messages, xml_decl => 0, separator => "\n");
+
+The "checksum" option is computed for the whole stream and croaks when the documents are returned as an array.
+
+=head2 hash2xml_checksum $hash, [ %options ]
+
+converts the hash like hash2xml and returns the document, the hex digest of the "checksum" option
+(undef if it is not set) and the byte count, see option "checksum".
+
+    my ($xml, $etag, $length) = hash2xml_checksum(\%hash, checksum => 'crc32');
+
+=head2 $conv->checksum
+
+hex digest of the document produced by the last call of the object, undef if the "checksum" option is not set
+
+=head2 $conv->bytes
+
+byte count of the document produced by the last call of the object
+
+=head2 $conv->hash2xml_iter $hash, [ %options ]
+
+returns an iterator that converts the document on demand, so a huge document doesn't block an event loop.
+Each call of C<next> continues the conversion where the previous one stopped and returns the next chunk
+of at most $size bytes (65536 by default) in the output encoding, undef after the end of the document.
+The iterator has no output: it croaks when C<output>, C<output_fd>, C<output_file> or C<async> is set,
+either per call or by the object and its global defaults. The hash must not be changed while the iterator is in use.
+
+    my $it = $conv->hash2xml_iter(\%hash, indent => 2);
+    while (defined(my $chunk = $it->next(65536))) {
+        $handle->push_write($chunk);
+    }
+
+=head2 XML::Hash::XS::Writer->new( [ %options ] )
+
+returns a writer that builds a document record by record, so an export never has to be in memory as a whole.
+It takes the same options as hash2xml; the output, encoder and indent state persist between the calls.
+
+    my $w = XML::Hash::XS::Writer->new(output => $fh, indent => 2);
+    $w->start('export', date => '2024-01-01');   # <export date="2024-01-01">
+    while (my $row = $sth->fetchrow_hashref) {
+        $w->add(item => $row);                    # <item>...</item>
+    }
+    $w->raw("<!-- done -->\n");                   # written as is
+    $w->end;                                      # </export>
+
+C<end> returns the document when no output is set, the writer can be started again after it.
 
 =head1 OPTIONS
 
+Every option has a global variable with the same name, e.g. C<$XML::Hash::XS::indent>,
+which is the default of the functional interface and of C<new>.
+
 =over 4
 
 =item doc [ => 0 ]
@@ -171,6 +257,67 @@ XML output method
 if output is undefined, XML document dumped into string.
 
 if output is FH, XML document writes directly to a filehandle or a stream.
+When the filehandle has no translating layers (":utf8", ":crlf", ":encoding"),
+the handle is flushed and the document is written to its file descriptor, bypassing the PerlIO buffer.
+
+if output is "segments", XML document is returned as a reference to an array of strings,
+which are filled one by one (up to 1 MB each), so a huge document is never copied to grow a single string:
+
+    print $fh @{ hash2xml(\%hash, output => 'segments') };
+
+=item output_fd [ = undef ]
+
+XML document writes directly to the file descriptor with write(2), bypassing PerlIO.
+Pending output and large raw values (e.g. returned by "toString") are sent together with writev(2) without copying.
+
+=item output_file [ = undef ]
+
+XML document writes to the file with the given name, the file is created or truncated.
+
+=item separator [ = undef ]
+
+hash2xml_many joins the documents by this string into a single stream instead of returning an array.
+
+=item output_size [ = 0 ]
+
+expected size of the document in bytes, when writing to a regular file via output_fd or output_file
+the space is preallocated and the kernel is advised about sequential access.
+
+=item buf_size [ = 16384 ]
+
+size of the output buffer in bytes for the streaming outputs, minimum is 256.
+
+=item huge_size [ = 0 ]
+
+when the buffer of a string result grows beyond this size in bytes, it grows by whole 2 MB pages
+and the kernel is advised to back it by transparent huge pages (Linux), "0" - disabled.
+
+=item async [ = 0 ]
+
+if async is "1", filled buffers are encoded and written by a background thread
+while the next buffer is filled, so serialization overlaps with I/O.
+Used only when the document goes to a file descriptor (output_fd, output_file or a filehandle without translating layers)
+and the module is built with pthreads, otherwise the option is ignored.
+
+=item compress [ = undef ]
+
+if compress is "gzip", the document is compressed on the fly (after encoding) into the gzip format,
+both for the string result and for the outputs. The uncompressed document is never kept in memory.
+The string result is bytes, a filehandle must be in binary mode.
+
+=item compress_level [ = -1 ]
+
+compression level from "0" (no compression) to "9" (best compression), "-1" is the default level of zlib.
+
+=item checksum [ = undef ]
+
+"crc32" or "xxh64", checksum of the produced bytes (after encoding and compression) computed during serialization.
+hash2xml_checksum returns the document (undef when writing to an output), the hex digest and the byte count:
+
+    my ($xml, $etag, $length) = hash2xml_checksum(\%hash, checksum => 'xxh64');
+
+Objects keep them of the last call, see methods "checksum" and "bytes".
+The byte count is always computed.
 
 =item canonical [ = 0 ]
 
@@ -198,6 +345,10 @@ if xml_decl is "0", XML declaration will not be output.
 
 Trim leading and trailing whitespace from text nodes
 
+=item max_depth [ = 1024 ]
+
+Maximum nesting depth of references. The conversion doesn't use recursion, so the limit may be raised as far as the data requires.
+
 =item method [ = 'NATIVE' ]
 
 experimental support the conversion methods other libraries
@@ -1,8 +1,11 @@
 #include "xh_config.h"
 #include "xh_core.h"
+#ifdef HAS_MADVISE
+#include <sys/mman.h>
+#endif
 
 void
-xh_buffer_init(xh_buffer_t *buf, size_t size)
+xh_buffer_init(pTHX_ xh_buffer_t *buf, size_t size)
 {
     buf->scalar = newSV(size);
     sv_setpv(buf->scalar, "");
@@ -12,7 +15,7 @@ xh_buffer_init(xh_buffer_t *buf, size_t size)
 }
 
 void
-xh_buffer_resize(xh_buffer_t *buf, size_t inc)
+xh_buffer_resize(pTHX_ xh_buffer_t *buf, size_t inc)
 {
     size_t size, use;
 
@@ -25,6 +28,11 @@ xh_buffer_resize(xh_buffer_t *buf, size_t inc)
 
     size += inc < size ? size : inc;
 
+    /* large buffers grow by whole huge pages */
+    if (size >= XH_BUFFER_HUGE_PAGE) {
+        size = (size + XH_BUFFER_HUGE_PAGE - 1) & ~((size_t) XH_BUFFER_HUGE_PAGE - 1);
+    }
+
     SvCUR_set(buf->scalar, use);
     SvGROW(buf->scalar, size);
 
@@ -32,3 +40,31 @@ xh_buffer_resize(xh_buffer_t *buf, size_t inc)
     buf->cur   = buf->start + use;
     buf->end   = buf->start + size;
 }
+
+/* asks the kernel to back the buffer by transparent huge pages */
+void
+xh_buffer_advise_huge(xh_buffer_t *buf)
+{
+#if defined(HAS_MADVISE) && defined(MADV_HUGEPAGE)
+    uintptr_t start, end;
+
+    start = ((uintptr_t) buf->start + XH_BUFFER_HUGE_PAGE - 1) & ~((uintptr_t) XH_BUFFER_HUGE_PAGE - 1);
+    end   = (uintptr_t) buf->end & ~((uintptr_t) XH_BUFFER_HUGE_PAGE - 1);
+
+    if (end > start) {
+        (void) madvise((void *) start, end - start, MADV_HUGEPAGE);
+    }
+#else
+    (void) buf;
+#endif
+}
+
+void
+xh_buffer_destroy(pTHX_ xh_buffer_t *buf)
+{
+    if (buf->scalar != NULL) {
+        SvREFCNT_dec(buf->scalar);
+    }
+
+    memset(buf, 0, sizeof(xh_buffer_t));
+}
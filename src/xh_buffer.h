@@ -4,6 +4,8 @@
 #include "xh_config.h"
 #include "xh_core.h"
 
+#define XH_BUFFER_HUGE_PAGE (2 * 1024 * 1024)
+
 typedef struct _xh_buffer_t xh_buffer_t;
 struct _xh_buffer_t {
     SV                    *scalar;
@@ -12,7 +14,9 @@ struct _xh_buffer_t {
     char                  *end;
 };
 
-void xh_buffer_init(xh_buffer_t *buf, size_t size);
-void xh_buffer_resize(xh_buffer_t *buf, size_t inc);
+void xh_buffer_init(pTHX_ xh_buffer_t *buf, size_t size);
+void xh_buffer_resize(pTHX_ xh_buffer_t *buf, size_t inc);
+void xh_buffer_destroy(pTHX_ xh_buffer_t *buf);
+void xh_buffer_advise_huge(xh_buffer_t *buf);
 
 #endif /* _XH_BUFFER_H_ */
@@ -0,0 +1,200 @@
+#include "xh_config.h"
+#include "xh_core.h"
+#include <inttypes.h>
+
+#define XH_XXH64_PRIME1 UINT64_C(0x9E3779B185EBCA87)
+#define XH_XXH64_PRIME2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define XH_XXH64_PRIME3 UINT64_C(0x165667B19E3779F9)
+#define XH_XXH64_PRIME4 UINT64_C(0x85EBCA77C2B2AE63)
+#define XH_XXH64_PRIME5 UINT64_C(0x27D4EB2F165667C5)
+
+#define xh_xxh64_rotl(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+XH_INLINE uint64_t
+xh_xxh64_read64(const u_char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if BYTEORDER == 0x87654321 || BYTEORDER == 0x4321
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+XH_INLINE uint32_t
+xh_xxh64_read32(const u_char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+#if BYTEORDER == 0x87654321 || BYTEORDER == 0x4321
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+XH_INLINE uint64_t
+xh_xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XH_XXH64_PRIME2;
+    acc  = xh_xxh64_rotl(acc, 31);
+    return acc * XH_XXH64_PRIME1;
+}
+
+XH_INLINE uint64_t
+xh_xxh64_merge_round(uint64_t acc, uint64_t val)
+{
+    acc ^= xh_xxh64_round(0, val);
+    return acc * XH_XXH64_PRIME1 + XH_XXH64_PRIME4;
+}
+
+static const u_char *
+xh_xxh64_stripes(uint64_t *v, const u_char *p, const u_char *end)
+{
+    while (end - p >= 32) {
+        v[0] = xh_xxh64_round(v[0], xh_xxh64_read64(p));
+        v[1] = xh_xxh64_round(v[1], xh_xxh64_read64(p + 8));
+        v[2] = xh_xxh64_round(v[2], xh_xxh64_read64(p + 16));
+        v[3] = xh_xxh64_round(v[3], xh_xxh64_read64(p + 24));
+        p += 32;
+    }
+    return p;
+}
+
+static uint64_t
+xh_xxh64_digest(xh_checksum_t *checksum)
+{
+    const u_char *p   = checksum->mem;
+    const u_char *end = p + checksum->mem_size;
+    uint64_t     *v   = checksum->v;
+    uint64_t      h;
+
+    if (checksum->bytes >= 32) {
+        h = xh_xxh64_rotl(v[0], 1) + xh_xxh64_rotl(v[1], 7)
+          + xh_xxh64_rotl(v[2], 12) + xh_xxh64_rotl(v[3], 18);
+        h = xh_xxh64_merge_round(h, v[0]);
+        h = xh_xxh64_merge_round(h, v[1]);
+        h = xh_xxh64_merge_round(h, v[2]);
+        h = xh_xxh64_merge_round(h, v[3]);
+    }
+    else {
+        h = v[2] + XH_XXH64_PRIME5;
+    }
+
+    h += checksum->bytes;
+
+    while (end - p >= 8) {
+        h ^= xh_xxh64_round(0, xh_xxh64_read64(p));
+        h  = xh_xxh64_rotl(h, 27) * XH_XXH64_PRIME1 + XH_XXH64_PRIME4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= (uint64_t) xh_xxh64_read32(p) * XH_XXH64_PRIME1;
+        h  = xh_xxh64_rotl(h, 23) * XH_XXH64_PRIME2 + XH_XXH64_PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * XH_XXH64_PRIME5;
+        h  = xh_xxh64_rotl(h, 11) * XH_XXH64_PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= XH_XXH64_PRIME2;
+    h ^= h >> 29;
+    h *= XH_XXH64_PRIME3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+xh_checksum_type_t
+xh_checksum_type(pTHX_ SV *value)
+{
+    char *str;
+
+    if (!SvOK(value)) {
+        return XH_CHECKSUM_NONE;
+    }
+
+    str = SvPV_nolen(value);
+    if (str[0] == '\0') {
+        return XH_CHECKSUM_NONE;
+    }
+    if (strcasecmp(str, "xxh64") == 0) {
+        return XH_CHECKSUM_XXH64;
+    }
+#ifdef XH_HAVE_ZLIB
+    if (strcasecmp(str, "crc32") == 0) {
+        return XH_CHECKSUM_CRC32;
+    }
+#endif
+
+    croak("Unsupported checksum '%s'", str);
+}
+
+void
+xh_checksum_init(xh_checksum_t *checksum, xh_checksum_type_t type)
+{
+    memset(checksum, 0, sizeof(xh_checksum_t));
+
+    checksum->type = type;
+    checksum->v[0] = XH_XXH64_PRIME1 + XH_XXH64_PRIME2;
+    checksum->v[1] = XH_XXH64_PRIME2;
+    checksum->v[2] = 0;
+    checksum->v[3] = -XH_XXH64_PRIME1;
+}
+
+/* doesn't use the Perl API, safe to call from the flush thread */
+void
+xh_checksum_update(xh_checksum_t *checksum, const char *s, size_t len)
+{
+    const u_char *p   = (const u_char *) s;
+    const u_char *end = p + len;
+    size_t        fill;
+
+    checksum->bytes += len;
+
+    switch (checksum->type) {
+        case XH_CHECKSUM_NONE:
+            break;
+#ifdef XH_HAVE_ZLIB
+        case XH_CHECKSUM_CRC32:
+            while (p < end) {
+                fill = end - p > 0x40000000 ? 0x40000000 : end - p;
+                checksum->crc = (uint32_t) crc32(checksum->crc, p, (uInt) fill);
+                p += fill;
+            }
+            break;
+#endif
+        default:
+            if (checksum->mem_size + len < 32) {
+                memcpy(checksum->mem + checksum->mem_size, p, len);
+                checksum->mem_size += len;
+                break;
+            }
+            if (checksum->mem_size > 0) {
+                fill = 32 - checksum->mem_size;
+                memcpy(checksum->mem + checksum->mem_size, p, fill);
+                (void) xh_xxh64_stripes(checksum->v, checksum->mem, checksum->mem + 32);
+                p += fill;
+                checksum->mem_size = 0;
+            }
+            p = xh_xxh64_stripes(checksum->v, p, end);
+            memcpy(checksum->mem, p, end - p);
+            checksum->mem_size = end - p;
+    }
+}
+
+void
+xh_checksum_digest(xh_checksum_t *checksum, char *digest)
+{
+    switch (checksum->type) {
+        case XH_CHECKSUM_CRC32:
+            (void) sprintf(digest, "%08x", (unsigned int) checksum->crc);
+            break;
+        case XH_CHECKSUM_XXH64:
+            (void) sprintf(digest, "%016" PRIx64, xh_xxh64_digest(checksum));
+            break;
+        default:
+            digest[0] = '\0';
+    }
+}
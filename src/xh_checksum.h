@@ -0,0 +1,31 @@
+#ifndef _XH_CHECKSUM_H_
+#define _XH_CHECKSUM_H_
+
+#include "xh_config.h"
+#include "xh_core.h"
+
+/* hex digest and '\0' */
+#define XH_CHECKSUM_DIGEST_LEN 17
+
+typedef enum {
+    XH_CHECKSUM_NONE,
+    XH_CHECKSUM_CRC32,
+    XH_CHECKSUM_XXH64
+} xh_checksum_type_t;
+
+typedef struct _xh_checksum_t xh_checksum_t;
+struct _xh_checksum_t {
+    xh_checksum_type_t     type;
+    uint64_t               bytes;
+    uint32_t               crc;
+    uint64_t               v[4];
+    u_char                 mem[32];
+    size_t                 mem_size;
+};
+
+xh_checksum_type_t xh_checksum_type(pTHX_ SV *value);
+void xh_checksum_init(xh_checksum_t *checksum, xh_checksum_type_t type);
+void xh_checksum_update(xh_checksum_t *checksum, const char *s, size_t len);
+void xh_checksum_digest(xh_checksum_t *checksum, char *digest);
+
+#endif /* _XH_CHECKSUM_H_ */
@@ -0,0 +1,88 @@
+#include "xh_config.h"
+#include "xh_core.h"
+
+#ifdef XH_HAVE_ZLIB
+
+/* 15 bits window and a gzip header */
+#define XH_COMPRESSOR_GZIP_BITS (15 + 16)
+
+xh_compressor_t *
+xh_compressor_create(xh_int_t level)
+{
+    xh_compressor_t *compressor;
+
+    compressor = malloc(sizeof(xh_compressor_t));
+    if (compressor == NULL) {
+        return NULL;
+    }
+    memset(compressor, 0, sizeof(xh_compressor_t));
+
+    if (deflateInit2(&compressor->z, (int) level, Z_DEFLATED, XH_COMPRESSOR_GZIP_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(compressor);
+        return NULL;
+    }
+    compressor->level = level;
+
+    return compressor;
+}
+
+void
+xh_compressor_destroy(xh_compressor_t *compressor)
+{
+    if (compressor != NULL) {
+        (void) deflateEnd(&compressor->z);
+        free(compressor);
+    }
+}
+
+void
+xh_compressor_reset(xh_compressor_t *compressor, xh_int_t level)
+{
+    (void) deflateReset(&compressor->z);
+
+    if (compressor->level != level) {
+        (void) deflateParams(&compressor->z, (int) level, Z_DEFAULT_STRATEGY);
+        compressor->level = level;
+    }
+}
+
+/*
+ * Compresses the input buffer into the output one and empties the input.
+ * Doesn't use the Perl API, the drain callback decides what to do
+ * with a full output buffer.
+ */
+int
+xh_compressor_compress(xh_compressor_t *compressor, xh_buffer_t *in, xh_buffer_t *out,
+    xh_bool_t finish, xh_compressor_drain_t drain, void *arg)
+{
+    z_stream *z = &compressor->z;
+    int       rc, err;
+
+    z->next_in  = (Bytef *) in->start;
+    z->avail_in = (uInt) (in->cur - in->start);
+
+    for (;;) {
+        z->next_out  = (Bytef *) out->cur;
+        z->avail_out = (uInt) (out->end - out->cur);
+
+        rc = deflate(z, finish ? Z_FINISH : Z_NO_FLUSH);
+
+        out->cur = (char *) z->next_out;
+
+        if (rc == Z_STREAM_ERROR) {
+            return rc;
+        }
+        if (z->avail_in == 0 && (!finish || rc == Z_STREAM_END)) {
+            break;
+        }
+        if (z->avail_out == 0 && (err = drain(arg, out)) != 0) {
+            return err;
+        }
+    }
+
+    in->cur = in->start;
+
+    return 0;
+}
+
+#endif /* XH_HAVE_ZLIB */
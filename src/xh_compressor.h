@@ -0,0 +1,28 @@
+#ifndef _XH_COMPRESSOR_H_
+#define _XH_COMPRESSOR_H_
+
+#include "xh_config.h"
+#include "xh_core.h"
+
+#ifdef XH_HAVE_ZLIB
+
+#include <zlib.h>
+
+/* returns 0 or an error code, called when the output buffer is full */
+typedef int (*xh_compressor_drain_t)(void *arg, xh_buffer_t *out);
+
+typedef struct _xh_compressor_t xh_compressor_t;
+struct _xh_compressor_t {
+    z_stream               z;
+    xh_int_t               level;
+};
+
+xh_compressor_t *xh_compressor_create(xh_int_t level);
+void xh_compressor_destroy(xh_compressor_t *compressor);
+void xh_compressor_reset(xh_compressor_t *compressor, xh_int_t level);
+int xh_compressor_compress(xh_compressor_t *compressor, xh_buffer_t *in, xh_buffer_t *out,
+    xh_bool_t finish, xh_compressor_drain_t drain, void *arg);
+
+#endif /* XH_HAVE_ZLIB */
+
+#endif /* _XH_COMPRESSOR_H_ */
@@ -1,6 +1,7 @@
 #ifndef _XH_CONFIG_H_
 #define _XH_CONFIG_H_
 
+#define PERL_NO_GET_CONTEXT
 #include "EXTERN.h"
 #include "perl.h"
 #define NO_XSLOCKS
@@ -23,9 +24,11 @@
 #if __GNUC__ >= 3
 # define expect(expr,value)         __builtin_expect ((expr), (value))
 # define XH_INLINE                  static inline
+# define XH_PREFETCH(addr)          __builtin_prefetch (addr)
 #else
 # define expect(expr,value)         (expr)
 # define XH_INLINE                  static
+# define XH_PREFETCH(addr)
 #endif
 
 #define expect_false(expr) expect ((expr) != 0, 0)
@@ -10,13 +10,18 @@
 #endif
 
 #include "xh_string.h"
-#include "xh_sort.h"
 #include "xh_stack.h"
+#include "xh_hash.h"
+#include "xh_sort.h"
 #include "xh_stash.h"
 #include "xh_param.h"
 #include "xh_buffer_helper.h"
 #include "xh_buffer.h"
+#include "xh_escape.h"
 #include "xh_encoder.h"
+#include "xh_compressor.h"
+#include "xh_checksum.h"
+#include "xh_worker.h"
 #include "xh_writer.h"
 #include "xh_h2x.h"
 #include "xh_xml.h"
@@ -89,7 +89,7 @@ x_PmmNewNode(xmlNodePtr node)
 }
 
 SV *
-x_PmmNodeToSv(xmlNodePtr node, ProxyNodePtr owner)
+x_PmmNodeToSv(pTHX_ xmlNodePtr node, ProxyNodePtr owner)
 {
     ProxyNodePtr dfProxy= NULL;
     SV * retval = &PL_sv_undef;
@@ -53,10 +53,21 @@ typedef DocProxyNode* DocProxyNodePtr;
 #define x_PmmUSEREGISTRY       (x_PROXY_NODE_REGISTRY_MUTEX != NULL)
 #define x_PmmREGISTRY          (INT2PTR(xmlHashTablePtr,SvIV(SvRV(get_sv("XML::LibXML::__PROXY_NODE_REGISTRY",0)))))
 
-SV *x_PmmNodeToSv(xmlNodePtr node, ProxyNodePtr owner);
+SV *x_PmmNodeToSv(pTHX_ xmlNodePtr node, ProxyNodePtr owner);
+
+/* the children of the frame are added to the node */
+XH_INLINE xh_h2x_frame_t *
+xh_h2d_push_frame(xh_h2x_ctx_t *ctx, xmlNodePtr node, char *key, I32 key_len, SV *value, xh_int_t flag)
+{
+    xh_h2x_frame_t *frame = xh_h2x_push_frame(ctx, key, key_len, value, flag);
+
+    frame->node = node;
+
+    return frame;
+}
 
 XH_INLINE xmlNodePtr
-xh_dom_new_node(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *name, size_t name_len, SV *value, xh_bool_t raw)
+xh_dom_new_node(pTHX_ xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *name, size_t name_len, SV *value, xh_bool_t raw)
 {
     char          *tmp;
     char          *content;
@@ -117,7 +128,7 @@ xh_dom_new_node(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *name, size_t name_
 }
 
 XH_INLINE void
-xh_dom_new_content(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value)
+xh_dom_new_content(pTHX_ xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value)
 {
     char          *content;
     size_t         content_len;
@@ -148,7 +159,7 @@ xh_dom_new_content(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value)
 }
 
 XH_INLINE void
-xh_dom_new_comment(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value)
+xh_dom_new_comment(pTHX_ xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value)
 {
     char          *content;
     size_t         content_len;
@@ -179,7 +190,7 @@ xh_dom_new_comment(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value)
 }
 
 XH_INLINE void
-xh_dom_new_cdata(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value)
+xh_dom_new_cdata(pTHX_ xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value)
 {
     char          *content;
     size_t         content_len;
@@ -202,7 +213,7 @@ xh_dom_new_cdata(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value)
 }
 
 XH_INLINE void
-xh_dom_new_attribute(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *name, size_t name_len, SV *value)
+xh_dom_new_attribute(pTHX_ xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *name, size_t name_len, SV *value)
 {
     char          *content;
     STRLEN         str_len;
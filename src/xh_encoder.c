@@ -92,7 +92,24 @@ xh_encoder_create(char *encoding)
 }
 
 void
-xh_encoder_encode(xh_encoder_t *encoder, xh_buffer_t *main_buf, xh_buffer_t *enc_buf)
+xh_encoder_reset(xh_encoder_t *encoder)
+{
+#ifdef XH_HAVE_ICONV
+    if (encoder->type == ENC_ICONV) {
+        (void) iconv(encoder->iconv, NULL, NULL, NULL, NULL);
+        return;
+    }
+#endif
+
+#ifdef XH_HAVE_ICU
+    ucnv_reset(encoder->uconv);
+    ucnv_reset(encoder->utf8);
+#endif
+}
+
+/* doesn't use the Perl API, safe to call from the flush thread */
+xh_bool_t
+xh_encoder_convert(xh_encoder_t *encoder, xh_buffer_t *main_buf, xh_buffer_t *enc_buf)
 {
     char   *src  = main_buf->start;
 
@@ -102,10 +119,7 @@ xh_encoder_encode(xh_encoder_t *encoder, xh_buffer_t *main_buf, xh_buffer_t *enc
         size_t out_left = enc_buf->end - enc_buf->cur;
 
         size_t converted = iconv(encoder->iconv, &src, &in_left, &enc_buf->cur, &out_left);
-        if (converted == (size_t) -1) {
-            croak("Convert error");
-        }
-        return;
+        return converted == (size_t) -1 ? FALSE : TRUE;
     }
 #endif
 
@@ -115,10 +129,18 @@ xh_encoder_encode(xh_encoder_t *encoder, xh_buffer_t *main_buf, xh_buffer_t *enc
                    (const char **) &src, main_buf->cur, NULL, NULL, NULL, NULL,
                    FALSE, TRUE, &err);
 
-    if ( U_FAILURE(err) ) {
-        croak("Convert error: %d", err);
-    }
+    return U_FAILURE(err) ? FALSE : TRUE;
+#else
+    return FALSE;
 #endif
 }
 
+void
+xh_encoder_encode(xh_encoder_t *encoder, xh_buffer_t *main_buf, xh_buffer_t *enc_buf)
+{
+    if (!xh_encoder_convert(encoder, main_buf, enc_buf)) {
+        croak("Convert error");
+    }
+}
+
 #endif /* XH_HAVE_ENCODER */
@@ -36,6 +36,8 @@ struct _xh_encoder_t {
 
 void xh_encoder_destroy(xh_encoder_t *encoder);
 xh_encoder_t *xh_encoder_create(char *encoding);
+void xh_encoder_reset(xh_encoder_t *encoder);
+xh_bool_t xh_encoder_convert(xh_encoder_t *encoder, xh_buffer_t *main_buf, xh_buffer_t *enc_buf);
 void xh_encoder_encode(xh_encoder_t *encoder, xh_buffer_t *main_buf, xh_buffer_t *enc_buf);
 
 #endif /* XH_HAVE_ENCODER */
@@ -0,0 +1,234 @@
+#include "xh_config.h"
+#include "xh_core.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define XH_HAVE_SSE2
+#include <emmintrin.h>
+#if (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) || defined(__clang__)
+#define XH_HAVE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#define XH_ESCAPE_SWAR_ONES  UINT64_C(0x0101010101010101)
+#define XH_ESCAPE_SWAR_HIGHS UINT64_C(0x8080808080808080)
+
+#define XH_ESCAPE_SWAR_HAS_BYTE(v, c)                                  \
+    ((((v) ^ (XH_ESCAPE_SWAR_ONES * (c))) - XH_ESCAPE_SWAR_ONES)       \
+        & ~((v) ^ (XH_ESCAPE_SWAR_ONES * (c))) & XH_ESCAPE_SWAR_HIGHS)
+
+/* number of extra bytes the entity adds, zero - no escaping needed */
+const char xh_escape_text_table[256] = {
+    ['\r'] = 4, ['<'] = 3, ['>'] = 3, ['&'] = 4
+};
+
+const char xh_escape_attr_table[256] = {
+    ['\n'] = 4, ['\r'] = 4, ['\t'] = 3, ['<'] = 3, ['>'] = 3, ['&'] = 4, ['"'] = 5
+};
+
+xh_escape_kernel_t xh_escape_kernel;
+
+static const char *
+xh_escape_find_text_swar(const char *s, const char *end)
+{
+    uint64_t v;
+
+    while (end - s >= 8) {
+        memcpy(&v, s, 8);
+        if (XH_ESCAPE_SWAR_HAS_BYTE(v, '<') | XH_ESCAPE_SWAR_HAS_BYTE(v, '>')
+          | XH_ESCAPE_SWAR_HAS_BYTE(v, '&') | XH_ESCAPE_SWAR_HAS_BYTE(v, '\r'))
+            break;
+        s += 8;
+    }
+
+    while (s < end && !xh_escape_text_table[(u_char) *s]) s++;
+
+    return s;
+}
+
+static const char *
+xh_escape_find_attr_swar(const char *s, const char *end)
+{
+    uint64_t v;
+
+    while (end - s >= 8) {
+        memcpy(&v, s, 8);
+        if (XH_ESCAPE_SWAR_HAS_BYTE(v, '<') | XH_ESCAPE_SWAR_HAS_BYTE(v, '>')
+          | XH_ESCAPE_SWAR_HAS_BYTE(v, '&') | XH_ESCAPE_SWAR_HAS_BYTE(v, '"')
+          | XH_ESCAPE_SWAR_HAS_BYTE(v, '\n') | XH_ESCAPE_SWAR_HAS_BYTE(v, '\r')
+          | XH_ESCAPE_SWAR_HAS_BYTE(v, '\t'))
+            break;
+        s += 8;
+    }
+
+    while (s < end && !xh_escape_attr_table[(u_char) *s]) s++;
+
+    return s;
+}
+
+#ifdef XH_HAVE_SSE2
+static const char *
+xh_escape_find_text_sse2(const char *s, const char *end)
+{
+    const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>'),
+                  amp = _mm_set1_epi8('&'), cr = _mm_set1_epi8('\r');
+    __m128i       v, m;
+    int           mask;
+
+    while (end - s >= 16) {
+        v    = _mm_loadu_si128((const __m128i *) s);
+        m    = _mm_or_si128(
+                   _mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)),
+                   _mm_or_si128(_mm_cmpeq_epi8(v, amp), _mm_cmpeq_epi8(v, cr))
+               );
+        mask = _mm_movemask_epi8(m);
+        if (mask) return s + __builtin_ctz(mask);
+        s += 16;
+    }
+
+    return xh_escape_find_text_swar(s, end);
+}
+
+static const char *
+xh_escape_find_attr_sse2(const char *s, const char *end)
+{
+    const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>'),
+                  amp = _mm_set1_epi8('&'), quot = _mm_set1_epi8('"'),
+                  lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r'),
+                  tab = _mm_set1_epi8('\t');
+    __m128i       v, m;
+    int           mask;
+
+    while (end - s >= 16) {
+        v    = _mm_loadu_si128((const __m128i *) s);
+        m    = _mm_or_si128(
+                   _mm_or_si128(
+                       _mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)),
+                       _mm_or_si128(_mm_cmpeq_epi8(v, amp), _mm_cmpeq_epi8(v, quot))
+                   ),
+                   _mm_or_si128(
+                       _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)),
+                       _mm_cmpeq_epi8(v, tab)
+                   )
+               );
+        mask = _mm_movemask_epi8(m);
+        if (mask) return s + __builtin_ctz(mask);
+        s += 16;
+    }
+
+    return xh_escape_find_attr_swar(s, end);
+}
+#endif
+
+#ifdef XH_HAVE_AVX2
+__attribute__((target("avx2"))) static const char *
+xh_escape_find_text_avx2(const char *s, const char *end)
+{
+    const __m256i lt = _mm256_set1_epi8('<'), gt = _mm256_set1_epi8('>'),
+                  amp = _mm256_set1_epi8('&'), cr = _mm256_set1_epi8('\r');
+    __m256i       v, m;
+    unsigned int  mask;
+
+    while (end - s >= 32) {
+        v    = _mm256_loadu_si256((const __m256i *) s);
+        m    = _mm256_or_si256(
+                   _mm256_or_si256(_mm256_cmpeq_epi8(v, lt), _mm256_cmpeq_epi8(v, gt)),
+                   _mm256_or_si256(_mm256_cmpeq_epi8(v, amp), _mm256_cmpeq_epi8(v, cr))
+               );
+        mask = (unsigned int) _mm256_movemask_epi8(m);
+        if (mask) return s + __builtin_ctz(mask);
+        s += 32;
+    }
+
+    return xh_escape_find_text_sse2(s, end);
+}
+
+__attribute__((target("avx2"))) static const char *
+xh_escape_find_attr_avx2(const char *s, const char *end)
+{
+    const __m256i lt = _mm256_set1_epi8('<'), gt = _mm256_set1_epi8('>'),
+                  amp = _mm256_set1_epi8('&'), quot = _mm256_set1_epi8('"'),
+                  lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r'),
+                  tab = _mm256_set1_epi8('\t');
+    __m256i       v, m;
+    unsigned int  mask;
+
+    while (end - s >= 32) {
+        v    = _mm256_loadu_si256((const __m256i *) s);
+        m    = _mm256_or_si256(
+                   _mm256_or_si256(
+                       _mm256_or_si256(_mm256_cmpeq_epi8(v, lt), _mm256_cmpeq_epi8(v, gt)),
+                       _mm256_or_si256(_mm256_cmpeq_epi8(v, amp), _mm256_cmpeq_epi8(v, quot))
+                   ),
+                   _mm256_or_si256(
+                       _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)),
+                       _mm256_cmpeq_epi8(v, tab)
+                   )
+               );
+        mask = (unsigned int) _mm256_movemask_epi8(m);
+        if (mask) return s + __builtin_ctz(mask);
+        s += 32;
+    }
+
+    return xh_escape_find_attr_sse2(s, end);
+}
+#endif
+
+static const xh_escape_kernel_t xh_escape_kernels[] = {
+#ifdef XH_HAVE_AVX2
+    { "avx2", xh_escape_find_text_avx2, xh_escape_find_attr_avx2 },
+#endif
+#ifdef XH_HAVE_SSE2
+    { "sse2", xh_escape_find_text_sse2, xh_escape_find_attr_sse2 },
+#endif
+    { "swar", xh_escape_find_text_swar, xh_escape_find_attr_swar },
+    { NULL,   NULL,                     NULL                     }
+};
+
+static xh_bool_t
+xh_escape_kernel_supported(const xh_escape_kernel_t *kernel)
+{
+#ifdef XH_HAVE_AVX2
+    if (strcmp(kernel->name, "avx2") == 0) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+const char *
+xh_escape_kernel_name(xh_uint_t i)
+{
+    const xh_escape_kernel_t *kernel;
+
+    for (kernel = xh_escape_kernels; kernel->name != NULL; kernel++) {
+        if (xh_escape_kernel_supported(kernel) && i-- == 0) {
+            return kernel->name;
+        }
+    }
+
+    return NULL;
+}
+
+xh_bool_t
+xh_escape_set_kernel(const char *name)
+{
+    const xh_escape_kernel_t *kernel;
+
+    for (kernel = xh_escape_kernels; kernel->name != NULL; kernel++) {
+        if (strcmp(kernel->name, name) == 0 && xh_escape_kernel_supported(kernel)) {
+            xh_escape_kernel = *kernel;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+void
+xh_escape_init(void)
+{
+    /* the first supported kernel is the fastest one */
+    (void) xh_escape_set_kernel(xh_escape_kernel_name(0));
+}
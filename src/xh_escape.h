@@ -0,0 +1,141 @@
+#ifndef _XH_ESCAPE_H_
+#define _XH_ESCAPE_H_
+
+#include "xh_config.h"
+#include "xh_core.h"
+
+/* strings shorter than this are escaped byte by byte */
+#define XH_ESCAPE_MIN_LEN 16
+
+typedef const char *(*xh_escape_find_t)(const char *s, const char *end);
+
+typedef struct {
+    const char            *name;
+    xh_escape_find_t       find_text;
+    xh_escape_find_t       find_attr;
+} xh_escape_kernel_t;
+
+extern xh_escape_kernel_t xh_escape_kernel;
+extern const char         xh_escape_text_table[256];
+extern const char         xh_escape_attr_table[256];
+
+void xh_escape_init(void);
+xh_bool_t xh_escape_set_kernel(const char *name);
+const char *xh_escape_kernel_name(xh_uint_t i);
+
+XH_INLINE size_t
+xh_escape_text_len(const char *s, size_t len)
+{
+    const char *end = s + len;
+
+    if (len < XH_ESCAPE_MIN_LEN) {
+        while (s < end) {
+            len += xh_escape_text_table[(u_char) *s++];
+        }
+        return len;
+    }
+
+    while ((s = xh_escape_kernel.find_text(s, end)) != end) {
+        len += xh_escape_text_table[(u_char) *s++];
+    }
+
+    return len;
+}
+
+XH_INLINE size_t
+xh_escape_attr_len(const char *s, size_t len)
+{
+    const char *end = s + len;
+
+    if (len < XH_ESCAPE_MIN_LEN) {
+        while (s < end) {
+            len += xh_escape_attr_table[(u_char) *s++];
+        }
+        return len;
+    }
+
+    while ((s = xh_escape_kernel.find_attr(s, end)) != end) {
+        len += xh_escape_attr_table[(u_char) *s++];
+    }
+
+    return len;
+}
+
+XH_INLINE void
+xh_escape_write_text(xh_buffer_t *buf, const char *s, size_t len)
+{
+    const char *end = s + len, *p;
+    size_t      l;
+
+    if (len < XH_ESCAPE_MIN_LEN) {
+        XH_BUFFER_WRITE_ESCAPE_STRING(buf, s, len)
+        return;
+    }
+
+    while (s < end) {
+        p = xh_escape_kernel.find_text(s, end);
+        l = p - s;
+        XH_BUFFER_WRITE_LONG_STRING(buf, s, l)
+        if (p == end) break;
+
+        switch (*p) {
+            case '\r':
+                XH_BUFFER_WRITE_CHAR5(buf, "&#13;")
+                break;
+            case '<':
+                XH_BUFFER_WRITE_CHAR4(buf, "&lt;")
+                break;
+            case '>':
+                XH_BUFFER_WRITE_CHAR4(buf, "&gt;")
+                break;
+            default:
+                XH_BUFFER_WRITE_CHAR5(buf, "&amp;")
+        }
+        s = p + 1;
+    }
+}
+
+XH_INLINE void
+xh_escape_write_attr(xh_buffer_t *buf, const char *s, size_t len)
+{
+    const char *end = s + len, *p;
+    size_t      l;
+
+    if (len < XH_ESCAPE_MIN_LEN) {
+        XH_BUFFER_WRITE_ESCAPE_ATTR(buf, s, len)
+        return;
+    }
+
+    while (s < end) {
+        p = xh_escape_kernel.find_attr(s, end);
+        l = p - s;
+        XH_BUFFER_WRITE_LONG_STRING(buf, s, l)
+        if (p == end) break;
+
+        switch (*p) {
+            case '\n':
+                XH_BUFFER_WRITE_CHAR5(buf, "&#10;")
+                break;
+            case '\r':
+                XH_BUFFER_WRITE_CHAR5(buf, "&#13;")
+                break;
+            case '\t':
+                XH_BUFFER_WRITE_CHAR4(buf, "&#9;")
+                break;
+            case '<':
+                XH_BUFFER_WRITE_CHAR4(buf, "&lt;")
+                break;
+            case '>':
+                XH_BUFFER_WRITE_CHAR4(buf, "&gt;")
+                break;
+            case '&':
+                XH_BUFFER_WRITE_CHAR5(buf, "&amp;")
+                break;
+            default:
+                XH_BUFFER_WRITE_CHAR6(buf, "&quot;")
+        }
+        s = p + 1;
+    }
+}
+
+#endif /* _XH_ESCAPE_H_ */
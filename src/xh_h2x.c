@@ -2,6 +2,12 @@
 #include "xh_core.h"
 
 #define XH_H2X_DEF_OUTPUT    NULL
+#define XH_H2X_DEF_OUTPUT_FD -1
+#define XH_H2X_DEF_BUF_SIZE  16384
+#define XH_H2X_DEF_OUT_SIZE  0
+#define XH_H2X_DEF_ASYNC     FALSE
+#define XH_H2X_DEF_HUGE_SIZE 0
+#define XH_H2X_DEF_COMP_LEVEL -1
 #define XH_H2X_DEF_METHOD    "NATIVE"
 #define XH_H2X_DEF_ROOT      "root"
 #define XH_H2X_DEF_VERSION   "1.0"
@@ -25,18 +31,278 @@
 
 const char indent_string[60] = "                                                            ";
 
+/* package variables read by xh_h2x_init_opts(aTHX) */
+const char *xh_h2x_global_names[XH_H2X_GLOBALS + 1] = {
+    "XML::Hash::XS::root",        "XML::Hash::XS::version",     "XML::Hash::XS::encoding",
+    "XML::Hash::XS::indent",      "XML::Hash::XS::canonical",   "XML::Hash::XS::content",
+    "XML::Hash::XS::xml_decl",    "XML::Hash::XS::doc",         "XML::Hash::XS::use_attr",
+    "XML::Hash::XS::max_depth",   "XML::Hash::XS::attr",        "XML::Hash::XS::text",
+    "XML::Hash::XS::trim",        "XML::Hash::XS::cdata",       "XML::Hash::XS::comm",
+    "XML::Hash::XS::method",      "XML::Hash::XS::output",      "XML::Hash::XS::output_fd",
+    "XML::Hash::XS::output_file", "XML::Hash::XS::separator",   "XML::Hash::XS::output_size",
+    "XML::Hash::XS::buf_size",    "XML::Hash::XS::huge_size",   "XML::Hash::XS::async",
+    "XML::Hash::XS::compress",    "XML::Hash::XS::compress_level", "XML::Hash::XS::checksum",
+    NULL
+};
+
 #define XH_H2X_STASH_SIZE    16
+#define XH_H2X_FRAMES_SIZE   32
+#define XH_H2X_ROWS_SIZE     8
+
+/* default chunk of the pull iterator */
+#define XH_H2X_DEF_CHUNK_SIZE 65536
+
+static void
+xh_h2x_ctx_init(xh_h2x_ctx_t *ctx)
+{
+    if (ctx->stash.elts == NULL) {
+        xh_stack_init(&ctx->stash, XH_H2X_STASH_SIZE, sizeof(SV *));
+    }
+    if (ctx->frames.elts == NULL) {
+        xh_stack_init(&ctx->frames, XH_H2X_FRAMES_SIZE, sizeof(xh_h2x_frame_t));
+    }
+
+    ctx->sort.scratch.top = 0;
+    ctx->sort.held        = 0;
+    ctx->rows.top = 0;
+    ctx->depth    = 0;
+    ctx->want     = 0;
+}
+
+/* drops the frames of an interrupted traversal */
+static void
+xh_h2x_frames_clean(pTHX_ xh_h2x_ctx_t *ctx)
+{
+    while (ctx->frames.top > 0) {
+        (void) xh_h2x_pop_frame(aTHX_ ctx);
+    }
+}
+
+/* keeps the value and copies the key, the inner frames are switched to the copy */
+static char *
+xh_h2x_hold_entry(pTHX_ xh_h2x_ctx_t *ctx, size_t inner, char *key, I32 key_len, SV *value)
+{
+    xh_h2x_frame_t *frames = (xh_h2x_frame_t *) ctx->frames.elts;
+    SV             *copy;
+
+    xh_stash_push(&ctx->stash, SvREFCNT_inc(value));
 
+    copy = newSVpvn(key, key_len);
+    xh_stash_push(&ctx->stash, copy);
+
+    for (; inner < ctx->frames.top; inner++) {
+        if (frames[inner].key == key) frames[inner].key = SvPVX(copy);
+    }
+
+    return SvPVX(copy);
+}
+
+/*
+ * A callback may delete the entries the hash frames are walking through.
+ * The current entry of a walk is kept until the end of the conversion,
+ * sorted hashes keep all of their entries.
+ */
 void
-xh_h2x_destroy(xh_h2x_opts_t *opts)
+xh_h2x_hold_hashes(pTHX_ xh_h2x_ctx_t *ctx)
 {
-    if (opts != NULL) {
-        free(opts);
+    xh_h2x_frame_t *frame;
+    xh_sort_hash_t *item;
+    size_t          i;
+
+    for (i = 0; i < ctx->frames.top; i++) {
+        frame = (xh_h2x_frame_t *) ctx->frames.elts + i;
+        if ((frame->state == XH_H2X_S_HASH || frame->state == XH_H2X_S_HASH_NODES)
+            && frame->hash.mode == XH_HASH_WALK && frame->hash.he != NULL) {
+            frame->hash.mode = XH_HASH_HELD;
+            (void) xh_h2x_hold_entry(aTHX_ ctx, i + 1, HeKEY(frame->hash.he), HeKLEN(frame->hash.he), HeVAL(frame->hash.he));
+        }
     }
+
+    for (i = ctx->sort.held; i < ctx->sort.scratch.top; i++) {
+        item = xh_sort_hash_item(&ctx->sort, i);
+        item->key = xh_h2x_hold_entry(aTHX_ ctx, 0, item->key, item->key_len, (SV *) item->value);
+    }
+    ctx->sort.held = ctx->sort.scratch.top;
+}
+
+/* reads of values with get magic run code, the key of the value is copied */
+char *
+xh_h2x_hold_plain(pTHX_ xh_h2x_ctx_t *ctx, char *key, I32 key_len)
+{
+    SV *copy;
+
+    xh_h2x_hold_hashes(aTHX_ ctx);
+
+    copy = newSVpvn(key, key_len);
+    xh_stash_push(&ctx->stash, copy);
+
+    return SvPVX(copy);
+}
+
+void
+xh_h2x_ctx_destroy(pTHX_ xh_h2x_ctx_t *ctx)
+{
+    if (ctx->stash.elts != NULL) {
+        xh_stash_clean(aTHX_ &ctx->stash);
+        xh_stack_destroy(&ctx->stash);
+    }
+    xh_sort_destroy(&ctx->sort);
+    if (ctx->frames.elts != NULL) {
+        xh_h2x_frames_clean(aTHX_ ctx);
+        xh_stack_destroy(&ctx->frames);
+    }
+    if (ctx->rows.elts != NULL) {
+        xh_stack_destroy(&ctx->rows);
+    }
+}
+
+/*
+ * Remembers the keys of the first record of an array and their output
+ * order. The keys stay on the stack until the array frame is popped.
+ */
+xh_int_t
+xh_h2x_row_create(pTHX_ xh_h2x_ctx_t *ctx, HV *hv, xh_bool_t node_keys)
+{
+    xh_h2x_row_t   *row;
+    xh_hash_iter_t  iter;
+    size_t          i, len, base;
+
+    len = HvUSEDKEYS(hv);
+    if (len == 0 || len > XH_H2X_ROW_KEYS) return XH_H2X_ROW_NONE;
+
+    if (ctx->rows.elts == NULL) {
+        xh_stack_init(&ctx->rows, XH_H2X_ROWS_SIZE, sizeof(xh_h2x_row_t));
+    }
+
+    row = (xh_h2x_row_t *) xh_stack_push(&ctx->rows);
+    row->len    = len;
+    row->hits   = 0;
+    row->misses = 0;
+
+    xh_hash_iter_init(aTHX_ &iter, hv);
+    for (i = 0; i < len; i++) {
+        (void) xh_hash_iter_next(aTHX_ &iter, &row->keys[i], &row->key_lens[i]);
+        /* special keys are left to the frame path */
+        if (node_keys && xh_h2x_key_class(&ctx->opts, row->keys[i], row->key_lens[i]) != XH_H2X_K_NODE) {
+            ctx->rows.top--;
+            return XH_H2X_ROW_NONE;
+        }
+        row->order[i] = i;
+    }
+
+    if (len > 1 && ctx->opts.canonical) {
+        base = xh_sort_hash(aTHX_ &ctx->sort, hv, len);
+        for (i = 0; i < len; i++) {
+            row->order[i] = xh_sort_hash_item(&ctx->sort, base + i)->index;
+        }
+        xh_sort_hash_release(&ctx->sort, base);
+    }
+
+    return ctx->rows.top - 1;
+}
+
+#define XH_H2X_HOLD_STR(param)                          \
+    if ((param).sv != NULL) {                           \
+        SvREFCNT_inc_void((param).sv);                  \
+    }
+#define XH_H2X_RELEASE_STR(param)                       \
+    if ((param).sv != NULL) {                           \
+        SvREFCNT_dec((param).sv);                       \
+    }
+
+/* options of an object outlive the arguments of new() */
+void
+xh_h2x_hold_opts(pTHX_ xh_h2x_opts_t *opts)
+{
+    XH_H2X_HOLD_STR(opts->root)
+    XH_H2X_HOLD_STR(opts->content)
+    XH_H2X_HOLD_STR(opts->attr)
+    XH_H2X_HOLD_STR(opts->text)
+    XH_H2X_HOLD_STR(opts->cdata)
+    XH_H2X_HOLD_STR(opts->comm)
+
+    if (opts->output != NULL) {
+        SvREFCNT_inc_void((SV *) opts->output);
+    }
+    if (opts->output_file != NULL) {
+        opts->output_file = newSVsv(opts->output_file);
+    }
+    if (opts->separator != NULL) {
+        opts->separator = newSVsv(opts->separator);
+    }
+}
+
+static void
+xh_h2x_release_opts(pTHX_ xh_h2x_opts_t *opts)
+{
+    XH_H2X_RELEASE_STR(opts->root)
+    XH_H2X_RELEASE_STR(opts->content)
+    XH_H2X_RELEASE_STR(opts->attr)
+    XH_H2X_RELEASE_STR(opts->text)
+    XH_H2X_RELEASE_STR(opts->cdata)
+    XH_H2X_RELEASE_STR(opts->comm)
+
+    if (opts->output != NULL) {
+        SvREFCNT_dec((SV *) opts->output);
+    }
+    if (opts->output_file != NULL) {
+        SvREFCNT_dec(opts->output_file);
+    }
+    if (opts->separator != NULL) {
+        SvREFCNT_dec(opts->separator);
+    }
+}
+
+void
+xh_h2x_destroy(pTHX_ xh_h2x_conv_t *conv)
+{
+    if (conv != NULL) {
+        xh_h2x_memo_clean(aTHX_ conv);
+        xh_h2x_release_opts(aTHX_ &conv->opts);
+        xh_writer_destroy(aTHX_ &conv->writer);
+        xh_h2x_ctx_destroy(aTHX_ &conv->ctx);
+        free(conv);
+    }
+}
+
+/* output => 'segments' */
+static xh_bool_t
+xh_h2x_is_segments(pTHX_ SV *value)
+{
+    STRLEN  len;
+    char   *str;
+
+    if (!SvOK(value) || SvROK(value)) {
+        return FALSE;
+    }
+
+    str = SvPV(value, len);
+
+    return len == 8 && xh_str_equal8(str, 's', 'e', 'g', 'm', 'e', 'n', 't', 's');
+}
+
+static xh_writer_compress_t
+xh_h2x_compress(pTHX_ SV *value)
+{
+    char *str;
+
+    if (!SvOK(value)) {
+        return XH_WRITER_COMPRESS_NONE;
+    }
+
+    str = SvPV_nolen(value);
+    if (str[0] == '\0') {
+        return XH_WRITER_COMPRESS_NONE;
+    }
+    if (strcasecmp(str, "gzip") == 0) {
+        return XH_WRITER_COMPRESS_GZIP;
+    }
+
+    croak("Unsupported compression '%s'", str);
 }
 
 xh_bool_t
-xh_h2x_init_opts(xh_h2x_opts_t *opts)
+xh_h2x_init_opts(pTHX_ xh_h2x_opts_t *opts)
 {
     char      method[XH_PARAM_LEN];
     xh_bool_t use_attr;
@@ -44,12 +310,12 @@ xh_h2x_init_opts(xh_h2x_opts_t *opts)
     XH_PARAM_READ_INIT
 
     /* native options */
-    XH_PARAM_READ_STRING(opts->root,      "XML::Hash::XS::root",      XH_H2X_DEF_ROOT);
+    XH_PARAM_READ_STR   (opts->root,      "XML::Hash::XS::root",      XH_H2X_DEF_ROOT);
     XH_PARAM_READ_STRING(opts->version,   "XML::Hash::XS::version",   XH_H2X_DEF_VERSION);
     XH_PARAM_READ_STRING(opts->encoding,  "XML::Hash::XS::encoding",  XH_H2X_DEF_ENCODING);
     XH_PARAM_READ_INT   (opts->indent,    "XML::Hash::XS::indent",    XH_H2X_DEF_INDENT);
     XH_PARAM_READ_BOOL  (opts->canonical, "XML::Hash::XS::canonical", XH_H2X_DEF_CANONICAL);
-    XH_PARAM_READ_STRING(opts->content,   "XML::Hash::XS::content",   XH_H2X_DEF_CONTENT);
+    XH_PARAM_READ_STR   (opts->content,   "XML::Hash::XS::content",   XH_H2X_DEF_CONTENT);
     XH_PARAM_READ_BOOL  (opts->xml_decl,  "XML::Hash::XS::xml_decl",  XH_H2X_DEF_XML_DECL);
 #ifdef XH_HAVE_DOM
     XH_PARAM_READ_BOOL  (opts->doc,       "XML::Hash::XS::doc",       XH_H2X_DEF_DOC);
@@ -58,12 +324,11 @@ xh_h2x_init_opts(xh_h2x_opts_t *opts)
     XH_PARAM_READ_INT   (opts->max_depth, "XML::Hash::XS::max_depth", XH_H2X_DEF_MAX_DEPTH);
 
     /* XML::Hash::LX options */
-    XH_PARAM_READ_STRING(opts->attr,      "XML::Hash::XS::attr",      XH_H2X_DEF_ATTR);
-    opts->attr_len = strlen(opts->attr);
-    XH_PARAM_READ_STRING(opts->text,      "XML::Hash::XS::text",      XH_H2X_DEF_TEXT);
+    XH_PARAM_READ_STR   (opts->attr,      "XML::Hash::XS::attr",      XH_H2X_DEF_ATTR);
+    XH_PARAM_READ_STR   (opts->text,      "XML::Hash::XS::text",      XH_H2X_DEF_TEXT);
     XH_PARAM_READ_BOOL  (opts->trim,      "XML::Hash::XS::trim",      XH_H2X_DEF_TRIM);
-    XH_PARAM_READ_STRING(opts->cdata,     "XML::Hash::XS::cdata",     XH_H2X_DEF_CDATA);
-    XH_PARAM_READ_STRING(opts->comm,      "XML::Hash::XS::comm",      XH_H2X_DEF_COMM);
+    XH_PARAM_READ_STR   (opts->cdata,     "XML::Hash::XS::cdata",     XH_H2X_DEF_CDATA);
+    XH_PARAM_READ_STR   (opts->comm,      "XML::Hash::XS::comm",      XH_H2X_DEF_COMM);
 
     /* method */
     XH_PARAM_READ_STRING(method,          "XML::Hash::XS::method",    XH_H2X_DEF_METHOD);
@@ -79,30 +344,120 @@ xh_h2x_init_opts(xh_h2x_opts_t *opts)
 
     /* output, NULL - to string */
     XH_PARAM_READ_REF   (opts->output,    "XML::Hash::XS::output",    XH_H2X_DEF_OUTPUT);
+    opts->output_segments = sv != NULL && xh_h2x_is_segments(aTHX_ sv);
+    /* output_fd, undef - no descriptor */
+    if ( (sv = get_sv("XML::Hash::XS::output_fd", 0)) != NULL && SvOK(sv) ) {
+        opts->output_fd = SvIV(sv);
+    }
+    else {
+        opts->output_fd = XH_H2X_DEF_OUTPUT_FD;
+    }
+    opts->output_file = get_sv("XML::Hash::XS::output_file", 0);
+    /* separator, undef - hash2xml_many returns an array */
+    if ( (sv = get_sv("XML::Hash::XS::separator", 0)) != NULL && SvOK(sv) ) {
+        opts->separator = sv;
+    }
+    else {
+        opts->separator = NULL;
+    }
+    XH_PARAM_READ_INT   (opts->output_size, "XML::Hash::XS::output_size", XH_H2X_DEF_OUT_SIZE);
+    XH_PARAM_READ_INT   (opts->buf_size,  "XML::Hash::XS::buf_size",  XH_H2X_DEF_BUF_SIZE);
+    XH_PARAM_READ_INT   (opts->huge_size, "XML::Hash::XS::huge_size", XH_H2X_DEF_HUGE_SIZE);
+    XH_PARAM_READ_BOOL  (opts->async,     "XML::Hash::XS::async",     XH_H2X_DEF_ASYNC);
+
+    /* compress, undef - no compression */
+    if ( (sv = get_sv("XML::Hash::XS::compress", 0)) != NULL ) {
+        opts->compress = xh_h2x_compress(aTHX_ sv);
+    }
+    else {
+        opts->compress = XH_WRITER_COMPRESS_NONE;
+    }
+    XH_PARAM_READ_INT   (opts->compress_level, "XML::Hash::XS::compress_level", XH_H2X_DEF_COMP_LEVEL);
+
+    /* checksum, undef - the byte count only */
+    if ( (sv = get_sv("XML::Hash::XS::checksum", 0)) != NULL ) {
+        opts->checksum = xh_checksum_type(aTHX_ sv);
+    }
+    else {
+        opts->checksum = XH_CHECKSUM_NONE;
+    }
+
+    xh_h2x_compile_opts(opts);
 
     return TRUE;
 }
 
-xh_h2x_opts_t *
-xh_h2x_create(void)
+/* rereads the package variables into the options of an object */
+void
+xh_h2x_reload_opts(pTHX_ xh_h2x_conv_t *conv)
+{
+    xh_h2x_opts_t opts;
+
+    memset(&opts, 0, sizeof(xh_h2x_opts_t));
+    (void) xh_h2x_init_opts(aTHX_ &opts);
+    xh_h2x_hold_opts(aTHX_ &opts);
+
+    xh_h2x_memo_clean(aTHX_ conv);
+    xh_h2x_release_opts(aTHX_ &conv->opts);
+    memcpy(&conv->opts, &opts, sizeof(xh_h2x_opts_t));
+}
+
+/* drops the output handle of an object, the option lists keep it too */
+void
+xh_h2x_release_output(pTHX_ xh_h2x_conv_t *conv)
 {
-    xh_h2x_opts_t *opts;
+    xh_h2x_memo_clean(aTHX_ conv);
 
-    if ((opts = malloc(sizeof(xh_h2x_opts_t))) == NULL) {
+    if (conv->opts.output != NULL) {
+        SvREFCNT_dec((SV *) conv->opts.output);
+        conv->opts.output = NULL;
+    }
+}
+
+/* the special keys of the method, see xh_h2x_key_class() */
+void
+xh_h2x_compile_opts(xh_h2x_opts_t *opts)
+{
+    memset(opts->key_first, 0, sizeof(opts->key_first));
+
+    switch (opts->method) {
+        case XH_H2X_METHOD_NATIVE_ATTR_MODE:
+            if (opts->content.len) opts->key_first[(u_char) opts->content.str[0]] |= XH_H2X_K_CONTENT;
+            break;
+        case XH_H2X_METHOD_LX:
+            if (opts->cdata.len) opts->key_first[(u_char) opts->cdata.str[0]] |= XH_H2X_K_CDATA;
+            if (opts->text.len)  opts->key_first[(u_char) opts->text.str[0]]  |= XH_H2X_K_TEXT;
+            if (opts->comm.len)  opts->key_first[(u_char) opts->comm.str[0]]  |= XH_H2X_K_COMM;
+            if (opts->attr.len)  opts->key_first[(u_char) opts->attr.str[0]]  |= XH_H2X_K_ATTR;
+            break;
+        default:
+            break;
+    }
+}
+
+xh_h2x_conv_t *
+xh_h2x_create(pTHX)
+{
+    xh_h2x_conv_t *conv;
+
+    if ((conv = malloc(sizeof(xh_h2x_conv_t))) == NULL) {
         return NULL;
     }
-    memset(opts, 0, sizeof(xh_h2x_opts_t));
+    memset(conv, 0, sizeof(xh_h2x_conv_t));
 
-    if (! xh_h2x_init_opts(opts)) {
-        xh_h2x_destroy(opts);
+    if (! xh_h2x_init_opts(aTHX_ &conv->opts)) {
+        xh_h2x_destroy(aTHX_ conv);
         return NULL;
     }
 
-    return opts;
+    conv->ctx.writer     = &conv->writer;
+    conv->ctx.persistent = TRUE;
+
+    return conv;
 }
 
 void
-xh_h2x_parse_param(xh_h2x_opts_t *opts, xh_int_t first, I32 ax, I32 items)
+xh_h2x_parse_param(pTHX_ xh_h2x_opts_t *opts, xh_int_t first, I32 ax, I32 items)
 {
     xh_int_t  i;
     char     *p, *cv;
@@ -127,48 +482,46 @@ xh_h2x_parse_param(xh_h2x_opts_t *opts, xh_int_t first, I32 ax, I32 items)
 #ifdef XH_HAVE_DOM
             case 3:
                 if (xh_str_equal3(p, 'd', 'o', 'c')) {
-                    opts->doc = xh_param_assign_bool(v);
+                    opts->doc = xh_param_assign_bool(aTHX_ v);
                     break;
                 }
                 goto error;
 #endif
             case 4:
                 if (xh_str_equal4(p, 'a', 't', 't', 'r')) {
-                    xh_param_assign_string(opts->attr, v);
-                    if (opts->attr[0] == '\0') {
-                        opts->attr_len = 0;
-                    }
-                    else {
-                        opts->attr_len = strlen(opts->attr);
-                    }
+                    xh_param_assign_str(aTHX_ &opts->attr, v);
                     break;
                 }
                 if (xh_str_equal4(p, 'c', 'o', 'm', 'm')) {
-                    xh_param_assign_string(opts->comm, v);
+                    xh_param_assign_str(aTHX_ &opts->comm, v);
                     break;
                 }
                 if (xh_str_equal4(p, 'r', 'o', 'o', 't')) {
-                    xh_param_assign_string(opts->root, v);
+                    xh_param_assign_str(aTHX_ &opts->root, v);
                     break;
                 }
                 if (xh_str_equal4(p, 't', 'r', 'i', 'm')) {
-                    opts->trim = xh_param_assign_bool(v);
+                    opts->trim = xh_param_assign_bool(aTHX_ v);
                     break;
                 }
                 if (xh_str_equal4(p, 't', 'e', 'x', 't')) {
-                    xh_param_assign_string(opts->text, v);
+                    xh_param_assign_str(aTHX_ &opts->text, v);
                     break;
                 }
                 goto error;
             case 5:
                 if (xh_str_equal5(p, 'c', 'd', 'a', 't', 'a')) {
-                    xh_param_assign_string(opts->cdata, v);
+                    xh_param_assign_str(aTHX_ &opts->cdata, v);
+                    break;
+                }
+                if (xh_str_equal5(p, 'a', 's', 'y', 'n', 'c')) {
+                    opts->async = xh_param_assign_bool(aTHX_ v);
                     break;
                 }
                 goto error;
             case 6:
                 if (xh_str_equal6(p, 'i', 'n', 'd', 'e', 'n', 't')) {
-                    xh_param_assign_int(p, &opts->indent, v);
+                    xh_param_assign_int(aTHX_ p, &opts->indent, v);
                     break;
                 }
                 if (xh_str_equal6(p, 'm', 'e', 't', 'h', 'o', 'd')) {
@@ -201,40 +554,92 @@ xh_h2x_parse_param(xh_h2x_opts_t *opts, xh_int_t first, I32 ax, I32 items)
                     else {
                         opts->output = NULL;
                     }
+                    opts->output_segments = xh_h2x_is_segments(aTHX_ v);
                     break;
                 }
                 goto error;
             case 7:
                 if (xh_str_equal7(p, 'c', 'o', 'n', 't', 'e', 'n', 't')) {
-                    xh_param_assign_string(opts->content, v);
+                    xh_param_assign_str(aTHX_ &opts->content, v);
                     break;
                 }
                 if (xh_str_equal7(p, 'v', 'e', 'r', 's', 'i', 'o', 'n')) {
-                    xh_param_assign_string(opts->version, v);
+                    xh_param_assign_string(aTHX_ opts->version, v);
                     break;
                 }
                 goto error;
             case 8:
                 if (xh_str_equal8(p, 'e', 'n', 'c', 'o', 'd', 'i', 'n', 'g')) {
-                    xh_param_assign_string(opts->encoding, v);
+                    xh_param_assign_string(aTHX_ opts->encoding, v);
                     break;
                 }
                 if (xh_str_equal8(p, 'u', 's', 'e', '_', 'a', 't', 't', 'r')) {
-                    use_attr = xh_param_assign_bool(v);
+                    use_attr = xh_param_assign_bool(aTHX_ v);
                     break;
                 }
                 if (xh_str_equal8(p, 'x', 'm', 'l', '_', 'd', 'e', 'c', 'l')) {
-                    opts->xml_decl = xh_param_assign_bool(v);
+                    opts->xml_decl = xh_param_assign_bool(aTHX_ v);
+                    break;
+                }
+                if (xh_str_equal8(p, 'c', 'h', 'e', 'c', 'k', 's', 'u', 'm')) {
+                    opts->checksum = xh_checksum_type(aTHX_ v);
+                    break;
+                }
+                if (xh_str_equal8(p, 'c', 'o', 'm', 'p', 'r', 'e', 's', 's')) {
+                    opts->compress = xh_h2x_compress(aTHX_ v);
+                    break;
+                }
+                if (xh_str_equal8(p, 'b', 'u', 'f', '_', 's', 'i', 'z', 'e')) {
+                    xh_param_assign_int(aTHX_ p, &opts->buf_size, v);
+                    if (opts->buf_size < 256) {
+                        croak("Parameter '%s' must be at least 256", p);
+                    }
                     break;
                 }
                 goto error;
             case 9:
                 if (xh_str_equal9(p, 'c', 'a', 'n', 'o', 'n', 'i', 'c', 'a', 'l')) {
-                    opts->canonical = xh_param_assign_bool(v);
+                    opts->canonical = xh_param_assign_bool(aTHX_ v);
                     break;
                 }
                 if (xh_str_equal9(p, 'm', 'a', 'x', '_', 'd', 'e', 'p', 't', 'h')) {
-                    xh_param_assign_int(p, &opts->max_depth, v);
+                    xh_param_assign_int(aTHX_ p, &opts->max_depth, v);
+                    break;
+                }
+                if (xh_str_equal9(p, 's', 'e', 'p', 'a', 'r', 'a', 't', 'o', 'r')) {
+                    opts->separator = SvOK(v) ? v : NULL;
+                    break;
+                }
+                if (xh_str_equal9(p, 'h', 'u', 'g', 'e', '_', 's', 'i', 'z', 'e')) {
+                    xh_param_assign_int(aTHX_ p, &opts->huge_size, v);
+                    break;
+                }
+                if (xh_str_equal9(p, 'o', 'u', 't', 'p', 'u', 't', '_', 'f', 'd')) {
+                    if (SvOK(v)) {
+                        opts->output_fd = SvIV(v);
+                    }
+                    else {
+                        opts->output_fd = XH_H2X_DEF_OUTPUT_FD;
+                    }
+                    break;
+                }
+                goto error;
+            case 11:
+                if (xh_str_equal11(p, 'o', 'u', 't', 'p', 'u', 't', '_', 'f', 'i', 'l', 'e')) {
+                    opts->output_file = SvOK(v) ? v : NULL;
+                    break;
+                }
+                if (xh_str_equal11(p, 'o', 'u', 't', 'p', 'u', 't', '_', 's', 'i', 'z', 'e')) {
+                    xh_param_assign_int(aTHX_ p, &opts->output_size, v);
+                    break;
+                }
+                goto error;
+            case 14:
+                if (xh_str_equal14(p, 'c', 'o', 'm', 'p', 'r', 'e', 's', 's', '_', 'l', 'e', 'v', 'e', 'l')) {
+                    xh_param_assign_int(aTHX_ p, &opts->compress_level, v);
+                    if (opts->compress_level < -1 || opts->compress_level > 9) {
+                        croak("Parameter '%s' must be from -1 to 9", p);
+                    }
                     break;
                 }
                 goto error;
@@ -252,6 +657,8 @@ xh_h2x_parse_param(xh_h2x_opts_t *opts, xh_int_t first, I32 ax, I32 items)
         }
     }
 
+    xh_h2x_compile_opts(opts);
+
     return;
 
 error_value:
@@ -262,64 +669,778 @@ error:
     croak("Invalid parameter '%s'", p);
 }
 
+/*
+ * An argument can be matched by its value: no magic and no references,
+ * a memoized output handle would outlive its scope.
+ */
+static xh_bool_t
+xh_h2x_memo_plain(SV *v)
+{
+    if (SvGMAGICAL(v) || SvROK(v)) {
+        return FALSE;
+    }
+
+    return !SvOK(v) || SvPOK(v) || SvIOK(v) || SvNOK(v);
+}
+
+/* the argument reads the same as the memoized copy */
+static xh_bool_t
+xh_h2x_memo_same(SV *cached, SV *v)
+{
+    if (!SvOK(v)) {
+        return !SvOK(cached);
+    }
+    if (SvPOK(v)) {
+        if (!SvPOK(cached) || SvCUR(cached) != SvCUR(v) || SvUTF8(cached) != SvUTF8(v)
+            || memcmp(SvPVX(cached), SvPVX(v), SvCUR(v)) != 0) {
+            return FALSE;
+        }
+        return !SvIOK(v) || (SvIOK(cached) && SvIVX(cached) == SvIVX(v));
+    }
+    if (SvIOK(v)) {
+        return SvIOK(cached) && !SvPOK(cached) && SvIVX(cached) == SvIVX(v);
+    }
+
+    return SvNOK(cached) && !SvPOK(cached) && !SvIOK(cached) && SvNVX(cached) == SvNVX(v);
+}
+
+static void
+xh_h2x_memo_free(pTHX_ xh_h2x_memo_t *memo)
+{
+    I32 i;
+
+    if (memo->nargs > 0) {
+        xh_h2x_release_opts(aTHX_ &memo->opts);
+        for (i = 0; i < memo->nargs; i++) {
+            SvREFCNT_dec(memo->args[i]);
+        }
+        memo->nargs = 0;
+    }
+}
+
+/* drops the option lists, they are based on the options of the object */
+void
+xh_h2x_memo_clean(pTHX_ xh_h2x_conv_t *conv)
+{
+    xh_uint_t i;
+
+    for (i = 0; i < XH_H2X_MEMO_SIZE; i++) {
+        xh_h2x_memo_free(aTHX_ &conv->memo[i]);
+    }
+    conv->memo_next = 0;
+}
+
+/*
+ * Returns the options of the object with the arguments from "first" applied.
+ * The same lists of arguments are parsed once and served from the memo,
+ * NULL - the arguments can't be memoized and have to be parsed by the caller.
+ */
+xh_h2x_opts_t *
+xh_h2x_memo_opts(pTHX_ xh_h2x_conv_t *conv, xh_int_t first, I32 ax, I32 items)
+{
+    xh_h2x_memo_t *memo;
+    I32            nargs = items - first, i;
+    xh_uint_t      m;
+
+    if (nargs > XH_H2X_MEMO_ARGS) {
+        return NULL;
+    }
+    for (i = 0; i < nargs; i++) {
+        if (!xh_h2x_memo_plain(ST(first + i))) {
+            return NULL;
+        }
+    }
+
+    for (m = 0; m < XH_H2X_MEMO_SIZE; m++) {
+        memo = &conv->memo[m];
+        if (memo->nargs != nargs) {
+            continue;
+        }
+        for (i = 0; i < nargs; i++) {
+            if (!xh_h2x_memo_same(memo->args[i], ST(first + i))) {
+                break;
+            }
+        }
+        if (i == nargs) {
+            return &memo->opts;
+        }
+    }
+
+    /* the slots are reused in turn */
+    memo = &conv->memo[conv->memo_next];
+    xh_h2x_memo_free(aTHX_ memo);
+
+    memcpy(&memo->opts, &conv->opts, sizeof(xh_h2x_opts_t));
+    xh_h2x_parse_param(aTHX_ &memo->opts, first, ax, items);
+    xh_h2x_hold_opts(aTHX_ &memo->opts);
+
+    for (i = 0; i < nargs; i++) {
+        memo->args[i] = newSVsv(ST(first + i));
+    }
+    memo->nargs = nargs;
+
+    conv->memo_next = (conv->memo_next + 1) % XH_H2X_MEMO_SIZE;
+
+    return &memo->opts;
+}
+
+static void
+xh_h2x_utf8_on(pTHX_ SV *result)
+{
+    AV     *segments;
+    SSize_t i;
+
+    if (!SvROK(result)) {
+        SvUTF8_on(result);
+        return;
+    }
+
+    segments = (AV *) SvRV(result);
+    for (i = 0; i <= av_len(segments); i++) {
+        SvUTF8_on(*av_fetch(segments, i, 0));
+    }
+}
+
+/* pushes the root of the document */
+void
+xh_h2x_start(xh_h2x_ctx_t *ctx, SV *hash)
+{
+    switch (ctx->opts.method) {
+        case XH_H2X_METHOD_NATIVE:
+            (void) xh_h2x_push_frame(ctx, (char *) ctx->opts.root.str, ctx->opts.root.len, SvRV(hash), XH_H2X_F_NONE);
+            break;
+        case XH_H2X_METHOD_NATIVE_ATTR_MODE:
+            (void) xh_h2x_push_frame(ctx, (char *) ctx->opts.root.str, ctx->opts.root.len, SvRV(hash), XH_H2X_F_COMPLEX);
+            break;
+        case XH_H2X_METHOD_LX:
+            (void) xh_h2x_push_frame(ctx, NULL, 0, hash, XH_H2X_F_NONE);
+            break;
+        default:
+            croak("Invalid method");
+    }
+}
+
+/* returns FALSE if the traversal is suspended */
+xh_bool_t
+xh_h2x_run(pTHX_ xh_h2x_ctx_t *ctx)
+{
+    switch (ctx->opts.method) {
+        case XH_H2X_METHOD_NATIVE:
+            return xh_h2x_native(aTHX_ ctx);
+        case XH_H2X_METHOD_NATIVE_ATTR_MODE:
+            return xh_h2x_native_attr(aTHX_ ctx);
+        case XH_H2X_METHOD_LX:
+            return xh_h2x_lx(aTHX_ ctx);
+        default:
+            croak("Invalid method");
+    }
+
+    return TRUE;
+}
+
+/* the result is a string of characters */
+static xh_bool_t
+xh_h2x_is_utf8(xh_h2x_ctx_t *ctx)
+{
+#ifdef XH_HAVE_ENCODER
+    if (ctx->writer->encoder != NULL) return FALSE;
+#endif
+    if (xh_writer_is_stream(ctx->writer) && !ctx->opts.output_segments) return FALSE;
+
+    return ctx->opts.compress == XH_WRITER_COMPRESS_NONE;
+}
+
+/* opens the writer for the configured output */
+static void
+xh_h2x_open_writer(pTHX_ xh_h2x_ctx_t *ctx)
+{
+    if (ctx->opts.dry_run) {
+        xh_writer_open_null(aTHX_ ctx->writer);
+    }
+    else if (ctx->opts.output_segments) {
+        xh_writer_open_segments(aTHX_ ctx->writer);
+    }
+    else {
+        xh_writer_open(aTHX_ ctx->writer, ctx->opts.output, ctx->opts.output_fd, ctx->opts.output_file, ctx->opts.output_size, ctx->opts.async);
+    }
+    ctx->writer->huge_size = ctx->opts.huge_size > 0 ? ctx->opts.huge_size : 0;
+    xh_writer_init(aTHX_ ctx->writer, ctx->opts.encoding, ctx->opts.buf_size, ctx->opts.indent, ctx->opts.trim,
+                   ctx->opts.compress, ctx->opts.compress_level, ctx->opts.checksum);
+}
+
+/* writes one document to the open writer */
+static void
+xh_h2x_document(pTHX_ xh_h2x_ctx_t *ctx, SV *hash)
+{
+    if (ctx->opts.xml_decl) {
+        xh_xml_write_xml_declaration(aTHX_ ctx->writer, ctx->opts.version, ctx->opts.encoding);
+    }
+
+    xh_h2x_start(ctx, hash);
+    (void) xh_h2x_run(aTHX_ ctx);
+
+    xh_stash_clean(aTHX_ &ctx->stash);
+}
+
 SV *
-xh_h2x(xh_h2x_ctx_t *ctx, SV *hash)
+xh_h2x(pTHX_ xh_h2x_ctx_t *ctx, SV *hash)
 {
     SV          *result;
-    xh_writer_t *writer = NULL;
+    xh_writer_t  writer;
+    xh_bool_t    utf8;
+    dXCPT;
+
+    if (!ctx->persistent) {
+        memset(&writer, 0, sizeof(xh_writer_t));
+        ctx->writer = &writer;
+    }
+
+    ctx->busy = TRUE;
 
     /* run */
+    XCPT_TRY_START
+    {
+        xh_h2x_ctx_init(ctx);
+        xh_h2x_open_writer(aTHX_ ctx);
+        xh_h2x_document(aTHX_ ctx, hash);
+
+        utf8 = xh_h2x_is_utf8(ctx);
+
+        result = xh_writer_finish(aTHX_ ctx->writer, ctx->persistent);
+
+        ctx->bytes = ctx->writer->checksum.bytes;
+        xh_checksum_digest(&ctx->writer->checksum, ctx->checksum);
+    } XCPT_TRY_END
+
+    XCPT_CATCH
+    {
+        xh_h2x_frames_clean(aTHX_ ctx);
+        xh_stash_clean(aTHX_ &ctx->stash);
+        xh_writer_close(aTHX_ ctx->writer);
+        if (!ctx->persistent) {
+            xh_writer_destroy(aTHX_ ctx->writer);
+            xh_h2x_ctx_destroy(aTHX_ ctx);
+        }
+        ctx->busy = FALSE;
+        XCPT_RETHROW;
+    }
+
+    if (result != NULL && utf8) {
+        xh_h2x_utf8_on(aTHX_ result);
+    }
+
+    if (!ctx->persistent) {
+        xh_h2x_ctx_destroy(aTHX_ ctx);
+    }
+    ctx->busy = FALSE;
+
+    return result;
+}
+
+static SV *
+xh_h2x_many_item(pTHX_ AV *hashes, SSize_t i)
+{
+    SV **item = av_fetch(hashes, i, 0);
+
+    if (item == NULL || !SvROK(*item) || SvTYPE(SvRV(*item)) != SVt_PVHV) {
+        croak("Parameter is not hash reference");
+    }
+
+    return *item;
+}
+
+/*
+ * Converts an array of hashes with one setup: the options, the writer,
+ * the encoder and the scratch stacks serve every document. The result is
+ * an array of documents or, if a separator or an output is set, a single
+ * stream of documents delimited by the separator.
+ */
+SV *
+xh_h2x_many(pTHX_ xh_h2x_ctx_t *ctx, AV *hashes)
+{
+    SV          *result = NULL, *doc;
+    AV          *docs   = NULL;
+    xh_writer_t  writer;
+    xh_bool_t    persistent = ctx->persistent, utf8 = FALSE;
+    SSize_t      i, len;
+    char        *sep    = NULL;
+    STRLEN       sep_len = 0;
+    uint64_t     bytes  = 0;
     dXCPT;
+
+    if (!persistent) {
+        memset(&writer, 0, sizeof(xh_writer_t));
+        ctx->writer     = &writer;
+        ctx->persistent = TRUE;
+    }
+
+    ctx->busy = TRUE;
+
+    len = av_len(hashes) + 1;
+
     XCPT_TRY_START
     {
-        xh_stack_init(&ctx->stash, XH_H2X_STASH_SIZE, sizeof(SV *));
-        ctx->writer = writer = xh_writer_create(ctx->opts.encoding, ctx->opts.output, 16384, ctx->opts.indent, ctx->opts.trim);
+        xh_h2x_ctx_init(ctx);
+
+        if (ctx->opts.separator != NULL || ctx->opts.output != NULL || ctx->opts.output_fd >= 0
+            || ctx->opts.output_segments || (ctx->opts.output_file != NULL && SvOK(ctx->opts.output_file))) {
+            if (ctx->opts.separator != NULL) {
+                sep = SvPV(ctx->opts.separator, sep_len);
+            }
+
+            xh_h2x_open_writer(aTHX_ ctx);
+            for (i = 0; i < len; i++) {
+                if (i > 0 && sep_len > 0) {
+                    xh_xml_write_raw(aTHX_ ctx->writer, sep, sep_len);
+                }
+                xh_h2x_document(aTHX_ ctx, xh_h2x_many_item(aTHX_ hashes, i));
+            }
+
+            utf8   = xh_h2x_is_utf8(ctx);
+            result = xh_writer_finish(aTHX_ ctx->writer, persistent);
+
+            bytes = ctx->writer->checksum.bytes;
+            xh_checksum_digest(&ctx->writer->checksum, ctx->checksum);
+        }
+        else {
+            /* a single digest can't stand for separate documents */
+            if (ctx->opts.checksum != XH_CHECKSUM_NONE) {
+                croak("Option 'checksum' of hash2xml_many requires a separator or an output");
+            }
+
+            docs = newAV();
+            if (len > 0) {
+                av_extend(docs, len - 1);
+            }
+
+            for (i = 0; i < len; i++) {
+                xh_h2x_open_writer(aTHX_ ctx);
+                xh_h2x_document(aTHX_ ctx, xh_h2x_many_item(aTHX_ hashes, i));
+
+                utf8 = xh_h2x_is_utf8(ctx);
+                doc  = xh_writer_finish(aTHX_ ctx->writer, TRUE);
+                if (utf8) {
+                    SvUTF8_on(doc);
+                }
+                av_push(docs, doc);
+
+                bytes += ctx->writer->checksum.bytes;
+            }
+
+            /* no digest of the previous call */
+            ctx->checksum[0] = '\0';
+            utf8   = FALSE;
+            result = newRV_noinc((SV *) docs);
+            docs   = NULL;
+
+            if (!persistent) {
+                xh_writer_destroy(aTHX_ ctx->writer);
+            }
+        }
+
+        ctx->bytes = bytes;
+    } XCPT_TRY_END
+
+    XCPT_CATCH
+    {
+        if (docs != NULL) {
+            SvREFCNT_dec((SV *) docs);
+        }
+        xh_h2x_frames_clean(aTHX_ ctx);
+        xh_stash_clean(aTHX_ &ctx->stash);
+        xh_writer_close(aTHX_ ctx->writer);
+        ctx->persistent = persistent;
+        if (!persistent) {
+            xh_writer_destroy(aTHX_ ctx->writer);
+            xh_h2x_ctx_destroy(aTHX_ ctx);
+        }
+        ctx->busy = FALSE;
+        XCPT_RETHROW;
+    }
+
+    if (result != NULL && utf8) {
+        xh_h2x_utf8_on(aTHX_ result);
+    }
+
+    ctx->persistent = persistent;
+    if (!persistent) {
+        xh_h2x_ctx_destroy(aTHX_ ctx);
+    }
+    ctx->busy = FALSE;
+
+    return result;
+}
+
+xh_h2x_iter_t *
+xh_h2x_iter_create(xh_h2x_opts_t *opts)
+{
+    xh_h2x_iter_t *iter;
+
+    if ((iter = malloc(sizeof(xh_h2x_iter_t))) == NULL) {
+        return NULL;
+    }
+    memset(iter, 0, sizeof(xh_h2x_iter_t));
+
+    memcpy(&iter->ctx.opts, opts, sizeof(xh_h2x_opts_t));
+    iter->ctx.writer = &iter->writer;
+    iter->done       = TRUE;
+
+    return iter;
+}
+
+/* the iterator returns the document by chunks, it has no output */
+void
+xh_h2x_iter_check_opts(pTHX_ xh_h2x_opts_t *opts)
+{
+    const char *name = NULL;
+
+    if (opts->output != NULL || opts->output_segments) {
+        name = "output";
+    }
+    else if (opts->output_fd >= 0) {
+        name = "output_fd";
+    }
+    else if (opts->output_file != NULL && SvOK(opts->output_file)) {
+        name = "output_file";
+    }
+    else if (opts->async) {
+        name = "async";
+    }
+
+    if (name != NULL) {
+        croak("Option '%s' is not supported by hash2xml_iter", name);
+    }
+}
+
+static void
+xh_h2x_iter_stop(pTHX_ xh_h2x_iter_t *iter)
+{
+    xh_h2x_frames_clean(aTHX_ &iter->ctx);
+    xh_stash_clean(aTHX_ &iter->ctx.stash);
+    xh_writer_close(aTHX_ &iter->writer);
+    if (iter->hash != NULL) {
+        SvREFCNT_dec(iter->hash);
+        iter->hash = NULL;
+    }
+    iter->done = TRUE;
+}
+
+void
+xh_h2x_iter_destroy(pTHX_ xh_h2x_iter_t *iter)
+{
+    if (iter != NULL) {
+        xh_h2x_iter_stop(aTHX_ iter);
+        xh_h2x_release_opts(aTHX_ &iter->ctx.opts);
+        xh_writer_destroy(aTHX_ &iter->writer);
+        xh_h2x_ctx_destroy(aTHX_ &iter->ctx);
+        if (iter->pending != NULL) {
+            SvREFCNT_dec(iter->pending);
+        }
+        free(iter);
+    }
+}
+
+/* the output goes to the pending scalar, the iterator takes it by chunks */
+void
+xh_h2x_iter_start(pTHX_ xh_h2x_iter_t *iter, SV *hash)
+{
+    xh_h2x_ctx_t *ctx = &iter->ctx;
+    dXCPT;
+
+    if (iter->pending == NULL) {
+        iter->pending = newSVpvn("", 0);
+    }
+    SvCUR_set(iter->pending, 0);
+
+    /* a copy of the reference, the argument may be reassigned */
+    iter->hash = newSVsv(hash);
+    iter->done = FALSE;
+
+    XCPT_TRY_START
+    {
+        xh_h2x_ctx_init(ctx);
+        xh_writer_open_pull(aTHX_ ctx->writer, iter->pending);
+        xh_writer_init(aTHX_ ctx->writer, ctx->opts.encoding, ctx->opts.buf_size, ctx->opts.indent, ctx->opts.trim,
+                       ctx->opts.compress, ctx->opts.compress_level, ctx->opts.checksum);
+
+        if (ctx->opts.xml_decl) {
+            xh_xml_write_xml_declaration(aTHX_ ctx->writer, ctx->opts.version, ctx->opts.encoding);
+        }
+
+        xh_h2x_start(ctx, iter->hash);
+    } XCPT_TRY_END
+
+    XCPT_CATCH
+    {
+        xh_h2x_iter_stop(aTHX_ iter);
+        XCPT_RETHROW;
+    }
+}
+
+/* returns up to size bytes of the document, NULL at the end */
+SV *
+xh_h2x_iter_next(pTHX_ xh_h2x_iter_t *iter, size_t size)
+{
+    xh_h2x_ctx_t *ctx = &iter->ctx;
+    SV           *result;
+    char         *pending;
+    size_t        len;
+    dXCPT;
+
+    if (size == 0) {
+        size = XH_H2X_DEF_CHUNK_SIZE;
+    }
+
+    XCPT_TRY_START
+    {
+        ctx->want = size;
+        while (!iter->done && SvCUR(iter->pending) < size) {
+            if (xh_h2x_run(aTHX_ ctx)) {
+                (void) xh_writer_finish(aTHX_ ctx->writer, TRUE);
+                xh_stash_clean(aTHX_ &ctx->stash);
+                ctx->bytes = ctx->writer->checksum.bytes;
+                xh_checksum_digest(&ctx->writer->checksum, ctx->checksum);
+                SvREFCNT_dec(iter->hash);
+                iter->hash = NULL;
+                iter->done = TRUE;
+            }
+            else {
+                (void) xh_writer_flush(aTHX_ ctx->writer);
+            }
+        }
+    } XCPT_TRY_END
+
+    XCPT_CATCH
+    {
+        xh_h2x_iter_stop(aTHX_ iter);
+        SvCUR_set(iter->pending, 0);
+        XCPT_RETHROW;
+    }
+
+    len = SvCUR(iter->pending);
+    if (len == 0) {
+        return NULL;
+    }
+    if (len > size) {
+        len = size;
+    }
+
+    pending = SvPVX(iter->pending);
+    result  = newSVpvn(pending, len);
+
+    /* the rest is usually short, it is moved to the start */
+    Move(pending + len, pending, SvCUR(iter->pending) - len, char);
+    SvCUR_set(iter->pending, SvCUR(iter->pending) - len);
+
+    return result;
+}
+
+xh_h2x_stream_t *
+xh_h2x_stream_create(pTHX)
+{
+    xh_h2x_stream_t *stream;
+
+    if ((stream = malloc(sizeof(xh_h2x_stream_t))) == NULL) {
+        return NULL;
+    }
+    memset(stream, 0, sizeof(xh_h2x_stream_t));
+
+    if (! xh_h2x_init_opts(aTHX_ &stream->opts)) {
+        free(stream);
+        return NULL;
+    }
+
+    stream->ctx.writer     = &stream->writer;
+    stream->ctx.persistent = TRUE;
+
+    return stream;
+}
+
+/* the document is abandoned, the output is left as is */
+static void
+xh_h2x_stream_stop(pTHX_ xh_h2x_stream_t *stream)
+{
+    xh_h2x_frames_clean(aTHX_ &stream->ctx);
+    xh_stash_clean(aTHX_ &stream->ctx.stash);
+    xh_writer_close(aTHX_ &stream->writer);
+    if (stream->root != NULL) {
+        SvREFCNT_dec(stream->root);
+        stream->root = NULL;
+    }
+    stream->started = FALSE;
+}
+
+void
+xh_h2x_stream_destroy(pTHX_ xh_h2x_stream_t *stream)
+{
+    if (stream != NULL) {
+        xh_h2x_stream_stop(aTHX_ stream);
+        xh_h2x_release_opts(aTHX_ &stream->opts);
+        xh_writer_destroy(aTHX_ &stream->writer);
+        xh_h2x_ctx_destroy(aTHX_ &stream->ctx);
+        free(stream);
+    }
+}
+
+/* '<root attr1="..." attr2="...">' */
+void
+xh_h2x_stream_start(pTHX_ xh_h2x_stream_t *stream, SV *root, SV **attrs, I32 nattrs)
+{
+    xh_h2x_ctx_t *ctx = &stream->ctx;
+    char         *name;
+    STRLEN        name_len, attr_len;
+    I32           i;
+    dXCPT;
+
+    if (stream->started) {
+        croak("Writer is already started");
+    }
+    if (nattrs % 2 != 0) {
+        croak("Odd number of attributes");
+    }
+
+    memcpy(&ctx->opts, &stream->opts, sizeof(xh_h2x_opts_t));
+
+    XCPT_TRY_START
+    {
+        stream->root    = newSVsv(root);
+        stream->started = TRUE;
+
+        xh_h2x_ctx_init(ctx);
+        xh_h2x_open_writer(aTHX_ ctx);
 
         if (ctx->opts.xml_decl) {
-            xh_xml_write_xml_declaration(writer, ctx->opts.version, ctx->opts.encoding);
+            xh_xml_write_xml_declaration(aTHX_ ctx->writer, ctx->opts.version, ctx->opts.encoding);
         }
 
+        name = SvPV(stream->root, name_len);
+        xh_xml_write_start_tag(aTHX_ ctx->writer, name, name_len);
+        for (i = 0; i < nattrs; i += 2) {
+            name = SvPV(attrs[i], attr_len);
+            xh_xml_write_attribute(aTHX_ ctx->writer, name, attr_len, SvOK(attrs[i + 1]) ? attrs[i + 1] : NULL);
+        }
+        xh_xml_write_end_tag(aTHX_ ctx->writer);
+    } XCPT_TRY_END
+
+    XCPT_CATCH
+    {
+        xh_h2x_stream_stop(aTHX_ stream);
+        XCPT_RETHROW;
+    }
+}
+
+/* one subtree of the document, converted by the configured method */
+void
+xh_h2x_stream_add(pTHX_ xh_h2x_stream_t *stream, SV *key, SV *value)
+{
+    xh_h2x_ctx_t *ctx = &stream->ctx;
+    char         *name;
+    STRLEN        name_len;
+    dXCPT;
+
+    if (!stream->started) {
+        croak("Writer is not started");
+    }
+
+    XCPT_TRY_START
+    {
+        name = SvPV(key, name_len);
+
         switch (ctx->opts.method) {
             case XH_H2X_METHOD_NATIVE:
-                xh_h2x_native(ctx, ctx->opts.root, strlen(ctx->opts.root), SvRV(hash));
+                (void) xh_h2x_push_frame(ctx, name, name_len, value, XH_H2X_F_NONE);
                 break;
             case XH_H2X_METHOD_NATIVE_ATTR_MODE:
-                (void) xh_h2x_native_attr(ctx, ctx->opts.root, strlen(ctx->opts.root), SvRV(hash), XH_H2X_F_COMPLEX);
+                (void) xh_h2x_push_frame(ctx, name, name_len, value, XH_H2X_F_COMPLEX);
                 break;
             case XH_H2X_METHOD_LX:
-                xh_h2x_lx(ctx, hash, XH_H2X_F_NONE);
+                xh_h2x_push_frame(ctx, name, name_len, value, XH_H2X_F_NONE)->state = XH_H2X_S_KEY;
                 break;
             default:
                 croak("Invalid method");
         }
+
+        (void) xh_h2x_run(aTHX_ ctx);
+
+        xh_stash_clean(aTHX_ &ctx->stash);
     } XCPT_TRY_END
 
     XCPT_CATCH
     {
-        xh_stash_clean(&ctx->stash);
-        xh_writer_destroy(writer);
+        xh_h2x_stream_stop(aTHX_ stream);
         XCPT_RETHROW;
     }
+}
 
-    xh_stash_clean(&ctx->stash);
-    result = xh_writer_flush(writer);
-    if (result != NULL) {
-#ifdef XH_HAVE_ENCODER
-        if (writer->encoder == NULL) {
-            SvUTF8_on(result);
-        }
-#else
-        SvUTF8_on(result);
-#endif
+void
+xh_h2x_stream_raw(pTHX_ xh_h2x_stream_t *stream, SV *content)
+{
+    char   *str;
+    STRLEN  len;
+    dXCPT;
+
+    if (!stream->started) {
+        croak("Writer is not started");
+    }
+
+    XCPT_TRY_START
+    {
+        str = SvPV(content, len);
+        xh_xml_write_raw(aTHX_ &stream->writer, str, len);
+    } XCPT_TRY_END
+
+    XCPT_CATCH
+    {
+        xh_h2x_stream_stop(aTHX_ stream);
+        XCPT_RETHROW;
+    }
+}
+
+/* '</root>', returns the document if the output is a string */
+SV *
+xh_h2x_stream_end(pTHX_ xh_h2x_stream_t *stream)
+{
+    xh_h2x_ctx_t *ctx = &stream->ctx;
+    SV           *result;
+    char         *name;
+    STRLEN        name_len;
+    xh_bool_t     utf8;
+    dXCPT;
+
+    if (!stream->started) {
+        croak("Writer is not started");
+    }
+
+    XCPT_TRY_START
+    {
+        name = SvPV(stream->root, name_len);
+        xh_xml_write_end_node(aTHX_ ctx->writer, name, name_len);
+
+        utf8   = xh_h2x_is_utf8(ctx);
+        result = xh_writer_finish(aTHX_ ctx->writer, TRUE);
+
+        ctx->bytes = ctx->writer->checksum.bytes;
+        xh_checksum_digest(&ctx->writer->checksum, ctx->checksum);
+    } XCPT_TRY_END
+
+    XCPT_CATCH
+    {
+        xh_h2x_stream_stop(aTHX_ stream);
+        XCPT_RETHROW;
+    }
+
+    xh_h2x_stream_stop(aTHX_ stream);
+
+    if (result != NULL && result != &PL_sv_undef && utf8) {
+        xh_h2x_utf8_on(aTHX_ result);
     }
-    xh_writer_destroy(writer);
 
     return result;
 }
 
 #ifdef XH_HAVE_DOM
 SV *
-xh_h2d(xh_h2x_ctx_t *ctx, SV *hash)
+xh_h2d(pTHX_ xh_h2x_ctx_t *ctx, SV *hash)
 {
     dXCPT;
 
@@ -329,18 +1450,23 @@ xh_h2d(xh_h2x_ctx_t *ctx, SV *hash)
     }
     doc->encoding = (const xmlChar*) xmlStrdup((const xmlChar*) ctx->opts.encoding);
 
+    ctx->busy = TRUE;
+
     XCPT_TRY_START
     {
-        xh_stack_init(&ctx->stash, XH_H2X_STASH_SIZE, sizeof(SV *));
+        xh_h2x_ctx_init(ctx);
         switch (ctx->opts.method) {
             case XH_H2X_METHOD_NATIVE:
-                xh_h2d_native(ctx, (xmlNodePtr) doc, ctx->opts.root, strlen(ctx->opts.root), SvRV(hash));
+                (void) xh_h2d_push_frame(ctx, (xmlNodePtr) doc, (char *) ctx->opts.root.str, ctx->opts.root.len, SvRV(hash), XH_H2X_F_NONE);
+                xh_h2d_native(aTHX_ ctx);
                 break;
             case XH_H2X_METHOD_NATIVE_ATTR_MODE:
-                (void) xh_h2d_native_attr(ctx, (xmlNodePtr) doc, ctx->opts.root, strlen(ctx->opts.root), SvRV(hash), XH_H2X_F_COMPLEX);
+                (void) xh_h2d_push_frame(ctx, (xmlNodePtr) doc, (char *) ctx->opts.root.str, ctx->opts.root.len, SvRV(hash), XH_H2X_F_COMPLEX);
+                xh_h2d_native_attr(aTHX_ ctx);
                 break;
             case XH_H2X_METHOD_LX:
-                xh_h2d_lx(ctx, (xmlNodePtr) doc, hash, XH_H2X_F_NONE);
+                (void) xh_h2d_push_frame(ctx, (xmlNodePtr) doc, NULL, 0, hash, XH_H2X_F_NONE);
+                xh_h2d_lx(aTHX_ ctx);
                 break;
             default:
                 croak("Invalid method");
@@ -349,12 +1475,22 @@ xh_h2d(xh_h2x_ctx_t *ctx, SV *hash)
 
     XCPT_CATCH
     {
-        xh_stash_clean(&ctx->stash);
+        xh_h2x_frames_clean(aTHX_ ctx);
+        xh_stash_clean(aTHX_ &ctx->stash);
+        if (!ctx->persistent) {
+            xh_h2x_ctx_destroy(aTHX_ ctx);
+        }
+        ctx->busy = FALSE;
+        xmlFreeDoc(doc);
         XCPT_RETHROW;
     }
 
-    xh_stash_clean(&ctx->stash);
+    xh_stash_clean(aTHX_ &ctx->stash);
+    if (!ctx->persistent) {
+        xh_h2x_ctx_destroy(aTHX_ ctx);
+    }
+    ctx->busy = FALSE;
 
-    return x_PmmNodeToSv((xmlNodePtr) doc, NULL);
+    return x_PmmNodeToSv(aTHX_ (xmlNodePtr) doc, NULL);
 }
 #endif
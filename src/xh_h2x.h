@@ -8,6 +8,10 @@
 #endif
 
 extern const char indent_string[60];
+/* package variables of the options */
+#define XH_H2X_GLOBALS                  27
+
+extern const char *xh_h2x_global_names[XH_H2X_GLOBALS + 1];
 
 #define XH_H2X_F_NONE                   0
 #define XH_H2X_F_SIMPLE                 1
@@ -22,6 +26,30 @@ extern const char indent_string[60];
 #define XH_H2X_T_RAW                    16
 #define XH_H2X_T_NOT_NULL               (XH_H2X_T_SCALAR | XH_H2X_T_ARRAY | XH_H2X_T_HASH)
 
+/* steps of a node in the traversal */
+#define XH_H2X_S_ENTER                  0
+#define XH_H2X_S_ITER                   1
+#define XH_H2X_S_SORTED                 2
+#define XH_H2X_S_HASH                   3
+#define XH_H2X_S_ARRAY                  4
+#define XH_H2X_S_SORTED_NODES           5
+#define XH_H2X_S_HASH_NODES             6
+#define XH_H2X_S_KEY                    7
+#define XH_H2X_S_KEY_ATTRS              8
+#define XH_H2X_S_KEY_END                9
+
+/* classes of hash keys */
+#define XH_H2X_K_NODE                   0
+#define XH_H2X_K_CONTENT                1
+#define XH_H2X_K_CDATA                  2
+#define XH_H2X_K_TEXT                   4
+#define XH_H2X_K_COMM                   8
+#define XH_H2X_K_ATTR                   16
+
+/* memoized per-call option lists of an object, arguments of a list */
+#define XH_H2X_MEMO_SIZE                4
+#define XH_H2X_MEMO_ARGS                16
+
 typedef enum {
     XH_H2X_METHOD_NATIVE = 0,
     XH_H2X_METHOD_NATIVE_ATTR_MODE,
@@ -34,41 +62,283 @@ typedef struct {
     /* native options */
     char                   version[XH_PARAM_LEN];
     char                   encoding[XH_PARAM_LEN];
-    char                   root[XH_PARAM_LEN];
+    xh_param_str_t         root;
     xh_bool_t              xml_decl;
     xh_bool_t              canonical;
-    char                   content[XH_PARAM_LEN];
+    xh_param_str_t         content;
     xh_int_t               indent;
     void                  *output;
+    xh_bool_t              output_segments;
+    xh_int_t               output_fd;
+    SV                    *output_file;
+    SV                    *separator;
+    xh_int_t               output_size;
+    xh_int_t               buf_size;
+    xh_int_t               huge_size;
+    xh_bool_t              async;
+    xh_writer_compress_t   compress;
+    xh_int_t               compress_level;
+    xh_checksum_type_t     checksum;
+    xh_bool_t              dry_run;
 #ifdef XH_HAVE_DOM
     xh_bool_t              doc;
 #endif
     xh_int_t               max_depth;
 
     /* LX options */
-    char                   attr[XH_PARAM_LEN];
-    size_t                 attr_len;
-    char                   text[XH_PARAM_LEN];
+    xh_param_str_t         attr;
+    xh_param_str_t         text;
     xh_bool_t              trim;
-    char                   cdata[XH_PARAM_LEN];
-    char                   comm[XH_PARAM_LEN];
+    xh_param_str_t         cdata;
+    xh_param_str_t         comm;
+
+    /* special keys of the method by their first byte, see xh_h2x_key_class() */
+    u_char                 key_first[256];
 } xh_h2x_opts_t;
 
+/*
+ * Keys of the records of an array in the walk order of the first record.
+ * Records with the same keys share them, so the keys of the next records
+ * are checked by address.
+ */
+#define XH_H2X_ROW_KEYS                 32
+#define XH_H2X_ROW_UNKNOWN              -1
+#define XH_H2X_ROW_NONE                 -2
+/* arrays of records with nested values give up after these misses */
+#define XH_H2X_ROW_MISSES               8
+
+typedef struct {
+    size_t                 len;
+    size_t                 hits;
+    size_t                 misses;
+    char                  *keys[XH_H2X_ROW_KEYS];
+    I32                    key_lens[XH_H2X_ROW_KEYS];
+    uint8_t                order[XH_H2X_ROW_KEYS];
+} xh_h2x_row_t;
+
+/*
+ * A node being converted. The traversal keeps the nodes on an explicit
+ * stack instead of the C stack, so it can be suspended between steps.
+ */
+typedef struct {
+    xh_uint_t              state;
+    xh_int_t               flag;
+    xh_int_t               depth;
+    char                  *key;
+    I32                    key_len;
+    SV                    *value;
+    SV                    *item;
+    GV                    *method;
+    size_t                 i;
+    size_t                 len;
+    size_t                 base;
+    size_t                 done;
+    size_t                 nattrs;
+    xh_int_t               row;
+    xh_hash_iter_t         hash;
+#ifdef XH_HAVE_DOM
+    xmlNodePtr             node;
+#endif
+} xh_h2x_frame_t;
+
 typedef struct {
     xh_h2x_opts_t          opts;
     xh_int_t               depth;
     xh_writer_t           *writer;
     xh_stack_t             stash;
+    xh_sort_t              sort;
+    xh_stack_t             frames;
+    xh_stack_t             rows;
+    size_t                 want;
+    xh_bool_t              persistent;
+    xh_bool_t              busy;
+    uint64_t               bytes;
+    char                   checksum[XH_CHECKSUM_DIGEST_LEN];
 } xh_h2x_ctx_t;
 
+/* options parsed from a per-call argument list */
+typedef struct {
+    I32                    nargs;
+    SV                    *args[XH_H2X_MEMO_ARGS];
+    xh_h2x_opts_t          opts;
+} xh_h2x_memo_t;
+
+/* converter object, keeps warm state between calls */
+typedef struct {
+    xh_h2x_opts_t          opts;
+    xh_h2x_ctx_t           ctx;
+    xh_writer_t            writer;
+    xh_h2x_memo_t          memo[XH_H2X_MEMO_SIZE];
+    xh_uint_t              memo_next;
+} xh_h2x_conv_t;
+
+/* pull iterator, the document is converted by chunks on demand */
+typedef struct {
+    xh_h2x_ctx_t           ctx;
+    xh_writer_t            writer;
+    SV                    *hash;
+    SV                    *pending;
+    xh_bool_t              done;
+} xh_h2x_iter_t;
+
+/* incremental writer, the document is written record by record */
+typedef struct {
+    xh_h2x_opts_t          opts;
+    xh_h2x_ctx_t           ctx;
+    xh_writer_t            writer;
+    SV                    *root;
+    xh_bool_t              started;
+} xh_h2x_stream_t;
+
+/* the traversal is suspended once the iterator has enough output */
+#define XH_H2X_SUSPEND(ctx)                                            \
+    ((ctx)->want != 0 && xh_writer_pending((ctx)->writer) >= (ctx)->want)
+
+XH_INLINE xh_h2x_frame_t *
+xh_h2x_push_frame(xh_h2x_ctx_t *ctx, char *key, I32 key_len, SV *value, xh_int_t flag)
+{
+    xh_h2x_frame_t *frame = (xh_h2x_frame_t *) xh_stack_push(&ctx->frames);
+
+    frame->state   = XH_H2X_S_ENTER;
+    frame->flag    = flag;
+    frame->depth   = ctx->depth;
+    frame->key     = key;
+    frame->key_len = key_len;
+    frame->value   = value;
+    frame->item    = NULL;
+    frame->nattrs  = 0;
+    frame->row     = XH_H2X_ROW_UNKNOWN;
+
+    return frame;
+}
+
+/*
+ * The next item of the array frame, holes of sparse arrays are read as
+ * undef. Plain arrays are read directly, tied and magical ones through
+ * av_fetch.
+ */
+XH_INLINE SV *
+xh_h2x_array_next(pTHX_ xh_h2x_frame_t *frame)
+{
+    AV     *av = (AV *) frame->value;
+    SV    **item;
+    size_t  i  = frame->i++;
+
+    if (expect_false(SvRMAGICAL(av))) {
+        item = av_fetch(av, i, 0);
+        if (item == NULL) return &PL_sv_undef;
+        SvGETMAGIC(*item);
+        return *item;
+    }
+
+    /* the array may be shortened by a callback of its items */
+    if (expect_false((SSize_t) i > AvFILLp(av)))
+        return &PL_sv_undef;
+
+    item = AvARRAY(av) + i;
+    if ((SSize_t) i < AvFILLp(av) && item[1] != NULL)
+        XH_PREFETCH(item[1]);
+
+    return *item == NULL ? &PL_sv_undef : *item;
+}
+
+/* plain values are converted at once, without a frame */
+#define XH_H2X_IS_PLAIN(v) (!SvROK(v) && !SvOBJECT(v))
+
+void xh_h2x_hold_hashes(pTHX_ xh_h2x_ctx_t *ctx);
+char *xh_h2x_hold_plain(pTHX_ xh_h2x_ctx_t *ctx, char *key, I32 key_len);
+
+xh_int_t xh_h2x_row_create(pTHX_ xh_h2x_ctx_t *ctx, HV *hv, xh_bool_t node_keys);
+
+/*
+ * Returns the keys of the record if it is a plain hash of plain values
+ * with the keys of the first record of the array frame, the values are
+ * put to "values" in the walk order. Otherwise the record is converted
+ * by frames.
+ */
+XH_INLINE xh_h2x_row_t *
+xh_h2x_row_values(pTHX_ xh_h2x_ctx_t *ctx, xh_h2x_frame_t *frame, SV *item, SV **values, xh_bool_t node_keys)
+{
+    xh_h2x_row_t   *row;
+    xh_hash_iter_t  iter;
+    HV             *hv;
+    char           *key;
+    I32             key_len;
+    size_t          i;
+
+    if (!SvROK(item)) return NULL;
+
+    hv = (HV *) SvRV(item);
+    if (SvTYPE(hv) != SVt_PVHV || SvOBJECT(hv) || SvRMAGICAL(hv)) return NULL;
+
+    /* the frame path reports the depth error */
+    if (ctx->depth >= ctx->opts.max_depth) return NULL;
+
+    if (frame->row == XH_H2X_ROW_UNKNOWN) {
+        frame->row = xh_h2x_row_create(aTHX_ ctx, hv, node_keys);
+        if (frame->row < 0) return NULL;
+    }
+
+    row = (xh_h2x_row_t *) ctx->rows.elts + frame->row;
+    if (HvUSEDKEYS(hv) != row->len) goto MISS;
+
+    xh_hash_iter_init(aTHX_ &iter, hv);
+    for (i = 0; i < row->len; i++) {
+        values[i] = xh_hash_iter_next(aTHX_ &iter, &key, &key_len);
+        if (key != row->keys[i] || !XH_H2X_IS_PLAIN(values[i]) || SvGMAGICAL(values[i]))
+            goto MISS;
+    }
+
+    row->hits++;
+
+    return row;
+
+MISS:
+    /* the keys are on the top of the stack while the array frame is on top */
+    if (++row->misses >= XH_H2X_ROW_MISSES && row->misses > row->hits) {
+        ctx->rows.top = frame->row;
+        frame->row    = XH_H2X_ROW_NONE;
+    }
+
+    return NULL;
+}
+
+XH_INLINE xh_h2x_frame_t *
+xh_h2x_top_frame(xh_h2x_ctx_t *ctx)
+{
+    return ctx->frames.top == 0
+        ? NULL
+        : (xh_h2x_frame_t *) ctx->frames.elts + ctx->frames.top - 1;
+}
+
+/* the popped frame stays valid until the next push */
+XH_INLINE xh_h2x_frame_t *
+xh_h2x_pop_frame(pTHX_ xh_h2x_ctx_t *ctx)
+{
+    xh_h2x_frame_t *frame = (xh_h2x_frame_t *) xh_stack_pop(&ctx->frames);
+
+    if (frame->item != NULL) {
+        SvREFCNT_dec(frame->item);
+        frame->item = NULL;
+    }
+    if (frame->row >= 0) {
+        ctx->rows.top = frame->row;
+    }
+    ctx->depth = frame->depth;
+
+    return frame;
+}
+
 XH_INLINE SV *
-xh_h2x_call_method(SV *obj, GV *method, char *method_name)
+xh_h2x_call_method(pTHX_ xh_h2x_ctx_t *ctx, SV *obj, GV *method, char *method_name)
 {
     int  count;
     SV  *result = &PL_sv_undef;
 
     dSP;
 
+    xh_h2x_hold_hashes(aTHX_ ctx);
+
     ENTER; SAVETMPS; PUSHMARK (SP);
     XPUSHs(sv_2mortal(newRV_inc(obj)));
     PUTBACK;
@@ -90,7 +360,7 @@ xh_h2x_call_method(SV *obj, GV *method, char *method_name)
 }
 
 XH_INLINE SV *
-xh_h2x_resolve_value(xh_h2x_ctx_t *ctx, SV *value, xh_uint_t *type)
+xh_h2x_resolve_value(pTHX_ xh_h2x_ctx_t *ctx, SV *value, xh_uint_t *type)
 {
     xh_int_t  nitems;
     GV       *method;
@@ -108,6 +378,8 @@ xh_h2x_resolve_value(xh_h2x_ctx_t *ctx, SV *value, xh_uint_t *type)
             if ((method = gv_fetchmethod_autoload(SvSTASH(value), "toString", 0)) != NULL) {
                 dSP;
 
+                xh_h2x_hold_hashes(aTHX_ ctx);
+
                 ENTER; SAVETMPS; PUSHMARK(SP);
                 XPUSHs(sv_2mortal(newRV_inc(value)));
                 PUTBACK;
@@ -136,6 +408,8 @@ xh_h2x_resolve_value(xh_h2x_ctx_t *ctx, SV *value, xh_uint_t *type)
         else if( SvTYPE(value) == SVt_PVCV ) {
             dSP;
 
+            xh_h2x_hold_hashes(aTHX_ ctx);
+
             ENTER; SAVETMPS; PUSHMARK (SP);
 
             nitems = call_sv(value, G_SCALAR|G_NOARGS);
@@ -160,6 +434,11 @@ xh_h2x_resolve_value(xh_h2x_ctx_t *ctx, SV *value, xh_uint_t *type)
         }
     }
 
+    /* tied values run code when they are read */
+    if (expect_false(SvGMAGICAL(value) || SvRMAGICAL(value))) {
+        xh_h2x_hold_hashes(aTHX_ ctx);
+    }
+
     if (SvTYPE(value) == SVt_PVHV) {
         *type |= XH_H2X_T_HASH;
     }
@@ -179,21 +458,78 @@ xh_h2x_resolve_value(xh_h2x_ctx_t *ctx, SV *value, xh_uint_t *type)
     return value;
 }
 
-xh_h2x_opts_t *xh_h2x_create(void);
-void xh_h2x_destroy(xh_h2x_opts_t *opts);
-xh_bool_t xh_h2x_init_opts(xh_h2x_opts_t *opts);
-void xh_h2x_parse_param(xh_h2x_opts_t *opts, xh_int_t first, I32 ax, I32 items);
+XH_INLINE xh_bool_t
+xh_h2x_key_equal(xh_param_str_t *name, const char *key, I32 key_len)
+{
+    return (STRLEN) key_len == name->len && memcmp(key, name->str, name->len) == 0;
+}
+
+/*
+ * Returns the class of the key for the method of the options. Keys that
+ * start with a byte no special key starts with are nodes at one lookup.
+ */
+XH_INLINE xh_uint_t
+xh_h2x_key_class(xh_h2x_opts_t *opts, const char *key, I32 key_len)
+{
+    xh_uint_t classes;
+
+    if (key_len <= 0 || (classes = opts->key_first[(u_char) key[0]]) == 0) {
+        return XH_H2X_K_NODE;
+    }
+
+    if (classes & XH_H2X_K_CONTENT && xh_h2x_key_equal(&opts->content, key, key_len))
+        return XH_H2X_K_CONTENT;
+    if (classes & XH_H2X_K_CDATA && xh_h2x_key_equal(&opts->cdata, key, key_len))
+        return XH_H2X_K_CDATA;
+    if (classes & XH_H2X_K_TEXT && xh_h2x_key_equal(&opts->text, key, key_len))
+        return XH_H2X_K_TEXT;
+    if (classes & XH_H2X_K_COMM && xh_h2x_key_equal(&opts->comm, key, key_len))
+        return XH_H2X_K_COMM;
+    if (classes & XH_H2X_K_ATTR && (STRLEN) key_len >= opts->attr.len
+        && memcmp(key, opts->attr.str, opts->attr.len) == 0)
+        return XH_H2X_K_ATTR;
+
+    return XH_H2X_K_NODE;
+}
 
-SV *xh_h2x(xh_h2x_ctx_t *ctx, SV *hash);
-void xh_h2x_native(xh_h2x_ctx_t *ctx, char *key, I32 key_len, SV *value);
-xh_int_t xh_h2x_native_attr(xh_h2x_ctx_t *ctx, char *key, I32 key_len, SV *value, xh_int_t flag);
-void xh_h2x_lx(xh_h2x_ctx_t *ctx, SV *value, xh_int_t flag);
+xh_h2x_conv_t *xh_h2x_create(pTHX);
+void xh_h2x_destroy(pTHX_ xh_h2x_conv_t *conv);
+void xh_h2x_hold_opts(pTHX_ xh_h2x_opts_t *opts);
+void xh_h2x_ctx_destroy(pTHX_ xh_h2x_ctx_t *ctx);
+xh_bool_t xh_h2x_init_opts(pTHX_ xh_h2x_opts_t *opts);
+void xh_h2x_reload_opts(pTHX_ xh_h2x_conv_t *conv);
+void xh_h2x_release_output(pTHX_ xh_h2x_conv_t *conv);
+void xh_h2x_parse_param(pTHX_ xh_h2x_opts_t *opts, xh_int_t first, I32 ax, I32 items);
+void xh_h2x_compile_opts(xh_h2x_opts_t *opts);
+void xh_h2x_memo_clean(pTHX_ xh_h2x_conv_t *conv);
+xh_h2x_opts_t *xh_h2x_memo_opts(pTHX_ xh_h2x_conv_t *conv, xh_int_t first, I32 ax, I32 items);
+
+SV *xh_h2x(pTHX_ xh_h2x_ctx_t *ctx, SV *hash);
+SV *xh_h2x_many(pTHX_ xh_h2x_ctx_t *ctx, AV *hashes);
+void xh_h2x_start(xh_h2x_ctx_t *ctx, SV *hash);
+xh_bool_t xh_h2x_run(pTHX_ xh_h2x_ctx_t *ctx);
+xh_bool_t xh_h2x_native(pTHX_ xh_h2x_ctx_t *ctx);
+xh_bool_t xh_h2x_native_attr(pTHX_ xh_h2x_ctx_t *ctx);
+xh_bool_t xh_h2x_lx(pTHX_ xh_h2x_ctx_t *ctx);
+
+xh_h2x_iter_t *xh_h2x_iter_create(xh_h2x_opts_t *opts);
+void xh_h2x_iter_check_opts(pTHX_ xh_h2x_opts_t *opts);
+void xh_h2x_iter_start(pTHX_ xh_h2x_iter_t *iter, SV *hash);
+SV *xh_h2x_iter_next(pTHX_ xh_h2x_iter_t *iter, size_t size);
+void xh_h2x_iter_destroy(pTHX_ xh_h2x_iter_t *iter);
+
+xh_h2x_stream_t *xh_h2x_stream_create(pTHX);
+void xh_h2x_stream_start(pTHX_ xh_h2x_stream_t *stream, SV *root, SV **attrs, I32 nattrs);
+void xh_h2x_stream_add(pTHX_ xh_h2x_stream_t *stream, SV *key, SV *value);
+void xh_h2x_stream_raw(pTHX_ xh_h2x_stream_t *stream, SV *content);
+SV *xh_h2x_stream_end(pTHX_ xh_h2x_stream_t *stream);
+void xh_h2x_stream_destroy(pTHX_ xh_h2x_stream_t *stream);
 
 #ifdef XH_HAVE_DOM
-SV *xh_h2d(xh_h2x_ctx_t *ctx, SV *hash);
-void xh_h2d_native(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *key, I32 key_len, SV *value);
-xh_int_t xh_h2d_native_attr(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *key, I32 key_len, SV *value, xh_int_t flag);
-void xh_h2d_lx(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value, xh_int_t flag);
+SV *xh_h2d(pTHX_ xh_h2x_ctx_t *ctx, SV *hash);
+void xh_h2d_native(pTHX_ xh_h2x_ctx_t *ctx);
+void xh_h2d_native_attr(pTHX_ xh_h2x_ctx_t *ctx);
+void xh_h2d_lx(pTHX_ xh_h2x_ctx_t *ctx);
 #endif
 
 #endif /* _XH_H2X_H_ */
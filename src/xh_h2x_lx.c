@@ -1,223 +1,393 @@
 #include "xh_config.h"
 #include "xh_core.h"
 
+/* a key of the hash */
 XH_INLINE void
-_xh_h2x_lx(xh_h2x_ctx_t *ctx, char *key, I32 key_len, SV *value, xh_int_t flag)
+_xh_h2x_lx(pTHX_ xh_h2x_ctx_t *ctx, xh_h2x_frame_t *frame)
 {
-    xh_uint_t type;
+    xh_uint_t  type;
+    xh_int_t   flag    = frame->flag;
+    char      *key     = frame->key;
+    I32        key_len = frame->key_len;
+    xh_uint_t  key_class;
+    SV        *value;
 
-    value = xh_h2x_resolve_value(ctx, value, &type);
+    value = xh_h2x_resolve_value(aTHX_ ctx, frame->value, &type);
+    key_class = xh_h2x_key_class(&ctx->opts, key, key_len);
 
-    if (ctx->opts.cdata[0] != '\0' && strcmp(key, ctx->opts.cdata) == 0) {
-        if (flag & XH_H2X_F_ATTR_ONLY || !(type & XH_H2X_T_SCALAR)) return;
-        xh_xml_write_cdata(ctx->writer, value);
+    if (key_class == XH_H2X_K_CDATA) {
+        if (flag & XH_H2X_F_ATTR_ONLY || !(type & XH_H2X_T_SCALAR)) goto FINISH;
+        xh_xml_write_cdata(aTHX_ ctx->writer, value);
     }
-    else if (ctx->opts.text[0] != '\0' && strcmp(key, ctx->opts.text) == 0) {
-        if (flag & XH_H2X_F_ATTR_ONLY || !(type & XH_H2X_T_SCALAR)) return;
-        xh_xml_write_content(ctx->writer, value);
+    else if (key_class == XH_H2X_K_TEXT) {
+        if (flag & XH_H2X_F_ATTR_ONLY || !(type & XH_H2X_T_SCALAR)) goto FINISH;
+        xh_xml_write_content(aTHX_ ctx->writer, value);
     }
-    else if (ctx->opts.comm[0] != '\0' && strcmp(key, ctx->opts.comm) == 0) {
-        if (flag & XH_H2X_F_ATTR_ONLY) return;
+    else if (key_class == XH_H2X_K_COMM) {
+        if (flag & XH_H2X_F_ATTR_ONLY) goto FINISH;
 
         if (type & XH_H2X_T_SCALAR) {
-            xh_xml_write_comment(ctx->writer, value);
+            xh_xml_write_comment(aTHX_ ctx->writer, value);
         }
         else {
-            xh_xml_write_comment(ctx->writer, NULL);
+            xh_xml_write_comment(aTHX_ ctx->writer, NULL);
         }
     }
-    else if (ctx->opts.attr[0] != '\0') {
-        if (strncmp(key, ctx->opts.attr, ctx->opts.attr_len) == 0) {
-            if (!(flag & XH_H2X_F_ATTR_ONLY)) return;
+    else if (ctx->opts.attr.len != 0) {
+        if (key_class == XH_H2X_K_ATTR) {
+            if (!(flag & XH_H2X_F_ATTR_ONLY)) goto FINISH;
 
-            key     += ctx->opts.attr_len;
-            key_len -= ctx->opts.attr_len;
+            key     += ctx->opts.attr.len;
+            key_len -= ctx->opts.attr.len;
 
             if (type & XH_H2X_T_SCALAR) {
-                xh_xml_write_attribute(ctx->writer, key, key_len, value);
+                xh_xml_write_attribute(aTHX_ ctx->writer, key, key_len, value);
             }
             else {
-                xh_xml_write_attribute(ctx->writer, key, key_len, NULL);
+                xh_xml_write_attribute(aTHX_ ctx->writer, key, key_len, NULL);
             }
         }
         else {
-            if (flag & XH_H2X_F_ATTR_ONLY) return;
+            if (flag & XH_H2X_F_ATTR_ONLY) goto FINISH;
 
             if (type & XH_H2X_T_NOT_NULL) {
                 /* '<tag' */
-                xh_xml_write_start_tag(ctx->writer, key, key_len);
-                /* ' attr1="..." attr2="..."' */
-                xh_h2x_lx(ctx, value, XH_H2X_F_ATTR_ONLY);
-                /* '>' */
-                xh_xml_write_end_tag(ctx->writer);
-
-                xh_h2x_lx(ctx, value, XH_H2X_F_NONE);
+                xh_xml_write_start_tag(aTHX_ ctx->writer, key, key_len);
 
-                xh_xml_write_end_node(ctx->writer, key, key_len);
+                /* ' attr1="..." attr2="..."', then '>' */
+                frame->value = value;
+                frame->state = XH_H2X_S_KEY_ATTRS;
+                (void) xh_h2x_push_frame(ctx, NULL, 0, value, XH_H2X_F_ATTR_ONLY);
+                return;
             }
             else {
-                xh_xml_write_empty_node(ctx->writer, key, key_len);
+                xh_xml_write_empty_node(aTHX_ ctx->writer, key, key_len);
             }
         }
     }
     else {
         if (type & XH_H2X_T_NOT_NULL) {
             /* '<tag>' */
-            xh_xml_write_start_node(ctx->writer, key, key_len);
+            xh_xml_write_start_node(aTHX_ ctx->writer, key, key_len);
+
+            frame->state = XH_H2X_S_KEY_END;
+            (void) xh_h2x_push_frame(ctx, NULL, 0, value, XH_H2X_F_NONE);
+            return;
+        }
+        else {
+            xh_xml_write_empty_node(aTHX_ ctx->writer, key, key_len);
+        }
+    }
+
+FINISH:
+    (void) xh_h2x_pop_frame(aTHX_ ctx);
+}
+
+XH_INLINE void
+xh_h2x_lx_push_key(xh_h2x_ctx_t *ctx, char *key, I32 key_len, SV *value, xh_int_t flag)
+{
+    xh_h2x_push_frame(ctx, key, key_len, value, flag)->state = XH_H2X_S_KEY;
+}
+
+/*
+ * A record of plain values with the keys of the first record, all of them
+ * are nodes, FALSE for other records. The attribute pass of the parent has
+ * nothing to write.
+ */
+static xh_bool_t
+xh_h2x_lx_row(pTHX_ xh_h2x_ctx_t *ctx, xh_h2x_frame_t *frame, SV *item)
+{
+    xh_h2x_row_t *row;
+    SV           *values[XH_H2X_ROW_KEYS];
+    size_t        i, k;
 
-            xh_h2x_lx(ctx, value, XH_H2X_F_NONE);
+    if ((row = xh_h2x_row_values(aTHX_ ctx, frame, item, values, TRUE)) == NULL) return FALSE;
 
-            /* '</tag>' */
-            xh_xml_write_end_node(ctx->writer, key, key_len);
+    if (frame->flag & XH_H2X_F_ATTR_ONLY) return TRUE;
+
+    for (i = 0; i < row->len; i++) {
+        k = row->order[i];
+        if (SvOK(values[k])) {
+            xh_xml_write_start_node(aTHX_ ctx->writer, row->keys[k], row->key_lens[k]);
+            xh_xml_write_content(aTHX_ ctx->writer, values[k]);
+            xh_xml_write_end_node(aTHX_ ctx->writer, row->keys[k], row->key_lens[k]);
         }
         else {
-            xh_xml_write_empty_node(ctx->writer, key, key_len);
+            xh_xml_write_empty_node(aTHX_ ctx->writer, row->keys[k], row->key_lens[k]);
         }
     }
+
+    return TRUE;
 }
 
-void
-xh_h2x_lx(xh_h2x_ctx_t *ctx, SV *value, xh_int_t flag)
+/* returns FALSE if the traversal is suspended */
+xh_bool_t
+xh_h2x_lx(pTHX_ xh_h2x_ctx_t *ctx)
 {
-    SV             *hash_value;
+    xh_h2x_frame_t *frame;
+    SV             *value, *hash_value;
     char           *key;
     I32             key_len;
-    size_t          len, i;
     xh_uint_t       type;
     xh_sort_hash_t *sorted_hash;
 
-    value = xh_h2x_resolve_value(ctx, value, &type);
+    while ((frame = xh_h2x_top_frame(ctx)) != NULL) {
+        if (XH_H2X_SUSPEND(ctx)) return FALSE;
 
-    if (type & XH_H2X_T_SCALAR) {
-        if (flag & XH_H2X_F_ATTR_ONLY) goto FINISH;
-        xh_xml_write_content(ctx->writer, value);
-    }
-    else if (type & XH_H2X_T_HASH) {
-        len = HvUSEDKEYS((HV *) value);
+        switch (frame->state) {
+            case XH_H2X_S_ENTER:
+                value = xh_h2x_resolve_value(aTHX_ ctx, frame->value, &type);
 
-        if (len > 1 && ctx->opts.canonical) {
-            sorted_hash = xh_sort_hash((HV *) value, len);
-            for (i = 0; i < len; i++) {
-                _xh_h2x_lx(ctx, sorted_hash[i].key, sorted_hash[i].key_len, sorted_hash[i].value, flag);
-            }
-            free(sorted_hash);
-        }
-        else {
-            hv_iterinit((HV *) value);
-            while ((hash_value = hv_iternextsv((HV *) value, &key, &key_len))) {
-                _xh_h2x_lx(ctx, key, key_len, hash_value, flag);
-            }
-        }
-    }
-    else if (type & XH_H2X_T_ARRAY) {
-        len = av_len((AV *) value) + 1;
-        for (i = 0; i < len; i++) {
-            xh_h2x_lx(ctx, *av_fetch((AV *) value, i, 0), flag);
+                if (type & XH_H2X_T_SCALAR) {
+                    if (!(frame->flag & XH_H2X_F_ATTR_ONLY)) {
+                        xh_xml_write_content(aTHX_ ctx->writer, value);
+                    }
+                }
+                else if (type & XH_H2X_T_HASH) {
+                    frame->value = value;
+                    frame->len   = HvUSEDKEYS((HV *) value);
+
+                    if (frame->len > 1 && ctx->opts.canonical) {
+                        frame->base  = xh_sort_hash(aTHX_ &ctx->sort, (HV *) value, frame->len);
+                        frame->i     = 0;
+                        frame->state = XH_H2X_S_SORTED;
+                    }
+                    else {
+                        xh_hash_iter_init(aTHX_ &frame->hash, (HV *) value);
+                        frame->state = XH_H2X_S_HASH;
+                    }
+                    continue;
+                }
+                else if (type & XH_H2X_T_ARRAY) {
+                    frame->value = value;
+                    frame->len   = av_len((AV *) value) + 1;
+                    frame->i     = 0;
+                    frame->state = XH_H2X_S_ARRAY;
+                    continue;
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_SORTED:
+                if (frame->i < frame->len) {
+                    sorted_hash = xh_sort_hash_item(&ctx->sort, frame->base + frame->i++);
+                    xh_h2x_lx_push_key(ctx, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, frame->flag);
+                    break;
+                }
+
+                xh_sort_hash_release(&ctx->sort, frame->base);
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_HASH:
+                if ((hash_value = xh_hash_iter_next(aTHX_ &frame->hash, &key, &key_len))) {
+                    xh_h2x_lx_push_key(ctx, key, key_len, hash_value, frame->flag);
+                    break;
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_ARRAY:
+                if (frame->i < frame->len) {
+                    value = xh_h2x_array_next(aTHX_ frame);
+                    if (frame->row == XH_H2X_ROW_NONE || !xh_h2x_lx_row(aTHX_ ctx, frame, value)) {
+                        (void) xh_h2x_push_frame(ctx, NULL, 0, value, frame->flag);
+                    }
+                    break;
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_KEY:
+                _xh_h2x_lx(aTHX_ ctx, frame);
+                break;
+
+            case XH_H2X_S_KEY_ATTRS:
+                /* '>' */
+                xh_xml_write_end_tag(aTHX_ ctx->writer);
+
+                frame->state = XH_H2X_S_KEY_END;
+                (void) xh_h2x_push_frame(ctx, NULL, 0, frame->value, XH_H2X_F_NONE);
+                break;
+
+            case XH_H2X_S_KEY_END:
+                /* '</tag>' */
+                xh_xml_write_end_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
         }
     }
 
-FINISH:
-    ctx->depth--;
+    return TRUE;
 }
 
 #ifdef XH_HAVE_DOM
+/* a key of the hash */
 XH_INLINE void
-_xh_h2d_lx(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *key, I32 key_len, SV *value, xh_int_t flag)
+_xh_h2d_lx(pTHX_ xh_h2x_ctx_t *ctx, xh_h2x_frame_t *frame)
 {
-    xh_uint_t      type;
+    xh_uint_t  type;
+    xh_int_t   flag    = frame->flag;
+    char      *key     = frame->key;
+    I32        key_len = frame->key_len;
+    xmlNodePtr rootNode = frame->node;
+    xh_uint_t  key_class;
+    SV        *value;
 
-    value = xh_h2x_resolve_value(ctx, value, &type);
+    value = xh_h2x_resolve_value(aTHX_ ctx, frame->value, &type);
+    key_class = xh_h2x_key_class(&ctx->opts, key, key_len);
 
-    if (ctx->opts.cdata[0] != '\0' && strcmp(key, ctx->opts.cdata) == 0) {
-        if (flag & XH_H2X_F_ATTR_ONLY || !(type & XH_H2X_T_SCALAR)) return;
-        xh_dom_new_cdata(ctx, rootNode, value);
+    if (key_class == XH_H2X_K_CDATA) {
+        if (flag & XH_H2X_F_ATTR_ONLY || !(type & XH_H2X_T_SCALAR)) goto FINISH;
+        xh_dom_new_cdata(aTHX_ ctx, rootNode, value);
     }
-    else if (ctx->opts.text[0] != '\0' && strcmp(key, ctx->opts.text) == 0) {
-        if (flag & XH_H2X_F_ATTR_ONLY || !(type & XH_H2X_T_SCALAR)) return;
-        xh_dom_new_content(ctx, rootNode, value);
+    else if (key_class == XH_H2X_K_TEXT) {
+        if (flag & XH_H2X_F_ATTR_ONLY || !(type & XH_H2X_T_SCALAR)) goto FINISH;
+        xh_dom_new_content(aTHX_ ctx, rootNode, value);
     }
-    else if (ctx->opts.comm[0] != '\0' && strcmp(key, ctx->opts.comm) == 0) {
-        if (flag & XH_H2X_F_ATTR_ONLY) return;
+    else if (key_class == XH_H2X_K_COMM) {
+        if (flag & XH_H2X_F_ATTR_ONLY) goto FINISH;
 
         if (!type) {
-            xh_dom_new_comment(ctx, rootNode, NULL);
+            xh_dom_new_comment(aTHX_ ctx, rootNode, NULL);
         }
         else if (type & XH_H2X_T_SCALAR) {
-            xh_dom_new_comment(ctx, rootNode, value);
+            xh_dom_new_comment(aTHX_ ctx, rootNode, value);
         }
     }
-    else if (ctx->opts.attr[0] != '\0') {
-        if (strncmp(key, ctx->opts.attr, ctx->opts.attr_len) == 0) {
-            if (!(flag & XH_H2X_F_ATTR_ONLY)) return;
+    else if (ctx->opts.attr.len != 0) {
+        if (key_class == XH_H2X_K_ATTR) {
+            if (!(flag & XH_H2X_F_ATTR_ONLY)) goto FINISH;
 
-            key     += ctx->opts.attr_len;
-            key_len -= ctx->opts.attr_len;
+            key     += ctx->opts.attr.len;
+            key_len -= ctx->opts.attr.len;
 
             if (type & XH_H2X_T_SCALAR) {
-                xh_dom_new_attribute(ctx, rootNode, key, key_len, value);
+                xh_dom_new_attribute(aTHX_ ctx, rootNode, key, key_len, value);
             }
             else {
-                xh_dom_new_attribute(ctx, rootNode, key, key_len, NULL);
+                xh_dom_new_attribute(aTHX_ ctx, rootNode, key, key_len, NULL);
             }
         }
         else {
-            if (flag & XH_H2X_F_ATTR_ONLY) return;
-            rootNode = xh_dom_new_node(ctx, rootNode, key, key_len, NULL, type & XH_H2X_T_RAW);
+            if (flag & XH_H2X_F_ATTR_ONLY) goto FINISH;
+
+            rootNode = xh_dom_new_node(aTHX_ ctx, rootNode, key, key_len, NULL, type & XH_H2X_T_RAW);
             if (type & XH_H2X_T_NOT_NULL) {
-                xh_h2d_lx(ctx, rootNode, value, XH_H2X_F_ATTR_ONLY);
-                xh_h2d_lx(ctx, rootNode, value, XH_H2X_F_NONE);
+                /* attributes first, then the content */
+                frame->node  = rootNode;
+                frame->value = value;
+                frame->state = XH_H2X_S_KEY_ATTRS;
+                (void) xh_h2d_push_frame(ctx, rootNode, NULL, 0, value, XH_H2X_F_ATTR_ONLY);
+                return;
             }
         }
     }
     else {
-        rootNode = xh_dom_new_node(ctx, rootNode, key, key_len, NULL, type & XH_H2X_T_RAW);
+        rootNode = xh_dom_new_node(aTHX_ ctx, rootNode, key, key_len, NULL, type & XH_H2X_T_RAW);
         if (type & XH_H2X_T_NOT_NULL) {
-            xh_h2d_lx(ctx, rootNode, value, XH_H2X_F_NONE);
+            frame->state = XH_H2X_S_KEY_END;
+            (void) xh_h2d_push_frame(ctx, rootNode, NULL, 0, value, XH_H2X_F_NONE);
+            return;
         }
     }
+
+FINISH:
+    (void) xh_h2x_pop_frame(aTHX_ ctx);
 }
 
 void
-xh_h2d_lx(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, SV *value, xh_int_t flag)
+xh_h2d_lx(pTHX_ xh_h2x_ctx_t *ctx)
 {
-    SV             *hash_value;
+    xh_h2x_frame_t *frame;
+    SV             *value, *hash_value;
     char           *key;
     I32             key_len;
-    size_t          len, i;
     xh_uint_t       type;
     xh_sort_hash_t *sorted_hash;
 
-    value = xh_h2x_resolve_value(ctx, value, &type);
+    while ((frame = xh_h2x_top_frame(ctx)) != NULL) {
+        switch (frame->state) {
+            case XH_H2X_S_ENTER:
+                value = xh_h2x_resolve_value(aTHX_ ctx, frame->value, &type);
 
-    if (type & XH_H2X_T_SCALAR) {
-        if (flag & XH_H2X_F_ATTR_ONLY) goto FINISH;
-        xh_dom_new_content(ctx, rootNode, value);
-    }
-    else if (type & XH_H2X_T_HASH) {
-        len = HvUSEDKEYS((HV *) value);
-        hv_iterinit((HV *) value);
-
-        if (len > 1 && ctx->opts.canonical) {
-            sorted_hash = xh_sort_hash((HV *) value, len);
-            for (i = 0; i < len; i++) {
-                _xh_h2d_lx(ctx, rootNode, sorted_hash[i].key, sorted_hash[i].key_len, sorted_hash[i].value, flag);
-            }
-            free(sorted_hash);
-        }
-        else {
-            while ((hash_value = hv_iternextsv((HV *) value, &key, &key_len))) {
-                _xh_h2d_lx(ctx, rootNode, key, key_len, hash_value, flag);
-            }
-        }
-    }
-    else if (type & XH_H2X_T_ARRAY) {
-        len = av_len((AV *) value) + 1;
-        for (i = 0; i < len; i++) {
-            xh_h2d_lx(ctx, rootNode, *av_fetch((AV *) value, i, 0), flag);
+                if (type & XH_H2X_T_SCALAR) {
+                    if (!(frame->flag & XH_H2X_F_ATTR_ONLY)) {
+                        xh_dom_new_content(aTHX_ ctx, frame->node, value);
+                    }
+                }
+                else if (type & XH_H2X_T_HASH) {
+                    frame->value = value;
+                    frame->len   = HvUSEDKEYS((HV *) value);
+
+                    if (frame->len > 1 && ctx->opts.canonical) {
+                        frame->base  = xh_sort_hash(aTHX_ &ctx->sort, (HV *) value, frame->len);
+                        frame->i     = 0;
+                        frame->state = XH_H2X_S_SORTED;
+                    }
+                    else {
+                        xh_hash_iter_init(aTHX_ &frame->hash, (HV *) value);
+                        frame->state = XH_H2X_S_HASH;
+                    }
+                    continue;
+                }
+                else if (type & XH_H2X_T_ARRAY) {
+                    frame->value = value;
+                    frame->len   = av_len((AV *) value) + 1;
+                    frame->i     = 0;
+                    frame->state = XH_H2X_S_ARRAY;
+                    continue;
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_SORTED:
+                if (frame->i < frame->len) {
+                    sorted_hash = xh_sort_hash_item(&ctx->sort, frame->base + frame->i++);
+                    xh_h2d_push_frame(ctx, frame->node, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, frame->flag)->state = XH_H2X_S_KEY;
+                    break;
+                }
+
+                xh_sort_hash_release(&ctx->sort, frame->base);
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_HASH:
+                if ((hash_value = xh_hash_iter_next(aTHX_ &frame->hash, &key, &key_len))) {
+                    xh_h2d_push_frame(ctx, frame->node, key, key_len, hash_value, frame->flag)->state = XH_H2X_S_KEY;
+                    break;
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_ARRAY:
+                if (frame->i < frame->len) {
+                    value = xh_h2x_array_next(aTHX_ frame);
+                    (void) xh_h2d_push_frame(ctx, frame->node, NULL, 0, value, frame->flag);
+                    break;
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_KEY:
+                _xh_h2d_lx(aTHX_ ctx, frame);
+                break;
+
+            case XH_H2X_S_KEY_ATTRS:
+                frame->state = XH_H2X_S_KEY_END;
+                (void) xh_h2d_push_frame(ctx, frame->node, NULL, 0, frame->value, XH_H2X_F_NONE);
+                break;
+
+            case XH_H2X_S_KEY_END:
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
         }
     }
-
-FINISH:
-    ctx->depth--;
 }
 #endif
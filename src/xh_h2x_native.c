@@ -1,128 +1,279 @@
 #include "xh_config.h"
 #include "xh_core.h"
 
-void
-xh_h2x_native(xh_h2x_ctx_t *ctx, char *key, I32 key_len, SV *value)
+XH_INLINE void
+xh_h2x_native_plain(pTHX_ xh_h2x_ctx_t *ctx, char *key, I32 key_len, SV *value)
+{
+    if (expect_false(SvGMAGICAL(value)))
+        key = xh_h2x_hold_plain(aTHX_ ctx, key, key_len);
+
+    if (SvOK(value)) {
+        xh_xml_write_node(aTHX_ ctx->writer, key, key_len, value, FALSE);
+    }
+    else {
+        xh_xml_write_empty_node(aTHX_ ctx->writer, key, key_len);
+    }
+}
+
+/* a record of plain values with the keys of the first record, FALSE for others */
+static xh_bool_t
+xh_h2x_native_row(pTHX_ xh_h2x_ctx_t *ctx, xh_h2x_frame_t *frame, SV *item)
 {
+    xh_h2x_row_t *row;
+    SV           *values[XH_H2X_ROW_KEYS];
+    size_t        i, k;
+
+    if ((row = xh_h2x_row_values(aTHX_ ctx, frame, item, values, FALSE)) == NULL) return FALSE;
+
+    xh_xml_write_start_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+
+    for (i = 0; i < row->len; i++) {
+        k = row->order[i];
+        xh_h2x_native_plain(aTHX_ ctx, row->keys[k], row->key_lens[k], values[k]);
+    }
+
+    xh_xml_write_end_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+
+    return TRUE;
+}
+
+/* returns FALSE if the traversal is suspended */
+xh_bool_t
+xh_h2x_native(pTHX_ xh_h2x_ctx_t *ctx)
+{
+    xh_h2x_frame_t *frame;
     xh_uint_t       type;
-    size_t          i, len;
-    SV             *item_value;
+    SV             *value, *item_value;
     char           *item;
     I32             item_len;
     xh_sort_hash_t *sorted_hash;
     GV             *method;
 
-    value = xh_h2x_resolve_value(ctx, value, &type);
+    while ((frame = xh_h2x_top_frame(ctx)) != NULL) {
+        if (XH_H2X_SUSPEND(ctx)) return FALSE;
 
-    if (type & XH_H2X_T_BLESSED && (method = gv_fetchmethod_autoload(SvSTASH(value), "iternext", 0)) != NULL) {
-        while (1) {
-            item_value = xh_h2x_call_method(value, method, "iternext");
-            if (!SvOK(item_value)) break;
-            (void) xh_h2x_native(ctx, key, key_len, item_value);
-            SvREFCNT_dec(item_value);
-        }
-        goto FINISH;
-    }
+        switch (frame->state) {
+            case XH_H2X_S_ENTER:
+                value = xh_h2x_resolve_value(aTHX_ ctx, frame->value, &type);
 
-    if (type & XH_H2X_T_SCALAR) {
-        xh_xml_write_node(ctx->writer, key, key_len, value, type & XH_H2X_T_RAW);
-    }
-    else if (type & XH_H2X_T_HASH) {
-        len = HvUSEDKEYS((HV *) value);
-        if (len == 0) goto ADD_EMPTY_NODE;
-
-        xh_xml_write_start_node(ctx->writer, key, key_len);
-
-        if (len > 1 && ctx->opts.canonical) {
-            sorted_hash = xh_sort_hash((HV *) value, len);
-            for (i = 0; i < len; i++) {
-                xh_h2x_native(ctx, sorted_hash[i].key, sorted_hash[i].key_len, sorted_hash[i].value);
-            }
-            free(sorted_hash);
-        }
-        else {
-            hv_iterinit((HV *) value);
-            while ((item_value = hv_iternextsv((HV *) value, &item, &item_len))) {
-                xh_h2x_native(ctx, item, item_len, item_value);
-            }
-        }
+                if (type & XH_H2X_T_BLESSED && (method = gv_fetchmethod_autoload(SvSTASH(value), "iternext", 0)) != NULL) {
+                    frame->value  = value;
+                    frame->method = method;
+                    frame->state  = XH_H2X_S_ITER;
+                    continue;
+                }
 
-        xh_xml_write_end_node(ctx->writer, key, key_len);
-    }
-    else if (type & XH_H2X_T_ARRAY) {
-        len = av_len((AV *) value) + 1;
-        for (i = 0; i < len; i++) {
-            xh_h2x_native(ctx, key, key_len, *av_fetch((AV *) value, i, 0));
-        }
-    }
-    else {
+                if (type & XH_H2X_T_SCALAR) {
+                    xh_xml_write_node(aTHX_ ctx->writer, frame->key, frame->key_len, value, type & XH_H2X_T_RAW);
+                }
+                else if (type & XH_H2X_T_HASH) {
+                    frame->len = HvUSEDKEYS((HV *) value);
+                    if (frame->len == 0) goto ADD_EMPTY_NODE;
+
+                    xh_xml_write_start_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+
+                    frame->value = value;
+                    if (frame->len > 1 && ctx->opts.canonical) {
+                        frame->base  = xh_sort_hash(aTHX_ &ctx->sort, (HV *) value, frame->len);
+                        frame->i     = 0;
+                        frame->state = XH_H2X_S_SORTED;
+                    }
+                    else {
+                        xh_hash_iter_init(aTHX_ &frame->hash, (HV *) value);
+                        frame->state = XH_H2X_S_HASH;
+                    }
+                    continue;
+                }
+                else if (type & XH_H2X_T_ARRAY) {
+                    frame->value = value;
+                    frame->len   = av_len((AV *) value) + 1;
+                    frame->i     = 0;
+                    frame->state = XH_H2X_S_ARRAY;
+                    continue;
+                }
+                else {
 ADD_EMPTY_NODE:
-        xh_xml_write_empty_node(ctx->writer, key, key_len);
+                    xh_xml_write_empty_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_ITER:
+                if (frame->item != NULL) {
+                    SvREFCNT_dec(frame->item);
+                    frame->item = NULL;
+                }
+
+                item_value = xh_h2x_call_method(aTHX_ ctx, frame->value, frame->method, "iternext");
+                if (!SvOK(item_value)) {
+                    SvREFCNT_dec(item_value);
+                    (void) xh_h2x_pop_frame(aTHX_ ctx);
+                    break;
+                }
+
+                frame->item = item_value;
+                (void) xh_h2x_push_frame(ctx, frame->key, frame->key_len, item_value, XH_H2X_F_NONE);
+                break;
+
+            case XH_H2X_S_SORTED:
+                if (frame->i < frame->len) {
+                    sorted_hash = xh_sort_hash_item(&ctx->sort, frame->base + frame->i++);
+                    if (XH_H2X_IS_PLAIN((SV *) sorted_hash->value)) {
+                        xh_h2x_native_plain(aTHX_ ctx, sorted_hash->key, sorted_hash->key_len, sorted_hash->value);
+                    }
+                    else {
+                        (void) xh_h2x_push_frame(ctx, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, XH_H2X_F_NONE);
+                    }
+                    break;
+                }
+
+                xh_sort_hash_release(&ctx->sort, frame->base);
+                xh_xml_write_end_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_HASH:
+                if ((item_value = xh_hash_iter_next(aTHX_ &frame->hash, &item, &item_len))) {
+                    if (XH_H2X_IS_PLAIN(item_value)) {
+                        xh_h2x_native_plain(aTHX_ ctx, item, item_len, item_value);
+                    }
+                    else {
+                        (void) xh_h2x_push_frame(ctx, item, item_len, item_value, XH_H2X_F_NONE);
+                    }
+                    break;
+                }
+
+                xh_xml_write_end_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_ARRAY:
+                if (frame->i < frame->len) {
+                    item_value = xh_h2x_array_next(aTHX_ frame);
+                    if (XH_H2X_IS_PLAIN(item_value)) {
+                        xh_h2x_native_plain(aTHX_ ctx, frame->key, frame->key_len, item_value);
+                    }
+                    else if (frame->row == XH_H2X_ROW_NONE || !xh_h2x_native_row(aTHX_ ctx, frame, item_value)) {
+                        (void) xh_h2x_push_frame(ctx, frame->key, frame->key_len, item_value, XH_H2X_F_NONE);
+                    }
+                    break;
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+        }
     }
 
-FINISH:
-    ctx->depth--;
+    return TRUE;
 }
 
 #ifdef XH_HAVE_DOM
 void
-xh_h2d_native(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *key, I32 key_len, SV *value)
+xh_h2d_native(pTHX_ xh_h2x_ctx_t *ctx)
 {
+    xh_h2x_frame_t *frame;
     xh_uint_t       type;
-    size_t          i, len;
-    SV             *item_value;
+    SV             *value, *item_value;
     char           *item;
     I32             item_len;
     xh_sort_hash_t *sorted_hash;
     GV             *method;
 
-    value = xh_h2x_resolve_value(ctx, value, &type);
+    while ((frame = xh_h2x_top_frame(ctx)) != NULL) {
+        switch (frame->state) {
+            case XH_H2X_S_ENTER:
+                value = xh_h2x_resolve_value(aTHX_ ctx, frame->value, &type);
 
-    if (type & XH_H2X_T_BLESSED && (method = gv_fetchmethod_autoload(SvSTASH(value), "iternext", 0)) != NULL) {
-        while (1) {
-            item_value = xh_h2x_call_method(value, method, "iternext");
-            if (!SvOK(item_value)) break;
-            (void) xh_h2d_native(ctx, rootNode, key, key_len, item_value);
-            SvREFCNT_dec(item_value);
-        }
-        goto FINISH;
-    }
+                if (type & XH_H2X_T_BLESSED && (method = gv_fetchmethod_autoload(SvSTASH(value), "iternext", 0)) != NULL) {
+                    frame->value  = value;
+                    frame->method = method;
+                    frame->state  = XH_H2X_S_ITER;
+                    continue;
+                }
 
-    if (type & XH_H2X_T_SCALAR) {
-        (void) xh_dom_new_node(ctx, rootNode, key, key_len, value, type & XH_H2X_T_RAW);
-    }
-    else if (type & XH_H2X_T_HASH) {
-        len = HvUSEDKEYS((HV *) value);
-        if (len == 0) goto ADD_EMPTY_NODE;
-
-        rootNode = xh_dom_new_node(ctx, rootNode, key, key_len, NULL, FALSE);
-
-        if (len > 1 && ctx->opts.canonical) {
-            sorted_hash = xh_sort_hash((HV *) value, len);
-            for (i = 0; i < len; i++) {
-                xh_h2d_native(ctx, rootNode, sorted_hash[i].key, sorted_hash[i].key_len, sorted_hash[i].value);
-            }
-            free(sorted_hash);
-        }
-        else {
-            hv_iterinit((HV *) value);
-            while ((item_value = hv_iternextsv((HV *) value, &item, &item_len))) {
-                xh_h2d_native(ctx, rootNode, item, item_len, item_value);
-            }
-        }
-    }
-    else if (type & XH_H2X_T_ARRAY) {
-        len = av_len((AV *) value) + 1;
-        for (i = 0; i < len; i++) {
-            (void) xh_h2d_native(ctx, rootNode, key, key_len, *av_fetch((AV *) value, i, 0));
-        }
-    }
-    else {
+                if (type & XH_H2X_T_SCALAR) {
+                    (void) xh_dom_new_node(aTHX_ ctx, frame->node, frame->key, frame->key_len, value, type & XH_H2X_T_RAW);
+                }
+                else if (type & XH_H2X_T_HASH) {
+                    frame->len = HvUSEDKEYS((HV *) value);
+                    if (frame->len == 0) goto ADD_EMPTY_NODE;
+
+                    frame->node  = xh_dom_new_node(aTHX_ ctx, frame->node, frame->key, frame->key_len, NULL, FALSE);
+                    frame->value = value;
+                    if (frame->len > 1 && ctx->opts.canonical) {
+                        frame->base  = xh_sort_hash(aTHX_ &ctx->sort, (HV *) value, frame->len);
+                        frame->i     = 0;
+                        frame->state = XH_H2X_S_SORTED;
+                    }
+                    else {
+                        xh_hash_iter_init(aTHX_ &frame->hash, (HV *) value);
+                        frame->state = XH_H2X_S_HASH;
+                    }
+                    continue;
+                }
+                else if (type & XH_H2X_T_ARRAY) {
+                    frame->value = value;
+                    frame->len   = av_len((AV *) value) + 1;
+                    frame->i     = 0;
+                    frame->state = XH_H2X_S_ARRAY;
+                    continue;
+                }
+                else {
 ADD_EMPTY_NODE:
-        xh_dom_new_node(ctx, rootNode, key, key_len, NULL, FALSE);
-    }
+                    (void) xh_dom_new_node(aTHX_ ctx, frame->node, frame->key, frame->key_len, NULL, FALSE);
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_ITER:
+                if (frame->item != NULL) {
+                    SvREFCNT_dec(frame->item);
+                    frame->item = NULL;
+                }
+
+                item_value = xh_h2x_call_method(aTHX_ ctx, frame->value, frame->method, "iternext");
+                if (!SvOK(item_value)) {
+                    SvREFCNT_dec(item_value);
+                    (void) xh_h2x_pop_frame(aTHX_ ctx);
+                    break;
+                }
+
+                frame->item = item_value;
+                (void) xh_h2d_push_frame(ctx, frame->node, frame->key, frame->key_len, item_value, XH_H2X_F_NONE);
+                break;
 
-FINISH:
-    ctx->depth--;
+            case XH_H2X_S_SORTED:
+                if (frame->i < frame->len) {
+                    sorted_hash = xh_sort_hash_item(&ctx->sort, frame->base + frame->i++);
+                    (void) xh_h2d_push_frame(ctx, frame->node, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, XH_H2X_F_NONE);
+                    break;
+                }
+
+                xh_sort_hash_release(&ctx->sort, frame->base);
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_HASH:
+                if ((item_value = xh_hash_iter_next(aTHX_ &frame->hash, &item, &item_len))) {
+                    (void) xh_h2d_push_frame(ctx, frame->node, item, item_len, item_value, XH_H2X_F_NONE);
+                    break;
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_ARRAY:
+                if (frame->i < frame->len) {
+                    item_value = xh_h2x_array_next(aTHX_ frame);
+                    (void) xh_h2d_push_frame(ctx, frame->node, frame->key, frame->key_len, item_value, XH_H2X_F_NONE);
+                    break;
+                }
+
+                (void) xh_h2x_pop_frame(aTHX_ ctx);
+                break;
+        }
+    }
 }
 #endif
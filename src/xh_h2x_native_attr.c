@@ -1,245 +1,464 @@
 #include "xh_config.h"
 #include "xh_core.h"
 
-xh_int_t
-xh_h2x_native_attr(xh_h2x_ctx_t *ctx, char *key, I32 key_len, SV *value, xh_int_t flag)
+/* the number of attributes and nodes goes to the parent */
+XH_INLINE void
+xh_h2x_native_attr_return(pTHX_ xh_h2x_ctx_t *ctx)
 {
-    xh_uint_t       type;
-    size_t          len, i, nattrs, done;
-    xh_sort_hash_t *sorted_hash;
-    SV             *item_value;
-    char           *item;
-    I32             item_len;
-    GV             *method;
-
-    nattrs = 0;
-
-    if (ctx->opts.content[0] != '\0' && strcmp(key, ctx->opts.content) == 0)
-        flag = flag | XH_H2X_F_CONTENT;
+    xh_h2x_frame_t *frame, *parent;
 
-    value = xh_h2x_resolve_value(ctx, value, &type);
+    frame  = xh_h2x_pop_frame(aTHX_ ctx);
+    parent = xh_h2x_top_frame(ctx);
 
-    if (type & XH_H2X_T_BLESSED && (method = gv_fetchmethod_autoload(SvSTASH(value), "iternext", 0)) != NULL) {
-        if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+    if (parent != NULL) {
+        parent->done += frame->nattrs;
+    }
+}
 
-        while (1) {
-            item_value = xh_h2x_call_method(value, method, "iternext");
-            if (!SvOK(item_value)) break;
-            (void) xh_h2x_native_attr(ctx, key, key_len, item_value, XH_H2X_F_SIMPLE | XH_H2X_F_COMPLEX);
-            SvREFCNT_dec(item_value);
-        }
-        nattrs++;
+XH_INLINE size_t
+xh_h2x_native_attr_plain(pTHX_ xh_h2x_ctx_t *ctx, char *key, I32 key_len, SV *value, xh_int_t flag)
+{
+    if (expect_false(SvGMAGICAL(value)))
+        key = xh_h2x_hold_plain(aTHX_ ctx, key, key_len);
 
-        goto FINISH;
-    }
+    if (xh_h2x_key_class(&ctx->opts, key, key_len) == XH_H2X_K_CONTENT)
+        flag = flag | XH_H2X_F_CONTENT;
 
-    if (type & XH_H2X_T_SCALAR) {
-        if (flag & XH_H2X_F_COMPLEX && (flag & XH_H2X_F_SIMPLE || type & XH_H2X_T_RAW)) {
-            xh_xml_write_node(ctx->writer, key, key_len, value, type & XH_H2X_T_RAW);
+    if (SvOK(value)) {
+        if (flag & XH_H2X_F_COMPLEX && flag & XH_H2X_F_SIMPLE) {
+            xh_xml_write_node(aTHX_ ctx->writer, key, key_len, value, FALSE);
         }
         else if (flag & XH_H2X_F_COMPLEX && flag & XH_H2X_F_CONTENT) {
-            xh_xml_write_content(ctx->writer, value);
+            xh_xml_write_content(aTHX_ ctx->writer, value);
         }
-        else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT) && !(type & XH_H2X_T_RAW)) {
-            xh_xml_write_attribute(ctx->writer, key, key_len, value);
-            nattrs++;
+        else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT)) {
+            xh_xml_write_attribute(aTHX_ ctx->writer, key, key_len, value);
+            return 1;
         }
     }
-    else if (type & XH_H2X_T_HASH) {
-        if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
-
-        len = HvUSEDKEYS((SV *) value);
-        if (len == 0) {
-            xh_xml_write_empty_node(ctx->writer, key, key_len);
-            goto FINISH;
+    else {
+        if (flag & XH_H2X_F_SIMPLE && flag & XH_H2X_F_COMPLEX) {
+            xh_xml_write_empty_node(aTHX_ ctx->writer, key, key_len);
         }
+        else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT)) {
+            xh_xml_write_attribute(aTHX_ ctx->writer, key, key_len, NULL);
+            return 1;
+        }
+    }
 
-        xh_xml_write_start_tag(ctx->writer, key, key_len);
+    return 0;
+}
+
+/*
+ * A record of plain values with the keys of the first record, all of them
+ * are attributes. FALSE for other records.
+ */
+static xh_bool_t
+xh_h2x_native_attr_row(pTHX_ xh_h2x_ctx_t *ctx, xh_h2x_frame_t *frame, SV *item)
+{
+    xh_h2x_row_t *row;
+    SV           *values[XH_H2X_ROW_KEYS];
+    size_t        i, k;
 
-        done = 0;
+    if ((row = xh_h2x_row_values(aTHX_ ctx, frame, item, values, TRUE)) == NULL) return FALSE;
 
-        if (len > 1 && ctx->opts.canonical) {
-            sorted_hash = xh_sort_hash((HV *) value, len);
+    xh_xml_write_start_tag(aTHX_ ctx->writer, frame->key, frame->key_len);
 
-            for (i = 0; i < len; i++) {
-                done += xh_h2x_native_attr(ctx, sorted_hash[i].key, sorted_hash[i].key_len, sorted_hash[i].value, XH_H2X_F_SIMPLE);
-            }
+    for (i = 0; i < row->len; i++) {
+        k = row->order[i];
+        xh_xml_write_attribute(aTHX_ ctx->writer, row->keys[k], row->key_lens[k], SvOK(values[k]) ? values[k] : NULL);
+    }
+
+    xh_xml_write_closed_end_tag(aTHX_ ctx->writer);
 
-            if (done == len) {
-                xh_xml_write_closed_end_tag(ctx->writer);
-            }
-            else {
-                xh_xml_write_end_tag(ctx->writer);
+    return TRUE;
+}
 
-                for (i = 0; i < len; i++) {
-                    (void) xh_h2x_native_attr(ctx, sorted_hash[i].key, sorted_hash[i].key_len, sorted_hash[i].value, XH_H2X_F_COMPLEX);
+/* returns FALSE if the traversal is suspended */
+xh_bool_t
+xh_h2x_native_attr(pTHX_ xh_h2x_ctx_t *ctx)
+{
+    xh_h2x_frame_t *frame;
+    xh_uint_t       type;
+    xh_int_t        flag;
+    xh_sort_hash_t *sorted_hash;
+    SV             *value, *item_value;
+    char           *item;
+    I32             item_len;
+    GV             *method;
+
+    while ((frame = xh_h2x_top_frame(ctx)) != NULL) {
+        if (XH_H2X_SUSPEND(ctx)) return FALSE;
+
+        switch (frame->state) {
+            case XH_H2X_S_ENTER:
+                flag = frame->flag;
+
+                if (xh_h2x_key_class(&ctx->opts, frame->key, frame->key_len) == XH_H2X_K_CONTENT)
+                    flag = flag | XH_H2X_F_CONTENT;
+
+                value = xh_h2x_resolve_value(aTHX_ ctx, frame->value, &type);
+
+                if (type & XH_H2X_T_BLESSED && (method = gv_fetchmethod_autoload(SvSTASH(value), "iternext", 0)) != NULL) {
+                    if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+
+                    frame->value  = value;
+                    frame->method = method;
+                    frame->nattrs = 1;
+                    frame->state  = XH_H2X_S_ITER;
+                    continue;
                 }
 
-                xh_xml_write_end_node(ctx->writer, key, key_len);
-            }
+                if (type & XH_H2X_T_SCALAR) {
+                    if (flag & XH_H2X_F_COMPLEX && (flag & XH_H2X_F_SIMPLE || type & XH_H2X_T_RAW)) {
+                        xh_xml_write_node(aTHX_ ctx->writer, frame->key, frame->key_len, value, type & XH_H2X_T_RAW);
+                    }
+                    else if (flag & XH_H2X_F_COMPLEX && flag & XH_H2X_F_CONTENT) {
+                        xh_xml_write_content(aTHX_ ctx->writer, value);
+                    }
+                    else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT) && !(type & XH_H2X_T_RAW)) {
+                        xh_xml_write_attribute(aTHX_ ctx->writer, frame->key, frame->key_len, value);
+                        frame->nattrs++;
+                    }
+                }
+                else if (type & XH_H2X_T_HASH) {
+                    if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+
+                    frame->len = HvUSEDKEYS((SV *) value);
+                    if (frame->len == 0) {
+                        xh_xml_write_empty_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+                        goto FINISH;
+                    }
+
+                    xh_xml_write_start_tag(aTHX_ ctx->writer, frame->key, frame->key_len);
+
+                    frame->value  = value;
+                    frame->done   = 0;
+                    frame->nattrs = 1;
+                    if (frame->len > 1 && ctx->opts.canonical) {
+                        frame->base  = xh_sort_hash(aTHX_ &ctx->sort, (HV *) value, frame->len);
+                        frame->i     = 0;
+                        frame->state = XH_H2X_S_SORTED;
+                    }
+                    else {
+                        xh_hash_iter_init(aTHX_ &frame->hash, (HV *) value);
+                        frame->state = XH_H2X_S_HASH;
+                    }
+                    continue;
+                }
+                else if (type & XH_H2X_T_ARRAY) {
+                    if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+
+                    frame->value  = value;
+                    frame->len    = av_len((AV *) value) + 1;
+                    frame->i      = 0;
+                    frame->nattrs = 1;
+                    frame->state  = XH_H2X_S_ARRAY;
+                    continue;
+                }
+                else {
+                    if (flag & XH_H2X_F_SIMPLE && flag & XH_H2X_F_COMPLEX) {
+                        xh_xml_write_empty_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+                    }
+                    else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT)) {
+                        xh_xml_write_attribute(aTHX_ ctx->writer, frame->key, frame->key_len, NULL);
+                        frame->nattrs++;
+                    }
+                }
 
-            free(sorted_hash);
-        }
-        else {
-            hv_iterinit((HV *) value);
-            while ((item_value = hv_iternextsv((HV *) value, &item, &item_len))) {
-                done += xh_h2x_native_attr(ctx, item, item_len,item_value, XH_H2X_F_SIMPLE);
-            }
+FINISH:
+                xh_h2x_native_attr_return(aTHX_ ctx);
+                break;
 
-            if (done == len) {
-                xh_xml_write_closed_end_tag(ctx->writer);
-            }
-            else {
-                xh_xml_write_end_tag(ctx->writer);
+            case XH_H2X_S_ITER:
+                if (frame->item != NULL) {
+                    SvREFCNT_dec(frame->item);
+                    frame->item = NULL;
+                }
 
-                hv_iterinit((HV *) value);
-                while ((item_value = hv_iternextsv((HV *) value, &item, &item_len))) {
-                    (void) xh_h2x_native_attr(ctx, item, item_len,item_value, XH_H2X_F_COMPLEX);
+                item_value = xh_h2x_call_method(aTHX_ ctx, frame->value, frame->method, "iternext");
+                if (!SvOK(item_value)) {
+                    SvREFCNT_dec(item_value);
+                    xh_h2x_native_attr_return(aTHX_ ctx);
+                    break;
                 }
 
-                xh_xml_write_end_node(ctx->writer, key, key_len);
-            }
-        }
+                frame->item = item_value;
+                (void) xh_h2x_push_frame(ctx, frame->key, frame->key_len, item_value, XH_H2X_F_SIMPLE | XH_H2X_F_COMPLEX);
+                break;
+
+            /* attributes of the hash */
+            case XH_H2X_S_SORTED:
+                if (frame->i < frame->len) {
+                    sorted_hash = xh_sort_hash_item(&ctx->sort, frame->base + frame->i++);
+                    if (XH_H2X_IS_PLAIN((SV *) sorted_hash->value)) {
+                        frame->done += xh_h2x_native_attr_plain(aTHX_ ctx, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, XH_H2X_F_SIMPLE);
+                    }
+                    else {
+                        (void) xh_h2x_push_frame(ctx, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, XH_H2X_F_SIMPLE);
+                    }
+                    break;
+                }
 
-        nattrs++;
-    }
-    else if (type & XH_H2X_T_ARRAY) {
-        if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+                if (frame->done == frame->len) {
+                    xh_xml_write_closed_end_tag(aTHX_ ctx->writer);
+                    xh_sort_hash_release(&ctx->sort, frame->base);
+                    xh_h2x_native_attr_return(aTHX_ ctx);
+                    break;
+                }
 
-        len = av_len((AV *) value) + 1;
-        for (i = 0; i < len; i++) {
-            (void) xh_h2x_native_attr(ctx, key, key_len, *av_fetch((AV *) value, i, 0), XH_H2X_F_SIMPLE | XH_H2X_F_COMPLEX);
-        }
+                xh_xml_write_end_tag(aTHX_ ctx->writer);
+                frame->i     = 0;
+                frame->state = XH_H2X_S_SORTED_NODES;
+                break;
+
+            case XH_H2X_S_HASH:
+                if ((item_value = xh_hash_iter_next(aTHX_ &frame->hash, &item, &item_len))) {
+                    if (XH_H2X_IS_PLAIN(item_value)) {
+                        frame->done += xh_h2x_native_attr_plain(aTHX_ ctx, item, item_len, item_value, XH_H2X_F_SIMPLE);
+                    }
+                    else {
+                        (void) xh_h2x_push_frame(ctx, item, item_len, item_value, XH_H2X_F_SIMPLE);
+                    }
+                    break;
+                }
 
-        nattrs++;
-    }
-    else {
-        if (flag & XH_H2X_F_SIMPLE && flag & XH_H2X_F_COMPLEX) {
-            xh_xml_write_empty_node(ctx->writer, key, key_len);
-        }
-        else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT)) {
-            xh_xml_write_attribute(ctx->writer, key, key_len, NULL);
-            nattrs++;
+                if (frame->done == frame->len) {
+                    xh_xml_write_closed_end_tag(aTHX_ ctx->writer);
+                    xh_h2x_native_attr_return(aTHX_ ctx);
+                    break;
+                }
+
+                xh_xml_write_end_tag(aTHX_ ctx->writer);
+                xh_hash_iter_init(aTHX_ &frame->hash, (HV *) frame->value);
+                frame->state = XH_H2X_S_HASH_NODES;
+                break;
+
+            /* nodes of the hash */
+            case XH_H2X_S_SORTED_NODES:
+                if (frame->i < frame->len) {
+                    sorted_hash = xh_sort_hash_item(&ctx->sort, frame->base + frame->i++);
+                    if (XH_H2X_IS_PLAIN((SV *) sorted_hash->value)) {
+                        (void) xh_h2x_native_attr_plain(aTHX_ ctx, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, XH_H2X_F_COMPLEX);
+                    }
+                    else {
+                        (void) xh_h2x_push_frame(ctx, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, XH_H2X_F_COMPLEX);
+                    }
+                    break;
+                }
+
+                xh_xml_write_end_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+                xh_sort_hash_release(&ctx->sort, frame->base);
+                xh_h2x_native_attr_return(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_HASH_NODES:
+                if ((item_value = xh_hash_iter_next(aTHX_ &frame->hash, &item, &item_len))) {
+                    if (XH_H2X_IS_PLAIN(item_value)) {
+                        (void) xh_h2x_native_attr_plain(aTHX_ ctx, item, item_len, item_value, XH_H2X_F_COMPLEX);
+                    }
+                    else {
+                        (void) xh_h2x_push_frame(ctx, item, item_len, item_value, XH_H2X_F_COMPLEX);
+                    }
+                    break;
+                }
+
+                xh_xml_write_end_node(aTHX_ ctx->writer, frame->key, frame->key_len);
+                xh_h2x_native_attr_return(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_ARRAY:
+                if (frame->i < frame->len) {
+                    item_value = xh_h2x_array_next(aTHX_ frame);
+                    if (XH_H2X_IS_PLAIN(item_value)) {
+                        (void) xh_h2x_native_attr_plain(aTHX_ ctx, frame->key, frame->key_len, item_value, XH_H2X_F_SIMPLE | XH_H2X_F_COMPLEX);
+                    }
+                    else if (frame->row == XH_H2X_ROW_NONE || !xh_h2x_native_attr_row(aTHX_ ctx, frame, item_value)) {
+                        (void) xh_h2x_push_frame(ctx, frame->key, frame->key_len, item_value, XH_H2X_F_SIMPLE | XH_H2X_F_COMPLEX);
+                    }
+                    break;
+                }
+
+                xh_h2x_native_attr_return(aTHX_ ctx);
+                break;
         }
     }
 
-FINISH:
-    ctx->depth--;
-
-    return nattrs;
+    return TRUE;
 }
 
 #ifdef XH_HAVE_DOM
-xh_int_t
-xh_h2d_native_attr(xh_h2x_ctx_t *ctx, xmlNodePtr rootNode, char *key, I32 key_len, SV *value, xh_int_t flag)
+void
+xh_h2d_native_attr(pTHX_ xh_h2x_ctx_t *ctx)
 {
+    xh_h2x_frame_t *frame;
     xh_uint_t       type;
-    size_t          len, i, nattrs, done;
+    xh_int_t        flag;
     xh_sort_hash_t *sorted_hash;
-    SV             *item_value;
+    SV             *value, *item_value;
     char           *item;
     I32             item_len;
     GV             *method;
 
-    nattrs = 0;
+    while ((frame = xh_h2x_top_frame(ctx)) != NULL) {
+        switch (frame->state) {
+            case XH_H2X_S_ENTER:
+                flag = frame->flag;
 
-    if (ctx->opts.content[0] != '\0' && strcmp(key, ctx->opts.content) == 0)
-        flag = flag | XH_H2X_F_CONTENT;
+                if (xh_h2x_key_class(&ctx->opts, frame->key, frame->key_len) == XH_H2X_K_CONTENT)
+                    flag = flag | XH_H2X_F_CONTENT;
 
-    value = xh_h2x_resolve_value(ctx, value, &type);
+                value = xh_h2x_resolve_value(aTHX_ ctx, frame->value, &type);
 
+                if (type & XH_H2X_T_BLESSED && (method = gv_fetchmethod_autoload(SvSTASH(value), "iternext", 0)) != NULL) {
+                    if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
 
-    if (type & XH_H2X_T_BLESSED && (method = gv_fetchmethod_autoload(SvSTASH(value), "iternext", 0)) != NULL) {
-        if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+                    frame->value  = value;
+                    frame->method = method;
+                    frame->nattrs = 1;
+                    frame->state  = XH_H2X_S_ITER;
+                    continue;
+                }
 
-        while (1) {
-            item_value = xh_h2x_call_method(value, method, "iternext");
-            if (!SvOK(item_value)) break;
-            (void) xh_h2d_native_attr(ctx, rootNode, key, key_len, item_value, XH_H2X_F_SIMPLE | XH_H2X_F_COMPLEX);
-            SvREFCNT_dec(item_value);
-        }
+                if (type & XH_H2X_T_SCALAR) {
+                    if (flag & XH_H2X_F_SIMPLE && flag & XH_H2X_F_COMPLEX) {
+                        (void) xh_dom_new_node(aTHX_ ctx, frame->node, frame->key, frame->key_len, value, type & XH_H2X_T_RAW);
+                    }
+                    else if (flag & XH_H2X_F_COMPLEX && flag & XH_H2X_F_CONTENT) {
+                        xh_dom_new_content(aTHX_ ctx, frame->node, value);
+                    }
+                    else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT)) {
+                        xh_dom_new_attribute(aTHX_ ctx, frame->node, frame->key, frame->key_len, value);
+                        frame->nattrs++;
+                    }
+                }
+                else if (type & XH_H2X_T_HASH) {
+                    if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+
+                    frame->node = xh_dom_new_node(aTHX_ ctx, frame->node, frame->key, frame->key_len, NULL, type & XH_H2X_T_RAW);
+
+                    frame->len = HvUSEDKEYS((SV *) value);
+                    if (frame->len == 0) goto FINISH;
+
+                    frame->value  = value;
+                    frame->done   = 0;
+                    frame->nattrs = 1;
+                    if (frame->len > 1 && ctx->opts.canonical) {
+                        frame->base  = xh_sort_hash(aTHX_ &ctx->sort, (HV *) value, frame->len);
+                        frame->i     = 0;
+                        frame->state = XH_H2X_S_SORTED;
+                    }
+                    else {
+                        xh_hash_iter_init(aTHX_ &frame->hash, (HV *) value);
+                        frame->state = XH_H2X_S_HASH;
+                    }
+                    continue;
+                }
+                else if (type & XH_H2X_T_ARRAY) {
+                    if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+
+                    frame->value  = value;
+                    frame->len    = av_len((AV *) value) + 1;
+                    frame->i      = 0;
+                    frame->nattrs = 1;
+                    frame->state  = XH_H2X_S_ARRAY;
+                    continue;
+                }
+                else {
+                    if (flag & XH_H2X_F_SIMPLE && flag & XH_H2X_F_COMPLEX) {
+                        (void) xh_dom_new_node(aTHX_ ctx, frame->node, frame->key, frame->key_len, NULL, type & XH_H2X_T_RAW);
+                    }
+                    else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT)) {
+                        xh_dom_new_attribute(aTHX_ ctx, frame->node, frame->key, frame->key_len, NULL);
+                        frame->nattrs++;
+                    }
+                }
 
-        nattrs++;
+FINISH:
+                xh_h2x_native_attr_return(aTHX_ ctx);
+                break;
 
-        goto FINISH;
-    }
+            case XH_H2X_S_ITER:
+                if (frame->item != NULL) {
+                    SvREFCNT_dec(frame->item);
+                    frame->item = NULL;
+                }
 
-    if (type & XH_H2X_T_SCALAR) {
-        if (flag & XH_H2X_F_SIMPLE && flag & XH_H2X_F_COMPLEX) {
-            (void) xh_dom_new_node(ctx, rootNode, key, key_len, value, type & XH_H2X_T_RAW);
-        }
-        else if (flag & XH_H2X_F_COMPLEX && flag & XH_H2X_F_CONTENT) {
-            xh_dom_new_content(ctx, rootNode, value);
-        }
-        else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT)) {
-            xh_dom_new_attribute(ctx, rootNode, key, key_len, value);
-            nattrs++;
-        }
-    }
-    else if (type & XH_H2X_T_HASH) {
-        if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+                item_value = xh_h2x_call_method(aTHX_ ctx, frame->value, frame->method, "iternext");
+                if (!SvOK(item_value)) {
+                    SvREFCNT_dec(item_value);
+                    xh_h2x_native_attr_return(aTHX_ ctx);
+                    break;
+                }
 
-        rootNode = xh_dom_new_node(ctx, rootNode, key, key_len, NULL, type & XH_H2X_T_RAW);
+                frame->item = item_value;
+                (void) xh_h2d_push_frame(ctx, frame->node, frame->key, frame->key_len, item_value, XH_H2X_F_SIMPLE | XH_H2X_F_COMPLEX);
+                break;
 
-        len = HvUSEDKEYS((SV *) value);
-        if (len == 0) goto FINISH;
+            /* attributes of the hash */
+            case XH_H2X_S_SORTED:
+                if (frame->i < frame->len) {
+                    sorted_hash = xh_sort_hash_item(&ctx->sort, frame->base + frame->i++);
+                    (void) xh_h2d_push_frame(ctx, frame->node, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, XH_H2X_F_SIMPLE);
+                    break;
+                }
 
-        done = 0;
+                if (frame->done == frame->len) {
+                    xh_sort_hash_release(&ctx->sort, frame->base);
+                    xh_h2x_native_attr_return(aTHX_ ctx);
+                    break;
+                }
 
-        if (len > 1 && ctx->opts.canonical) {
-            sorted_hash = xh_sort_hash((HV *) value, len);
+                frame->i     = 0;
+                frame->state = XH_H2X_S_SORTED_NODES;
+                break;
 
-            for (i = 0; i < len; i++) {
-                done += xh_h2d_native_attr(ctx, rootNode, sorted_hash[i].key, sorted_hash[i].key_len, sorted_hash[i].value, XH_H2X_F_SIMPLE);
-            }
+            case XH_H2X_S_HASH:
+                if ((item_value = xh_hash_iter_next(aTHX_ &frame->hash, &item, &item_len))) {
+                    (void) xh_h2d_push_frame(ctx, frame->node, item, item_len, item_value, XH_H2X_F_SIMPLE);
+                    break;
+                }
 
-            if (done != len) {
-                for (i = 0; i < len; i++) {
-                    (void) xh_h2d_native_attr(ctx, rootNode, sorted_hash[i].key, sorted_hash[i].key_len, sorted_hash[i].value, XH_H2X_F_COMPLEX);
+                if (frame->done == frame->len) {
+                    xh_h2x_native_attr_return(aTHX_ ctx);
+                    break;
                 }
-            }
 
-            free(sorted_hash);
-        }
-        else {
-            hv_iterinit((HV *) value);
-            while ((item_value = hv_iternextsv((HV *) value, &item, &item_len))) {
-                done += xh_h2d_native_attr(ctx, rootNode, item, item_len,item_value, XH_H2X_F_SIMPLE);
-            }
-
-            if (done != len) {
-                hv_iterinit((HV *) value);
-                while ((item_value = hv_iternextsv((HV *) value, &item, &item_len))) {
-                    (void) xh_h2d_native_attr(ctx, rootNode, item, item_len,item_value, XH_H2X_F_COMPLEX);
-                }
-            }
-        }
+                xh_hash_iter_init(aTHX_ &frame->hash, (HV *) frame->value);
+                frame->state = XH_H2X_S_HASH_NODES;
+                break;
 
-        nattrs++;
-    }
-    else if (type & XH_H2X_T_ARRAY) {
-        if (!(flag & XH_H2X_F_COMPLEX)) goto FINISH;
+            /* nodes of the hash */
+            case XH_H2X_S_SORTED_NODES:
+                if (frame->i < frame->len) {
+                    sorted_hash = xh_sort_hash_item(&ctx->sort, frame->base + frame->i++);
+                    (void) xh_h2d_push_frame(ctx, frame->node, sorted_hash->key, sorted_hash->key_len, sorted_hash->value, XH_H2X_F_COMPLEX);
+                    break;
+                }
 
-        len = av_len((AV *) value) + 1;
-        for (i = 0; i < len; i++) {
-            (void) xh_h2d_native_attr(ctx, rootNode, key, key_len, *av_fetch((AV *) value, i, 0), XH_H2X_F_SIMPLE | XH_H2X_F_COMPLEX);
-        }
+                xh_sort_hash_release(&ctx->sort, frame->base);
+                xh_h2x_native_attr_return(aTHX_ ctx);
+                break;
 
-        nattrs++;
-    }
-    else {
-        if (flag & XH_H2X_F_SIMPLE && flag & XH_H2X_F_COMPLEX) {
-            (void) xh_dom_new_node(ctx, rootNode, key, key_len, NULL, type & XH_H2X_T_RAW);
-        }
-        else if (flag & XH_H2X_F_SIMPLE && !(flag & XH_H2X_F_CONTENT)) {
-            xh_dom_new_attribute(ctx, rootNode, key, key_len, NULL);
-            nattrs++;
-        }
-    }
+            case XH_H2X_S_HASH_NODES:
+                if ((item_value = xh_hash_iter_next(aTHX_ &frame->hash, &item, &item_len))) {
+                    (void) xh_h2d_push_frame(ctx, frame->node, item, item_len, item_value, XH_H2X_F_COMPLEX);
+                    break;
+                }
 
-FINISH:
-    ctx->depth--;
+                xh_h2x_native_attr_return(aTHX_ ctx);
+                break;
+
+            case XH_H2X_S_ARRAY:
+                if (frame->i < frame->len) {
+                    item_value = xh_h2x_array_next(aTHX_ frame);
+                    (void) xh_h2d_push_frame(ctx, frame->node, frame->key, frame->key_len, item_value, XH_H2X_F_SIMPLE | XH_H2X_F_COMPLEX);
+                    break;
+                }
 
-    return nattrs;
+                xh_h2x_native_attr_return(aTHX_ ctx);
+                break;
+        }
+    }
 }
 #endif
@@ -0,0 +1,20 @@
+#include "xh_config.h"
+#include "xh_core.h"
+
+/* the held entry is followed only if it is still in its bucket */
+HE *
+xh_hash_iter_resume(xh_hash_iter_t *iter)
+{
+    HE *he;
+
+    iter->mode = XH_HASH_WALK;
+
+    if (HvARRAY(iter->hv) == NULL || iter->bucket - 1 > HvMAX(iter->hv))
+        return NULL;
+
+    for (he = HvARRAY(iter->hv)[iter->bucket - 1]; he != NULL; he = HeNEXT(he)) {
+        if (he == iter->he) return HeNEXT(he);
+    }
+
+    return NULL;
+}
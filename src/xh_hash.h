@@ -0,0 +1,72 @@
+#ifndef _XH_HASH_H_
+#define _XH_HASH_H_
+
+#include "xh_config.h"
+#include "xh_core.h"
+
+/*
+ * Position in the buckets of a hash. Plain hashes are walked directly,
+ * so the "each" iterator of the caller is kept. Tied and other magical
+ * hashes go through hv_iternextsv. The current entry is held while a
+ * callback may delete it, see xh_h2x_hold_hashes().
+ */
+#define XH_HASH_WALK                    0
+#define XH_HASH_ITERNEXT                1
+#define XH_HASH_HELD                    2
+
+typedef struct {
+    HV               *hv;
+    HE               *he;
+    STRLEN            bucket;
+    xh_uint_t         mode;
+} xh_hash_iter_t;
+
+HE *xh_hash_iter_resume(xh_hash_iter_t *iter);
+
+XH_INLINE void
+xh_hash_iter_init(pTHX_ xh_hash_iter_t *iter, HV *hv)
+{
+    iter->hv      = hv;
+    iter->he      = NULL;
+    iter->bucket  = 0;
+    iter->mode    = SvRMAGICAL(hv) ? XH_HASH_ITERNEXT : XH_HASH_WALK;
+
+    if (iter->mode == XH_HASH_ITERNEXT) {
+        hv_iterinit(hv);
+    }
+}
+
+/* returns NULL after the last entry */
+XH_INLINE SV *
+xh_hash_iter_next(pTHX_ xh_hash_iter_t *iter, char **key, I32 *key_len)
+{
+    HE *he;
+
+    if (expect_false(iter->mode != XH_HASH_WALK)) {
+        if (iter->mode == XH_HASH_ITERNEXT)
+            return hv_iternextsv(iter->hv, key, key_len);
+        he = xh_hash_iter_resume(iter);
+    }
+    else {
+        he = iter->he == NULL ? NULL : HeNEXT(iter->he);
+    }
+
+    for (;;) {
+        while (he == NULL) {
+            if (HvARRAY(iter->hv) == NULL || iter->bucket > HvMAX(iter->hv))
+                return NULL;
+            he = HvARRAY(iter->hv)[iter->bucket++];
+        }
+        /* deleted keys of restricted hashes */
+        if (expect_true(HeVAL(he) != &PL_sv_placeholder)) break;
+        he = HeNEXT(he);
+    }
+
+    iter->he = he;
+    *key     = HeKEY(he);
+    *key_len = HeKLEN(he);
+
+    return HeVAL(he);
+}
+
+#endif /* _XH_HASH_H_ */
@@ -2,7 +2,7 @@
 #include "xh_core.h"
 
 void
-xh_param_assign_string(char param[], SV *value)
+xh_param_assign_string(pTHX_ char param[], SV *value)
 {
     char *str;
 
@@ -16,7 +16,37 @@ xh_param_assign_string(char param[], SV *value)
 }
 
 void
-xh_param_assign_int(char *name, xh_int_t *param, SV *value)
+xh_param_set_str(pTHX_ xh_param_str_t *param, const char *str, STRLEN len)
+{
+    if (len == 0) {
+        param->sv  = NULL;
+        param->str = "";
+        param->len = 0;
+        return;
+    }
+
+    param->sv  = sv_2mortal(newSVpvn(str, len));
+    param->str = SvPVX(param->sv);
+    param->len = len;
+}
+
+void
+xh_param_assign_str(pTHX_ xh_param_str_t *param, SV *value)
+{
+    char   *str;
+    STRLEN  len;
+
+    if ( SvOK(value) ) {
+        str = SvPV(value, len);
+        xh_param_set_str(aTHX_ param, str, len);
+    }
+    else {
+        xh_param_set_str(aTHX_ param, NULL, 0);
+    }
+}
+
+void
+xh_param_assign_int(pTHX_ char *name, xh_int_t *param, SV *value)
 {
     if ( !SvOK(value) ) {
         croak("Parameter '%s' is undefined", name);
@@ -25,7 +55,7 @@ xh_param_assign_int(char *name, xh_int_t *param, SV *value)
 }
 
 xh_bool_t
-xh_param_assign_bool(SV *value)
+xh_param_assign_bool(pTHX_ SV *value)
 {
     if ( SvTRUE(value) ) {
         return TRUE;
@@ -6,6 +6,16 @@
 
 #define XH_PARAM_LEN 32
 
+/*
+ * A string parameter of any length. The characters are a private copy in
+ * "sv", a mortal one until the options are held by an object.
+ */
+typedef struct {
+    SV         *sv;
+    const char *str;
+    STRLEN      len;
+} xh_param_str_t;
+
 #define XH_PARAM_READ_INIT                              \
     SV   *sv;                                           \
     char *str;
@@ -22,6 +32,13 @@
     else {                                              \
         strncpy(var, def_value, XH_PARAM_LEN);          \
     }
+#define XH_PARAM_READ_STR(var, name, def_value)         \
+    if ( (sv = get_sv(name, 0)) != NULL ) {             \
+        xh_param_assign_str(aTHX_ &(var), sv);          \
+    }                                                   \
+    else {                                              \
+        xh_param_set_str(aTHX_ &(var), def_value, sizeof(def_value) - 1); \
+    }
 #define XH_PARAM_READ_BOOL(var, name, def_value)        \
     if ( (sv = get_sv(name, 0)) != NULL ) {             \
         if ( SvTRUE(sv) ) {                             \
@@ -44,7 +61,7 @@
 #define XH_PARAM_READ_REF(var, name, def_value)         \
     if ( (sv = get_sv(name, 0)) != NULL ) {             \
         if ( SvOK(sv) && SvROK(sv) ) {                  \
-            var = sv;                                   \
+            var = SvRV(sv);                             \
         }                                               \
         else {                                          \
             var = NULL;                                 \
@@ -54,8 +71,10 @@
         var = def_value;                                \
     }
 
-void xh_param_assign_string(char param[], SV *value);
-void xh_param_assign_int(char *name, xh_int_t *param, SV *value);
-xh_bool_t xh_param_assign_bool(SV *value);
+void xh_param_assign_string(pTHX_ char param[], SV *value);
+void xh_param_set_str(pTHX_ xh_param_str_t *param, const char *str, STRLEN len);
+void xh_param_assign_str(pTHX_ xh_param_str_t *param, SV *value);
+void xh_param_assign_int(pTHX_ char *name, xh_int_t *param, SV *value);
+xh_bool_t xh_param_assign_bool(pTHX_ SV *value);
 
 #endif /* _XH_PARAM_H_ */
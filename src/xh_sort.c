@@ -1,30 +1,153 @@
 #include "xh_config.h"
 #include "xh_core.h"
 
+/* the first 8 bytes of the key as a big-endian number, zero padded */
+XH_INLINE uint64_t
+xh_sort_prefix(const char *key, size_t len)
+{
+    uint64_t prefix = 0;
+#if defined(__GNUC__) && (BYTEORDER == 0x1234 || BYTEORDER == 0x12345678)
+    memcpy(&prefix, key, len < 8 ? len : 8);
+    return __builtin_bswap64(prefix);
+#else
+    size_t   i;
+
+    for (i = 0; i < 8; i++) {
+        prefix = (prefix << 8) | (i < len ? (u_char) key[i] : 0);
+    }
+    return prefix;
+#endif
+}
+
+/* byte order of the keys, embedded NULs included */
+XH_INLINE int
+xh_sort_hash_cmp_items(const xh_sort_hash_t *a, const xh_sort_hash_t *b)
+{
+    I32 len;
+    int result;
+
+    if (a->prefix != b->prefix)
+        return (a->prefix > b->prefix) - (a->prefix < b->prefix);
+
+    len = a->key_len < b->key_len ? a->key_len : b->key_len;
+    if (len > 8 && (result = memcmp(a->key + 8, b->key + 8, len - 8)) != 0)
+        return result;
+
+    return (a->key_len > b->key_len) - (a->key_len < b->key_len);
+}
+
 static int
 xh_sort_hash_cmp(const void *p1, const void *p2)
 {
-    return strcmp(((xh_sort_hash_t *) p1)->key, ((xh_sort_hash_t *) p2)->key);
+    return xh_sort_hash_cmp_items((const xh_sort_hash_t *) p1, (const xh_sort_hash_t *) p2);
+}
+
+static void
+xh_sort_hash_insertion(xh_sort_hash_t *items, size_t len)
+{
+    xh_sort_hash_t item;
+    size_t         i, j;
+
+    for (i = 1; i < len; i++) {
+        item = items[i];
+        for (j = i; j > 0 && xh_sort_hash_cmp_items(&item, &items[j - 1]) < 0; j--) {
+            items[j] = items[j - 1];
+        }
+        items[j] = item;
+    }
+}
+
+/* puts the items in the remembered order, FALSE and the walk order if they are not sorted then */
+static xh_bool_t
+xh_sort_hash_apply(xh_sort_hash_t *items, size_t len, const uint8_t *order)
+{
+    xh_sort_hash_t walk[XH_SORT_ORDER_KEYS];
+    size_t         i;
+
+    memcpy(walk, items, len * sizeof(xh_sort_hash_t));
+
+    items[0] = walk[order[0]];
+    for (i = 1; i < len; i++) {
+        items[i] = walk[order[i]];
+        if (xh_sort_hash_cmp_items(&items[i - 1], &items[i]) >= 0) {
+            /* freed keys may be reused by other ones, back to the walk order */
+            memcpy(items, walk, len * sizeof(xh_sort_hash_t));
+            return FALSE;
+        }
+    }
+
+    return TRUE;
 }
 
-xh_sort_hash_t *
-xh_sort_hash(HV *hash, size_t len)
+size_t
+xh_sort_hash(pTHX_ xh_sort_t *sort, HV *hash, size_t len)
 {
-    xh_sort_hash_t *sorted_hash;
-    size_t          i;
+    xh_sort_hash_t  *sorted_hash;
+    xh_sort_order_t *order;
+    xh_hash_iter_t   iter;
+    uint64_t         fingerprint;
+    size_t           i, base;
+
+    if (sort->scratch.elts == NULL) {
+        xh_stack_init(&sort->scratch, XH_SORT_SCRATCH_SIZE, sizeof(xh_sort_hash_t));
+    }
+
+    base = sort->scratch.top;
+
+    xh_stack_reserve(&sort->scratch, len);
+    sort->scratch.top += len;
+
+    sorted_hash = xh_sort_hash_item(sort, base);
+
+    xh_hash_iter_init(aTHX_ &iter, hash);
+
+    fingerprint = len;
+    for (i = 0; i < len; i++) {
+        sorted_hash[i].value  = xh_hash_iter_next(aTHX_ &iter, &sorted_hash[i].key, &sorted_hash[i].key_len);
+        sorted_hash[i].prefix = xh_sort_prefix(sorted_hash[i].key, sorted_hash[i].key_len);
+        sorted_hash[i].index  = i;
+        fingerprint = (fingerprint ^ (uintptr_t) sorted_hash[i].key) * UINT64_C(0x100000001b3);
+    }
 
-    sorted_hash = malloc(sizeof(xh_sort_hash_t) * len);
-    if (sorted_hash == NULL) {
-        croak("Memory allocation error");
+    if (len > XH_SORT_ORDER_KEYS) {
+        qsort(sorted_hash, len, sizeof(xh_sort_hash_t), xh_sort_hash_cmp);
+        return base;
     }
 
-    hv_iterinit(hash);
+    if (sort->orders == NULL) {
+        sort->orders = calloc(XH_SORT_ORDERS, sizeof(xh_sort_order_t));
+        if (sort->orders == NULL) {
+            croak("Memory allocation error");
+        }
+    }
+
+    order = &sort->orders[(fingerprint ^ (fingerprint >> 32)) & (XH_SORT_ORDERS - 1)];
+    if (order->fingerprint == fingerprint && order->len == len
+        && xh_sort_hash_apply(sorted_hash, len, order->order))
+        return base;
+
+    if (len > XH_SORT_INSERTION) {
+        qsort(sorted_hash, len, sizeof(xh_sort_hash_t), xh_sort_hash_cmp);
+    }
+    else {
+        xh_sort_hash_insertion(sorted_hash, len);
+    }
 
+    order->fingerprint = fingerprint;
+    order->len         = len;
     for (i = 0; i < len; i++) {
-        sorted_hash[i].value = hv_iternextsv(hash, &sorted_hash[i].key, &sorted_hash[i].key_len);
+        order->order[i] = (uint8_t) sorted_hash[i].index;
     }
 
-    qsort(sorted_hash, len, sizeof(xh_sort_hash_t), xh_sort_hash_cmp);
+    return base;
+}
 
-    return sorted_hash;
+void
+xh_sort_destroy(xh_sort_t *sort)
+{
+    if (sort->scratch.elts != NULL) {
+        xh_stack_destroy(&sort->scratch);
+    }
+    free(sort->orders);
+    sort->orders = NULL;
 }
@@ -4,12 +4,55 @@
 #include "xh_config.h"
 #include "xh_core.h"
 
+#define XH_SORT_SCRATCH_SIZE 64
+/* hashes up to this size remember their sorted order */
+#define XH_SORT_ORDER_KEYS   32
+#define XH_SORT_ORDERS       64
+/* shorter runs are sorted by insertion instead of qsort */
+#define XH_SORT_INSERTION    16
+
 typedef struct {
+    uint64_t          prefix;
     char             *key;
     I32               key_len;
+    I32               index;
     void             *value;
 } xh_sort_hash_t;
 
-xh_sort_hash_t *xh_sort_hash(HV *hash, size_t len);
+/*
+ * Sorted order of a hash walk. Records of an array usually have the same
+ * keys in the same walk order, the order is found by the fingerprint of
+ * the addresses of their shared keys and is checked before use.
+ */
+typedef struct {
+    uint64_t          fingerprint;
+    size_t            len;
+    uint8_t           order[XH_SORT_ORDER_KEYS];
+} xh_sort_order_t;
+
+typedef struct {
+    xh_stack_t        scratch;
+    xh_sort_order_t  *orders;
+    /* items below are copies, see xh_h2x_hold_hashes() */
+    size_t            held;
+} xh_sort_t;
+
+/*
+ * Sorted hashes are kept in the scratch stack, nested hashes are pushed on
+ * top of their parents. The stack may be reallocated by a nested call, so
+ * items are addressed by index rather than by pointer.
+ */
+#define xh_sort_hash_item(sort, i)                                     \
+    ((xh_sort_hash_t *) (sort)->scratch.elts + (i))
+
+XH_INLINE void
+xh_sort_hash_release(xh_sort_t *sort, size_t base)
+{
+    sort->scratch.top = base;
+    if (sort->held > base) sort->held = base;
+}
+
+size_t xh_sort_hash(pTHX_ xh_sort_t *sort, HV *hash, size_t len);
+void xh_sort_destroy(xh_sort_t *sort);
 
 #endif /* _XH_SORT_H_ */
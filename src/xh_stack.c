@@ -16,4 +16,5 @@ void
 xh_stack_destroy(xh_stack_t *st)
 {
     free(st->elts);
+    st->elts = NULL;
 }
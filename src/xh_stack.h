@@ -23,6 +23,19 @@ xh_stack_push(xh_stack_t *st)
     return (void *) ((u_char *) st->elts + st->top++ * st->size);
 }
 
+XH_INLINE void
+xh_stack_reserve(xh_stack_t *st, size_t n)
+{
+    if (st->top + n > st->nelts) {
+        while (st->top + n > st->nelts) {
+            st->nelts *= 2;
+        }
+        if ((st->elts = realloc(st->elts, st->nelts * st->size)) == NULL) {
+            croak("Memory allocation error");
+        }
+    }
+}
+
 XH_INLINE void *
 xh_stack_pop(xh_stack_t *st)
 {
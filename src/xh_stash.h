@@ -12,6 +12,6 @@ xh_stash_push(xh_stack_t *stash, SV *value)
     *stash_item = value;
 }
 
-void xh_stash_clean(xh_stack_t *stash);
+void xh_stash_clean(pTHX_ xh_stack_t *stash);
 
 #endif /* _XH_STASH_H_ */
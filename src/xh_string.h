@@ -31,6 +31,17 @@
         && ((uint32_t *) p)[1] == ((c7 << 24) | (c6 << 16) | (c5 << 8) | c4)\
         && p[8] == c8
 
+#define xh_str_equal11(p, c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10)\
+    *(uint32_t *) p == ((c3 << 24) | (c2 << 16) | (c1 << 8) | c0)      \
+        && ((uint32_t *) p)[1] == ((c7 << 24) | (c6 << 16) | (c5 << 8) | c4)\
+        && p[8] == c8 && p[9] == c9 && p[10] == c10
+
+#define xh_str_equal14(p, c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11, c12, c13)\
+    *(uint32_t *) p == ((c3 << 24) | (c2 << 16) | (c1 << 8) | c0)      \
+        && ((uint32_t *) p)[1] == ((c7 << 24) | (c6 << 16) | (c5 << 8) | c4)\
+        && ((uint32_t *) p)[2] == ((c11 << 24) | (c10 << 16) | (c9 << 8) | c8)\
+        && p[12] == c12 && p[13] == c13
+
 XH_INLINE char *
 xh_str_trim(char *s, size_t *len)
 {
@@ -0,0 +1,139 @@
+#include "xh_config.h"
+#include "xh_core.h"
+
+#ifdef XH_HAVE_PTHREAD
+
+static void *
+xh_worker_run(void *arg)
+{
+    xh_worker_t *worker = (xh_worker_t *) arg;
+    int          err;
+
+    pthread_mutex_lock(&worker->mutex);
+
+    for (;;) {
+        while (!worker->pending && !worker->stop) {
+            pthread_cond_wait(&worker->ready, &worker->mutex);
+        }
+        if (!worker->pending) break;
+
+        pthread_mutex_unlock(&worker->mutex);
+
+        /* after an error the rest of the output is dropped */
+        err = worker->error == 0 ? xh_writer_drain(worker->writer, &worker->buf, worker->finish) : 0;
+
+        pthread_mutex_lock(&worker->mutex);
+
+        if (err != 0) worker->error = err;
+        worker->pending = FALSE;
+        pthread_cond_signal(&worker->done);
+    }
+
+    pthread_mutex_unlock(&worker->mutex);
+
+    return NULL;
+}
+
+void
+xh_worker_start(pTHX_ xh_worker_t *worker, struct _xh_writer_t *writer, size_t size)
+{
+    worker->writer  = writer;
+    worker->pending = FALSE;
+    worker->finish  = FALSE;
+    worker->stop    = FALSE;
+    worker->error   = 0;
+
+    if (worker->buf.scalar == NULL) {
+        xh_buffer_init(aTHX_ &worker->buf, size);
+    }
+    else {
+        worker->buf.cur = worker->buf.start;
+    }
+
+    pthread_mutex_init(&worker->mutex, NULL);
+    pthread_cond_init(&worker->ready, NULL);
+    pthread_cond_init(&worker->done, NULL);
+
+    if (pthread_create(&worker->thread, NULL, xh_worker_run, worker) != 0) {
+        pthread_cond_destroy(&worker->done);
+        pthread_cond_destroy(&worker->ready);
+        pthread_mutex_destroy(&worker->mutex);
+        croak("Can't create flush thread");
+    }
+
+    worker->running = TRUE;
+}
+
+void
+xh_worker_wait(xh_worker_t *worker)
+{
+    int err;
+
+    pthread_mutex_lock(&worker->mutex);
+    while (worker->pending) {
+        pthread_cond_wait(&worker->done, &worker->mutex);
+    }
+    err           = worker->error;
+    worker->error = 0;
+    pthread_mutex_unlock(&worker->mutex);
+
+    xh_writer_raise(err);
+}
+
+/* hands the filled buffer over and takes the drained one back */
+void
+xh_worker_submit(pTHX_ xh_worker_t *worker, xh_buffer_t *buf, xh_bool_t finish)
+{
+    xh_buffer_t tmp;
+    size_t      len = buf->cur - buf->start;
+
+    xh_worker_wait(worker);
+
+    /* the end of the compressed stream is written even without data */
+    if (len == 0 && !finish) return;
+
+#ifdef XH_HAVE_ENCODER
+    if (worker->writer->encoder != NULL) {
+        /* 1 char -> 4 chars, the worker can't grow the buffer */
+        xh_buffer_resize(aTHX_ &worker->writer->enc_buf, len * 4 + 1);
+    }
+#endif
+
+    tmp         = worker->buf;
+    worker->buf = *buf;
+    *buf        = tmp;
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->finish  = finish;
+    worker->pending = TRUE;
+    pthread_cond_signal(&worker->ready);
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+void
+xh_worker_stop(xh_worker_t *worker)
+{
+    if (!worker->running) return;
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->stop = TRUE;
+    pthread_cond_signal(&worker->ready);
+    pthread_mutex_unlock(&worker->mutex);
+
+    pthread_join(worker->thread, NULL);
+
+    pthread_cond_destroy(&worker->done);
+    pthread_cond_destroy(&worker->ready);
+    pthread_mutex_destroy(&worker->mutex);
+
+    worker->running = FALSE;
+}
+
+void
+xh_worker_destroy(pTHX_ xh_worker_t *worker)
+{
+    xh_worker_stop(worker);
+    xh_buffer_destroy(aTHX_ &worker->buf);
+}
+
+#endif /* XH_HAVE_PTHREAD */
@@ -0,0 +1,41 @@
+#ifndef _XH_WORKER_H_
+#define _XH_WORKER_H_
+
+#include "xh_config.h"
+#include "xh_core.h"
+
+#ifdef XH_HAVE_PTHREAD
+
+#include <pthread.h>
+
+struct _xh_writer_t;
+
+/*
+ * Flush thread: drains filled buffers of the writer while the main
+ * thread fills the next one. Only plain C data crosses the threads,
+ * the buffers are allocated and resized by the main thread.
+ */
+typedef struct _xh_worker_t xh_worker_t;
+struct _xh_worker_t {
+    pthread_t              thread;
+    pthread_mutex_t        mutex;
+    pthread_cond_t         ready;
+    pthread_cond_t         done;
+    xh_bool_t              running;
+    xh_bool_t              pending;
+    xh_bool_t              finish;
+    xh_bool_t              stop;
+    int                    error;
+    struct _xh_writer_t   *writer;
+    xh_buffer_t            buf;
+};
+
+void xh_worker_start(pTHX_ xh_worker_t *worker, struct _xh_writer_t *writer, size_t size);
+void xh_worker_submit(pTHX_ xh_worker_t *worker, xh_buffer_t *buf, xh_bool_t finish);
+void xh_worker_wait(xh_worker_t *worker);
+void xh_worker_stop(xh_worker_t *worker);
+void xh_worker_destroy(pTHX_ xh_worker_t *worker);
+
+#endif /* XH_HAVE_PTHREAD */
+
+#endif /* _XH_WORKER_H_ */
@@ -1,23 +1,160 @@
 #include "xh_config.h"
 #include "xh_core.h"
+#include <fcntl.h>
+#ifdef HAS_WRITEV
+#include <sys/uio.h>
+#endif
+#ifdef USE_PERLIO
+#include "perliol.h"
+#endif
+
+/* returns 0 or errno, doesn't use the Perl API */
+int
+xh_writer_write_all(int fd, const char *s1, size_t l1, const char *s2, size_t l2)
+{
+    ssize_t      n;
+#ifdef HAS_WRITEV
+    struct iovec iov[2];
+#endif
+
+    while (l1 + l2 > 0) {
+#ifdef HAS_WRITEV
+        if (l1 > 0 && l2 > 0) {
+            iov[0].iov_base = (void *) s1;
+            iov[0].iov_len  = l1;
+            iov[1].iov_base = (void *) s2;
+            iov[1].iov_len  = l2;
+            n = writev(fd, iov, 2);
+        }
+        else
+#endif
+        if (l1 > 0) {
+            n = write(fd, s1, l1);
+        }
+        else {
+            n = write(fd, s2, l2);
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+
+        if ((size_t) n >= l1) {
+            n  -= l1;
+            s1 += l1;
+            l1  = 0;
+            s2 += n;
+            l2 -= n;
+        }
+        else {
+            s1 += n;
+            l1 -= n;
+        }
+    }
+
+    return 0;
+}
+
+void
+xh_writer_write_fd(int fd, const char *s1, size_t l1, const char *s2, size_t l2)
+{
+    int err = xh_writer_write_all(fd, s1, l1, s2, l2);
+
+    if (err != 0) {
+        croak("Write error: %s", strerror(err));
+    }
+}
 
 void
-xh_writer_resize_buffer(xh_writer_t *writer, size_t inc)
+xh_writer_write_direct(xh_writer_t *writer, const char *content, size_t content_len)
 {
-    (void) xh_writer_flush(writer);
+    xh_buffer_t *buf = &writer->main_buf;
+
+#ifdef XH_HAVE_PTHREAD
+    if (writer->worker.running) {
+        xh_worker_wait(&writer->worker);
+    }
+#endif
+
+    xh_checksum_update(&writer->checksum, buf->start, buf->cur - buf->start);
+    xh_checksum_update(&writer->checksum, content, content_len);
 
-    xh_buffer_resize(&writer->main_buf, inc);
+    xh_writer_write_fd(writer->fd, buf->start, buf->cur - buf->start, content, content_len);
+
+    buf->cur = buf->start;
+}
+
+/* a huge string result is backed by huge pages */
+static void
+xh_writer_grow_buffer(pTHX_ xh_writer_t *writer, xh_buffer_t *buf, size_t inc)
+{
+    xh_buffer_resize(aTHX_ buf, inc);
+
+    if (writer->huge_size > 0 && (size_t) (buf->end - buf->start) >= writer->huge_size) {
+        xh_buffer_advise_huge(buf);
+    }
+}
+
+void
+xh_writer_resize_buffer(pTHX_ xh_writer_t *writer, size_t inc)
+{
+    (void) xh_writer_flush(aTHX_ writer);
+
+    xh_writer_grow_buffer(aTHX_ writer, &writer->main_buf, inc);
+}
+
+/* the filled buffer becomes a segment of the result, nothing is copied */
+static void
+xh_writer_write_to_segments(pTHX_ xh_writer_t *writer, xh_buffer_t *buf)
+{
+    size_t size, len = buf->cur - buf->start;
+
+    if (len == 0) return;
+
+    *buf->cur = '\0';
+    SvCUR_set(buf->scalar, len);
+    av_push(writer->segments, buf->scalar);
+
+    size = (buf->end - buf->start) * 2;
+    if (size > XH_WRITER_SEGMENT_SIZE) {
+        size = XH_WRITER_SEGMENT_SIZE;
+    }
+
+    xh_buffer_init(aTHX_ buf, size);
 }
 
 SV *
-xh_writer_flush_buffer(xh_writer_t *writer, xh_buffer_t *buf)
+xh_writer_flush_buffer(pTHX_ xh_writer_t *writer, xh_buffer_t *buf)
 {
+    /* the string result is counted once it is complete */
+    if (xh_writer_is_stream(writer)) {
+        xh_checksum_update(&writer->checksum, buf->start, buf->cur - buf->start);
+    }
+
     if (writer->perl_obj != NULL) {
-        xh_writer_write_to_perl_obj(buf, writer->perl_obj);
+        xh_writer_write_to_perl_obj(aTHX_ buf, writer->perl_obj);
         return &PL_sv_undef;
     }
     else if (writer->perl_io != NULL) {
-        xh_writer_write_to_perl_io(buf, writer->perl_io);
+        xh_writer_write_to_perl_io(aTHX_ buf, writer->perl_io);
+        return &PL_sv_undef;
+    }
+    else if (writer->fd != -1) {
+        xh_writer_write_to_fd(buf, writer->fd);
+        return &PL_sv_undef;
+    }
+    else if (writer->segments != NULL) {
+        xh_writer_write_to_segments(aTHX_ writer, buf);
+        return &PL_sv_undef;
+    }
+    else if (writer->pull != NULL) {
+        sv_catpvn(writer->pull, buf->start, buf->cur - buf->start);
+        buf->cur = buf->start;
+        return &PL_sv_undef;
+    }
+    else if (writer->null_sink) {
+        buf->cur = buf->start;
         return &PL_sv_undef;
     }
 
@@ -26,7 +163,7 @@ xh_writer_flush_buffer(xh_writer_t *writer, xh_buffer_t *buf)
 
 #ifdef XH_HAVE_ENCODER
 void
-xh_writer_encode_buffer(xh_writer_t *writer, xh_buffer_t *main_buf, xh_buffer_t *enc_buf)
+xh_writer_encode_buffer(pTHX_ xh_writer_t *writer, xh_buffer_t *main_buf, xh_buffer_t *enc_buf)
 {
     size_t len;
 
@@ -34,86 +171,326 @@ xh_writer_encode_buffer(xh_writer_t *writer, xh_buffer_t *main_buf, xh_buffer_t
     len = (main_buf->cur - main_buf->start) * 4 + 1;
 
     if (len > (enc_buf->end - enc_buf->cur)) {
-        xh_writer_flush_buffer(writer, enc_buf);
+        xh_writer_flush_buffer(aTHX_ writer, enc_buf);
 
-        xh_buffer_resize(enc_buf, len);
+        xh_writer_grow_buffer(aTHX_ writer, enc_buf, len);
     }
 
     xh_encoder_encode(writer->encoder, main_buf, enc_buf);
+
+    main_buf->cur = main_buf->start;
 }
 #endif
 
-SV *
-xh_writer_flush(xh_writer_t *writer)
+#ifdef XH_HAVE_ZLIB
+/* full output of the compressor goes to the sink or the buffer grows */
+static int
+xh_writer_drain_compressed(void *arg, xh_buffer_t *out)
 {
-    xh_buffer_t *buf;
+    xh_writer_t *writer = (xh_writer_t *) arg;
+    dTHXa(writer->perl);
+
+    if (xh_writer_is_stream(writer)) {
+        (void) xh_writer_flush_buffer(aTHX_ writer, out);
+    }
+    else {
+        xh_writer_grow_buffer(aTHX_ writer, out, out->end - out->start);
+    }
+
+    return 0;
+}
+
+static int
+xh_writer_drain_fd(void *arg, xh_buffer_t *out)
+{
+    xh_writer_t *writer = (xh_writer_t *) arg;
+    int          err;
+
+    xh_checksum_update(&writer->checksum, out->start, out->cur - out->start);
+    err = xh_writer_write_all(writer->fd, out->start, out->cur - out->start, NULL, 0);
+    out->cur = out->start;
+
+    return err;
+}
+#endif
+
+/*
+ * Encodes, compresses and writes the buffer to the fd.
+ * Doesn't use the Perl API, so the flush thread calls it;
+ * the encoding buffer must fit the encoded data.
+ */
+int
+xh_writer_drain(xh_writer_t *writer, xh_buffer_t *buf, xh_bool_t finish)
+{
+    int err;
 
 #ifdef XH_HAVE_ENCODER
     if (writer->encoder != NULL) {
-        xh_writer_encode_buffer(writer, &writer->main_buf, &writer->enc_buf);
-        buf = &writer->enc_buf;
+        if (!xh_encoder_convert(writer->encoder, buf, &writer->enc_buf)) {
+            buf->cur = buf->start;
+            return XH_WRITER_CONVERT_ERROR;
+        }
+        buf->cur = buf->start;
+        buf      = &writer->enc_buf;
     }
-    else {
-        buf = &writer->main_buf;
+#endif
+
+#ifdef XH_HAVE_ZLIB
+    if (writer->compressor != NULL) {
+        err = xh_compressor_compress(writer->compressor, buf, &writer->comp_buf, finish,
+                                     xh_writer_drain_fd, writer);
+        if (err != 0) {
+            buf->cur = buf->start;
+            return err < 0 ? XH_WRITER_COMPRESS_ERROR : err;
+        }
+        buf = &writer->comp_buf;
     }
 #else
-    buf = &writer->main_buf;
+    (void) finish;
 #endif
 
-    return xh_writer_flush_buffer(writer, buf);
+    xh_checksum_update(&writer->checksum, buf->start, buf->cur - buf->start);
+    err = xh_writer_write_all(writer->fd, buf->start, buf->cur - buf->start, NULL, 0);
+    buf->cur = buf->start;
+
+    return err;
 }
 
 void
-xh_writer_destroy(xh_writer_t *writer)
+xh_writer_raise(int err)
 {
-    if (writer != NULL) {
-        if (writer->perl_obj != NULL || writer->perl_io != NULL) {
-            SvREFCNT_dec(writer->main_buf.scalar);
-#ifdef XH_HAVE_ENCODER
-            SvREFCNT_dec(writer->enc_buf.scalar);
-        }
-        else if (writer->encoder != NULL) {
-            SvREFCNT_dec(writer->main_buf.scalar);
+    switch (err) {
+        case 0:
+            return;
+        case XH_WRITER_CONVERT_ERROR:
+            croak("Convert error");
+        case XH_WRITER_COMPRESS_ERROR:
+            croak("Compression error");
+        default:
+            croak("Write error: %s", strerror(err));
+    }
+}
+
+static SV *
+xh_writer_flush_stage(pTHX_ xh_writer_t *writer, xh_bool_t finish)
+{
+    xh_buffer_t *buf = &writer->main_buf;
+
+#ifdef XH_HAVE_PTHREAD
+    if (writer->worker.running) {
+        xh_worker_submit(aTHX_ &writer->worker, buf, finish);
+        return &PL_sv_undef;
+    }
 #endif
-        }
 
 #ifdef XH_HAVE_ENCODER
-        xh_encoder_destroy(writer->encoder);
+    if (writer->encoder != NULL) {
+        xh_writer_encode_buffer(aTHX_ writer, buf, &writer->enc_buf);
+        buf = &writer->enc_buf;
+    }
 #endif
-        free(writer);
+
+#ifdef XH_HAVE_ZLIB
+    if (writer->compressor != NULL) {
+        if (xh_compressor_compress(writer->compressor, buf, &writer->comp_buf, finish,
+                                   xh_writer_drain_compressed, writer) != 0) {
+            croak("Compression error");
+        }
+        buf = &writer->comp_buf;
     }
+#else
+    (void) finish;
+#endif
+
+    return xh_writer_flush_buffer(aTHX_ writer, buf);
 }
 
-xh_writer_t *
-xh_writer_create(char *encoding, void *output, size_t size, xh_uint_t indent, xh_bool_t trim)
+SV *
+xh_writer_flush(pTHX_ xh_writer_t *writer)
+{
+    return xh_writer_flush_stage(aTHX_ writer, FALSE);
+}
+
+static size_t
+xh_writer_buffer_size(xh_writer_t *writer)
 {
-    xh_writer_t *writer;
+    size_t size;
 
-    writer = malloc(sizeof(xh_writer_t));
-    if (writer == NULL) {
-        croak("Memory allocation error");
+    if (writer->avg_size == 0 || xh_writer_is_stream(writer)) {
+        return writer->size;
     }
-    memset(writer, 0, sizeof(xh_writer_t));
 
-    writer->indent = indent;
-    writer->trim   = trim;
+    /* string result: fit the recent outputs without growing */
+    size = writer->avg_size + writer->avg_size / 4;
 
-    xh_buffer_init(&writer->main_buf, size);
+    return size < XH_WRITER_MIN_SIZE ? XH_WRITER_MIN_SIZE : size;
+}
 
-    if (strcasecmp(encoding, "UTF-8") != 0) {
+static void
+xh_writer_shrink_buffer(pTHX_ xh_buffer_t *buf, size_t size)
+{
+    if (buf->scalar != NULL && (size_t) (buf->end - buf->start) > size * 4) {
+        xh_buffer_destroy(aTHX_ buf);
+    }
+}
+
+SV *
+xh_writer_finish(pTHX_ xh_writer_t *writer, xh_bool_t keep)
+{
+    xh_buffer_t *buf;
+    SV          *result;
+    size_t       len;
+
+    result = xh_writer_flush_stage(aTHX_ writer, TRUE);
+
+    if (xh_writer_is_stream(writer)) {
+#ifdef XH_HAVE_PTHREAD
+        if (writer->worker.running) {
+            xh_worker_wait(&writer->worker);
+        }
+#endif
+        if (writer->segments != NULL) {
+#ifdef SvPV_shrink_to_cur
+            /* the last segment is usually not full */
+            len = av_len(writer->segments) + 1;
+            if (len > 0) {
+                SvPV_shrink_to_cur(*av_fetch(writer->segments, len - 1, 0));
+            }
+#endif
+            result = newRV_noinc((SV *) writer->segments);
+            writer->segments = NULL;
+        }
+        xh_writer_close(aTHX_ writer);
+
+        if (keep) {
+            xh_writer_shrink_buffer(aTHX_ &writer->main_buf, writer->size);
+#ifdef XH_HAVE_PTHREAD
+            xh_writer_shrink_buffer(aTHX_ &writer->worker.buf, writer->size);
+#endif
+#ifdef XH_HAVE_ZLIB
+            xh_writer_shrink_buffer(aTHX_ &writer->comp_buf, writer->size);
+#endif
 #ifdef XH_HAVE_ENCODER
-        writer->encoder = xh_encoder_create(encoding);
-        if (writer->encoder == NULL) {
-            croak("Can't create encoder for '%s'", encoding);
+            xh_writer_shrink_buffer(aTHX_ &writer->enc_buf, writer->size * 4);
+#endif
         }
+        else {
+            xh_writer_destroy(aTHX_ writer);
+        }
+        return result;
+    }
 
-        xh_buffer_init(&writer->enc_buf, size * 4);
-#else
-        croak("Can't create encoder for '%s'", encoding);
+    buf = &writer->main_buf;
+#ifdef XH_HAVE_ENCODER
+    if (writer->encoder != NULL) buf = &writer->enc_buf;
+#endif
+#ifdef XH_HAVE_ZLIB
+    if (writer->compressor != NULL) buf = &writer->comp_buf;
+#endif
+
+    len = buf->cur - buf->start;
+    xh_checksum_update(&writer->checksum, buf->start, len);
+    writer->avg_size = writer->avg_size == 0 ? len : (writer->avg_size * 3 + len) / 4;
+
+    if (keep && len <= XH_WRITER_COPY_SIZE) {
+        /* the buffer stays warm for the next call */
+        result   = newSVpvn(buf->start, len);
+        buf->cur = buf->start;
+    }
+    else {
+        /* hand the buffer over to the caller */
+        memset(buf, 0, sizeof(xh_buffer_t));
+    }
+
+    if (keep) {
+        xh_writer_shrink_buffer(aTHX_ &writer->main_buf, xh_writer_buffer_size(writer));
+#ifdef XH_HAVE_ENCODER
+        xh_writer_shrink_buffer(aTHX_ &writer->enc_buf, xh_writer_buffer_size(writer) * 4);
 #endif
+#ifdef XH_HAVE_ZLIB
+        xh_writer_shrink_buffer(aTHX_ &writer->comp_buf, xh_writer_buffer_size(writer));
+#endif
+    }
+    else {
+        xh_writer_destroy(aTHX_ writer);
     }
 
-    if (output != NULL) {
+    return result;
+}
+
+void
+xh_writer_destroy(pTHX_ xh_writer_t *writer)
+{
+    xh_writer_close(aTHX_ writer);
+    xh_buffer_destroy(aTHX_ &writer->main_buf);
+#ifdef XH_HAVE_PTHREAD
+    xh_worker_destroy(aTHX_ &writer->worker);
+#endif
+#ifdef XH_HAVE_ZLIB
+    xh_buffer_destroy(aTHX_ &writer->comp_buf);
+    xh_compressor_destroy(writer->compressor);
+    writer->compressor = NULL;
+#endif
+#ifdef XH_HAVE_ENCODER
+    xh_buffer_destroy(aTHX_ &writer->enc_buf);
+    xh_encoder_destroy(writer->encoder);
+    writer->encoder = NULL;
+#endif
+}
+
+/* handle without translating layers, its fd can be written directly */
+static xh_bool_t
+xh_writer_is_raw_perl_io(pTHX_ PerlIO *perl_io)
+{
+#ifdef USE_PERLIO
+    PerlIO     *l;
+    const char *name;
+
+    if (!PerlIO_fast_gets(perl_io) || PerlIO_isutf8(perl_io) || PerlIO_fileno(perl_io) < 0)
+        return FALSE;
+
+    for (l = perl_io; PerlIOValid(l); l = PerlIONext(l)) {
+        if (PerlIOBase(l)->flags & PERLIO_F_CRLF) return FALSE;
+
+        name = PerlIOBase(l)->tab->name;
+        if (strcmp(name, "perlio") != 0 && strcmp(name, "unix") != 0) return FALSE;
+    }
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+void
+xh_writer_open(pTHX_ xh_writer_t *writer, void *output, xh_int_t fd, SV *file, size_t size_hint, xh_bool_t async)
+{
+    char        *path;
+    Stat_t       st;
+
+    writer->perl_io   = NULL;
+    writer->sync_io   = NULL;
+    writer->perl_obj  = NULL;
+    writer->fd        = -1;
+    writer->close_fd  = FALSE;
+    writer->async     = async;
+    writer->null_sink = FALSE;
+    writer->segments  = NULL;
+    writer->pull      = NULL;
+
+    if (file != NULL && SvOK(file)) {
+        path = SvPV_nolen(file);
+        fd   = PerlLIO_open3(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1) {
+            croak("Can't open file '%s': %s", path, strerror(errno));
+        }
+        writer->fd       = fd;
+        writer->close_fd = TRUE;
+    }
+    else if (fd >= 0) {
+        writer->fd = fd;
+    }
+    else if (output != NULL) {
         MAGIC  *mg;
         GV     *gv = (GV *) output;
         IO     *io = GvIO(gv);
@@ -122,11 +499,187 @@ xh_writer_create(char *encoding, void *output, size_t size, xh_uint_t indent, xh
             /* tied handle */
             writer->perl_obj = SvTIED_obj(MUTABLE_SV(io), mg);
         }
+        else if (xh_writer_is_raw_perl_io(aTHX_ IoOFP(io))) {
+            /* raw handle, write to its fd and resync the handle on close */
+            if (PerlIO_flush(IoOFP(io)) != 0) {
+                croak("Write error: %s", strerror(errno));
+            }
+            writer->sync_io = IoOFP(io);
+            writer->fd      = PerlIO_fileno(IoOFP(io));
+        }
         else {
             /* simple handle */
             writer->perl_io = IoOFP(io);
+            return;
+        }
+        if (writer->fd == -1) return;
+    }
+    else {
+        return;
+    }
+
+    /* expected size of the output, reserve the space at once */
+    if (size_hint > 0 && PerlLIO_fstat(writer->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+        (void) fallocate(writer->fd, FALLOC_FL_KEEP_SIZE, lseek(writer->fd, 0, SEEK_CUR), size_hint);
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+        (void) posix_fadvise(writer->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+}
+
+/* discards the output, only its length is counted */
+void
+xh_writer_open_null(pTHX_ xh_writer_t *writer)
+{
+    xh_writer_open(aTHX_ writer, NULL, -1, NULL, 0, FALSE);
+
+    writer->null_sink = TRUE;
+}
+
+/* the result is an array of scalars filled one by one */
+void
+xh_writer_open_segments(pTHX_ xh_writer_t *writer)
+{
+    xh_writer_open(aTHX_ writer, NULL, -1, NULL, 0, FALSE);
+
+    writer->segments = newAV();
+}
+
+/* the output is appended to the pending scalar of the pull iterator */
+void
+xh_writer_open_pull(pTHX_ xh_writer_t *writer, SV *pending)
+{
+    xh_writer_open(aTHX_ writer, NULL, -1, NULL, 0, FALSE);
+
+    writer->pull = pending;
+}
+
+void
+xh_writer_close(pTHX_ xh_writer_t *writer)
+{
+#ifdef XH_HAVE_PTHREAD
+    xh_worker_stop(&writer->worker);
+#endif
+    if (writer->close_fd) {
+        (void) PerlLIO_close(writer->fd);
+        writer->close_fd = FALSE;
+    }
+    if (writer->segments != NULL) {
+        SvREFCNT_dec((SV *) writer->segments);
+        writer->segments = NULL;
+    }
+    writer->pull = NULL;
+    if (writer->sync_io != NULL) {
+        if (PerlLIO_lseek(writer->fd, 0, SEEK_CUR) != -1) {
+            (void) PerlIO_seek(writer->sync_io, 0, SEEK_CUR);
         }
+        writer->sync_io = NULL;
+    }
+    writer->fd = -1;
+}
+
+void
+xh_writer_init(pTHX_ xh_writer_t *writer, char *encoding, size_t size, xh_uint_t indent, xh_bool_t trim,
+    xh_writer_compress_t compress, xh_int_t compress_level, xh_checksum_type_t checksum)
+{
+#ifdef PERL_IMPLICIT_CONTEXT
+    writer->perl         = aTHX;
+#endif
+    writer->indent       = indent;
+    writer->indent_count = 0;
+    writer->trim         = trim;
+    writer->size         = size;
+
+    xh_checksum_init(&writer->checksum, checksum);
+
+    size = xh_writer_buffer_size(writer);
+
+    if (writer->main_buf.scalar == NULL) {
+        xh_buffer_init(aTHX_ &writer->main_buf, size);
+    }
+    else {
+        writer->main_buf.cur = writer->main_buf.start;
     }
 
-    return writer;
+    if (strcasecmp(encoding, "UTF-8") != 0) {
+#ifdef XH_HAVE_ENCODER
+        if (writer->encoder != NULL && strcasecmp(writer->encoding, encoding) == 0) {
+            xh_encoder_reset(writer->encoder);
+        }
+        else {
+            xh_encoder_destroy(writer->encoder);
+
+            writer->encoder = xh_encoder_create(encoding);
+            if (writer->encoder == NULL) {
+                croak("Can't create encoder for '%s'", encoding);
+            }
+            strncpy(writer->encoding, encoding, XH_PARAM_LEN);
+        }
+
+        if (writer->enc_buf.scalar == NULL) {
+            xh_buffer_init(aTHX_ &writer->enc_buf, size * 4);
+        }
+        else {
+            writer->enc_buf.cur = writer->enc_buf.start;
+        }
+#else
+        croak("Can't create encoder for '%s'", encoding);
+#endif
+    }
+#ifdef XH_HAVE_ENCODER
+    else if (writer->encoder != NULL) {
+        xh_encoder_destroy(writer->encoder);
+        writer->encoder = NULL;
+        xh_buffer_destroy(aTHX_ &writer->enc_buf);
+    }
+#endif
+
+#ifdef XH_HAVE_ZLIB
+    if (compress == XH_WRITER_COMPRESS_GZIP) {
+        if (writer->compressor != NULL) {
+            xh_compressor_reset(writer->compressor, compress_level);
+        }
+        else {
+            writer->compressor = xh_compressor_create(compress_level);
+            if (writer->compressor == NULL) {
+                croak("Can't create compressor");
+            }
+        }
+
+        if (writer->comp_buf.scalar == NULL) {
+            xh_buffer_init(aTHX_ &writer->comp_buf, size);
+        }
+        else {
+            writer->comp_buf.cur = writer->comp_buf.start;
+        }
+    }
+    else if (writer->compressor != NULL) {
+        xh_compressor_destroy(writer->compressor);
+        writer->compressor = NULL;
+        xh_buffer_destroy(aTHX_ &writer->comp_buf);
+    }
+#else
+    if (compress != XH_WRITER_COMPRESS_NONE) {
+        croak("Compression is not supported");
+    }
+    (void) compress_level;
+#endif
+
+    /* without encoding and compression the length is known without writing */
+    writer->count_only = writer->null_sink;
+#ifdef XH_HAVE_ENCODER
+    if (writer->encoder != NULL) writer->count_only = FALSE;
+#endif
+#ifdef XH_HAVE_ZLIB
+    if (writer->compressor != NULL) writer->count_only = FALSE;
+#endif
+
+#ifdef XH_HAVE_PTHREAD
+    /* the writer fills one buffer while the thread drains another */
+    if (writer->async && writer->fd != -1) {
+        xh_worker_start(aTHX_ &writer->worker, writer, size);
+    }
+#endif
 }
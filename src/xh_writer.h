@@ -4,33 +4,120 @@
 #include "xh_config.h"
 #include "xh_core.h"
 
+/* values larger than this are written by windows when streaming */
+#define XH_WRITER_CHUNK_SIZE 65536
+
+#define XH_WRITER_IS_CHUNKED(w, l)                                     \
+    ((l) > XH_WRITER_CHUNK_SIZE && xh_writer_is_stream(w))
+
 #define XH_WRITER_RESIZE_BUFFER(w, b, l)                               \
     if ((l) > (b->end - b->cur -1)) {                                  \
-        xh_writer_resize_buffer(w, (l) + 1);                           \
+        xh_writer_resize_buffer(aTHX_ w, (l) + 1);                     \
     }
 
+/* smallest buffer allocated for a string result */
+#define XH_WRITER_MIN_SIZE 1024
+
+/* string results up to this size are copied out of a warm buffer */
+#define XH_WRITER_COPY_SIZE 65536
+
+/* segments grow from the buffer size up to this size */
+#define XH_WRITER_SEGMENT_SIZE 1048576
+
+/* errors of the stages, otherwise errno of write(2) */
+#define XH_WRITER_CONVERT_ERROR  -1
+#define XH_WRITER_COMPRESS_ERROR -2
+
+typedef enum {
+    XH_WRITER_COMPRESS_NONE,
+    XH_WRITER_COMPRESS_GZIP
+} xh_writer_compress_t;
+
 typedef struct _xh_writer_t xh_writer_t;
 struct _xh_writer_t {
 #ifdef XH_HAVE_ENCODER
     xh_encoder_t          *encoder;
+    char                   encoding[XH_PARAM_LEN];
     xh_buffer_t            enc_buf;
+#endif
+#ifdef XH_HAVE_ZLIB
+    xh_compressor_t       *compressor;
+    xh_buffer_t            comp_buf;
+#endif
+#ifdef PERL_IMPLICIT_CONTEXT
+    /* the interpreter for callbacks of the stages, they get the writer only */
+    tTHX                   perl;
 #endif
     PerlIO                *perl_io;
+    PerlIO                *sync_io;
     SV                    *perl_obj;
+    AV                    *segments;
+    SV                    *pull;
+    int                    fd;
+    xh_bool_t              close_fd;
+    xh_bool_t              async;
+    xh_bool_t              null_sink;
+    xh_bool_t              count_only;
+#ifdef XH_HAVE_PTHREAD
+    xh_worker_t            worker;
+#endif
     xh_buffer_t            main_buf;
+    xh_checksum_t          checksum;
+    size_t                 size;
+    size_t                 avg_size;
+    size_t                 huge_size;
     xh_int_t               indent;
     xh_int_t               indent_count;
     xh_bool_t              trim;
 };
 
-SV *xh_writer_flush_buffer(xh_writer_t *writer, xh_buffer_t *buf);
-SV *xh_writer_flush(xh_writer_t *writer);
-void xh_writer_resize_buffer(xh_writer_t *writer, size_t inc);
-void xh_writer_destroy(xh_writer_t *writer);
-xh_writer_t *xh_writer_create(char *encoding, void *output, size_t size, xh_uint_t indent, xh_bool_t trim);
+SV *xh_writer_flush_buffer(pTHX_ xh_writer_t *writer, xh_buffer_t *buf);
+SV *xh_writer_flush(pTHX_ xh_writer_t *writer);
+SV *xh_writer_finish(pTHX_ xh_writer_t *writer, xh_bool_t keep);
+void xh_writer_resize_buffer(pTHX_ xh_writer_t *writer, size_t inc);
+void xh_writer_destroy(pTHX_ xh_writer_t *writer);
+void xh_writer_open(pTHX_ xh_writer_t *writer, void *output, xh_int_t fd, SV *file, size_t size_hint, xh_bool_t async);
+void xh_writer_open_null(pTHX_ xh_writer_t *writer);
+void xh_writer_open_segments(pTHX_ xh_writer_t *writer);
+void xh_writer_open_pull(pTHX_ xh_writer_t *writer, SV *pending);
+void xh_writer_close(pTHX_ xh_writer_t *writer);
+void xh_writer_init(pTHX_ xh_writer_t *writer, char *encoding, size_t size, xh_uint_t indent, xh_bool_t trim,
+    xh_writer_compress_t compress, xh_int_t compress_level, xh_checksum_type_t checksum);
+int xh_writer_drain(xh_writer_t *writer, xh_buffer_t *buf, xh_bool_t finish);
+void xh_writer_raise(int err);
+int xh_writer_write_all(int fd, const char *s1, size_t l1, const char *s2, size_t l2);
+void xh_writer_write_fd(int fd, const char *s1, size_t l1, const char *s2, size_t l2);
+void xh_writer_write_direct(xh_writer_t *writer, const char *content, size_t content_len);
+
+XH_INLINE xh_bool_t
+xh_writer_is_stream(xh_writer_t *writer)
+{
+    return writer->perl_io != NULL || writer->perl_obj != NULL || writer->fd != -1
+        || writer->segments != NULL || writer->pull != NULL || writer->null_sink;
+}
+
+/* output written, but not taken by the pull iterator yet */
+XH_INLINE size_t
+xh_writer_pending(xh_writer_t *writer)
+{
+    return (writer->main_buf.cur - writer->main_buf.start) + SvCUR(writer->pull);
+}
+
+/* raw data can be written to the fd as is, bypassing the buffer */
+XH_INLINE xh_bool_t
+xh_writer_is_direct(xh_writer_t *writer)
+{
+#ifdef XH_HAVE_ENCODER
+    if (writer->encoder != NULL) return FALSE;
+#endif
+#ifdef XH_HAVE_ZLIB
+    if (writer->compressor != NULL) return FALSE;
+#endif
+    return writer->fd != -1;
+}
 
 XH_INLINE void
-xh_writer_write_to_perl_obj(xh_buffer_t *buf, SV *perl_obj)
+xh_writer_write_to_perl_obj(pTHX_ xh_buffer_t *buf, SV *perl_obj)
 {
     size_t len = buf->cur - buf->start;
 
@@ -59,7 +146,7 @@ xh_writer_write_to_perl_obj(xh_buffer_t *buf, SV *perl_obj)
 }
 
 XH_INLINE void
-xh_writer_write_to_perl_io(xh_buffer_t *buf, PerlIO *perl_io)
+xh_writer_write_to_perl_io(pTHX_ xh_buffer_t *buf, PerlIO *perl_io)
 {
     size_t len = buf->cur - buf->start;
 
@@ -73,6 +160,18 @@ xh_writer_write_to_perl_io(xh_buffer_t *buf, PerlIO *perl_io)
     }
 }
 
+XH_INLINE void
+xh_writer_write_to_fd(xh_buffer_t *buf, int fd)
+{
+    size_t len = buf->cur - buf->start;
+
+    if (len > 0) {
+        xh_writer_write_fd(fd, buf->start, len, NULL, 0);
+
+        buf->cur = buf->start;
+    }
+}
+
 XH_INLINE SV *
 xh_writer_write_to_perl_scalar(xh_buffer_t *buf)
 {
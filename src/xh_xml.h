@@ -6,8 +6,29 @@
 
 extern const char indent_string[60];
 
+#define XH_XML_NAME_PREFIX_LEN(name) ((name)[0] >= '0' && (name)[0] <= '9' ? 1 : 0)
+
+/* dry run: the length of an indent the writer would write */
+XH_INLINE size_t
+xh_xml_count_indent(xh_writer_t *writer, xh_int_t indent_count)
+{
+    size_t indent_len;
+
+    if (!writer->indent) return 0;
+
+    indent_len = indent_count * writer->indent;
+
+    return indent_len > sizeof(indent_string) ? sizeof(indent_string) : indent_len;
+}
+
+XH_INLINE void
+xh_xml_count(xh_writer_t *writer, size_t len)
+{
+    writer->checksum.bytes += len;
+}
+
 XH_INLINE void
-xh_xml_write_xml_declaration(xh_writer_t *writer, char *version, char *encoding)
+xh_xml_write_xml_declaration(pTHX_ xh_writer_t *writer, char *version, char *encoding)
 {
     xh_buffer_t   *buf;
     size_t         ver_len, enc_len;
@@ -16,7 +37,13 @@ xh_xml_write_xml_declaration(xh_writer_t *writer, char *version, char *encoding)
     ver_len = strlen(version);
     enc_len = strlen(encoding);
 
-    XH_WRITER_RESIZE_BUFFER(writer, buf, sizeof("<?xml version=\"\" encoding=\"\"?>\n") - 1 + ver_len * 6 + enc_len * 6)
+    if (writer->count_only) {
+        xh_xml_count(writer, sizeof("<?xml version=\"\" encoding=\"\"?>\n") - 1
+            + xh_escape_attr_len(version, ver_len) + xh_escape_attr_len(encoding, enc_len));
+        return;
+    }
+
+    XH_WRITER_RESIZE_BUFFER(writer, buf, sizeof("<?xml version=\"\" encoding=\"\"?>\n") - 1 + xh_escape_attr_len(version, ver_len) + xh_escape_attr_len(encoding, enc_len))
 
     XH_BUFFER_WRITE_CONSTANT(buf, "<?xml version=\"")
     XH_BUFFER_WRITE_ESCAPE_ATTR(buf, version, ver_len);
@@ -26,10 +53,60 @@ xh_xml_write_xml_declaration(xh_writer_t *writer, char *version, char *encoding)
 
 }
 
+typedef enum {
+    XH_XML_RAW = 0,
+    XH_XML_TEXT,
+    XH_XML_ATTR
+} xh_xml_escape_t;
+
+/* Writes a huge content by windows of XH_WRITER_CHUNK_SIZE bytes,
+ * so the buffers never grow beyond a window whatever the value size. */
 XH_INLINE void
-xh_xml_write_node(xh_writer_t *writer, char *name, size_t name_len, SV *value, xh_bool_t raw)
+xh_xml_write_chunked(pTHX_ xh_writer_t *writer, const char *content, size_t content_len, xh_xml_escape_t mode)
 {
-    size_t         indent_len;
+    xh_buffer_t   *buf;
+    size_t         len, escaped_len;
+
+    buf = &writer->main_buf;
+
+    if (mode == XH_XML_RAW && xh_writer_is_direct(writer)) {
+        xh_writer_write_direct(writer, content, content_len);
+        return;
+    }
+
+    while (content_len) {
+        len = content_len > XH_WRITER_CHUNK_SIZE ? XH_WRITER_CHUNK_SIZE : content_len;
+
+        /* do not split a multibyte character between two flushes */
+        if (len < content_len) {
+            while (len > 1 && (content[len] & 0xC0) == 0x80) len--;
+        }
+
+        switch (mode) {
+            case XH_XML_TEXT:
+                escaped_len = xh_escape_text_len(content, len);
+                XH_WRITER_RESIZE_BUFFER(writer, buf, escaped_len)
+                xh_escape_write_text(buf, content, len);
+                break;
+            case XH_XML_ATTR:
+                escaped_len = xh_escape_attr_len(content, len);
+                XH_WRITER_RESIZE_BUFFER(writer, buf, escaped_len)
+                xh_escape_write_attr(buf, content, len);
+                break;
+            default:
+                XH_WRITER_RESIZE_BUFFER(writer, buf, len)
+                XH_BUFFER_WRITE_LONG_STRING(buf, content, len)
+        }
+
+        content     += len;
+        content_len -= len;
+    }
+}
+
+XH_INLINE void
+xh_xml_write_node(pTHX_ xh_writer_t *writer, char *name, size_t name_len, SV *value, xh_bool_t raw)
+{
+    size_t         indent_len, escaped_len, prefix_len;
     xh_buffer_t   *buf;
     char          *content;
     STRLEN         content_len;
@@ -41,6 +118,20 @@ xh_xml_write_node(xh_writer_t *writer, char *name, size_t name_len, SV *value, x
         content = xh_str_trim(content, &content_len);
     }
 
+    if (XH_WRITER_IS_CHUNKED(writer, content_len) && !writer->count_only) {
+        escaped_len = 0;
+    }
+    else {
+        escaped_len = raw ? content_len : xh_escape_text_len(content, content_len);
+    }
+
+    if (writer->count_only) {
+        /* "<" + "_" + ">" + "</" + "_" + ">" + "\n" */
+        xh_xml_count(writer, xh_xml_count_indent(writer, writer->indent_count) + (writer->indent ? 1 : 0)
+            + 5 + (XH_XML_NAME_PREFIX_LEN(name) + name_len) * 2 + escaped_len);
+        return;
+    }
+
     if (writer->indent) {
         indent_len = writer->indent_count * writer->indent;
         if (indent_len > sizeof(indent_string)) {
@@ -48,36 +139,47 @@ xh_xml_write_node(xh_writer_t *writer, char *name, size_t name_len, SV *value, x
         }
 
         /* "</" + "_" + ">" + "\n" */
-        XH_WRITER_RESIZE_BUFFER(writer, buf, indent_len + name_len * 2 + 10 + (raw ? content_len : content_len * 5))
+        XH_WRITER_RESIZE_BUFFER(writer, buf, indent_len + name_len * 2 + 10 + escaped_len)
 
         XH_BUFFER_WRITE_LONG_STRING(buf, indent_string, indent_len);
     }
     else {
         /* "</" + "_" + ">" + "\n" */
-        XH_WRITER_RESIZE_BUFFER(writer, buf, name_len * 2 + 10 + (raw ? content_len : content_len * 5))
+        XH_WRITER_RESIZE_BUFFER(writer, buf, name_len * 2 + 10 + escaped_len)
     }
 
-    XH_BUFFER_WRITE_CHAR(buf, '<')
+    /* names starting with a digit get the "_" prefix in both tags */
+    prefix_len = XH_XML_NAME_PREFIX_LEN(name);
 
-    if (name[0] >= '0' && name[0] <= '9') {
-        XH_BUFFER_WRITE_CHAR(buf, '_')
+    if (prefix_len) {
+        XH_BUFFER_WRITE_CHAR2(buf, "<_")
+    }
+    else {
+        XH_BUFFER_WRITE_CHAR(buf, '<')
     }
 
     XH_BUFFER_WRITE_LONG_STRING(buf, name, name_len)
 
     XH_BUFFER_WRITE_CHAR(buf, '>')
 
-    if (raw) {
+    if (XH_WRITER_IS_CHUNKED(writer, content_len)) {
+        xh_xml_write_chunked(aTHX_ writer, content, content_len, raw ? XH_XML_RAW : XH_XML_TEXT);
+
+        /* "</" + "_" + ">" + "\n" */
+        XH_WRITER_RESIZE_BUFFER(writer, buf, name_len + 5)
+    }
+    else if (raw) {
         XH_BUFFER_WRITE_LONG_STRING(buf, content, content_len)
     }
     else {
-        XH_BUFFER_WRITE_ESCAPE_STRING(buf, content, content_len)
+        xh_escape_write_text(buf, content, content_len);
     }
 
-    XH_BUFFER_WRITE_CHAR2(buf, "</")
-
-    if (name[0] >= '0' && name[0] <= '9') {
-        XH_BUFFER_WRITE_CHAR(buf, '_')
+    if (prefix_len) {
+        XH_BUFFER_WRITE_CHAR3(buf, "</_")
+    }
+    else {
+        XH_BUFFER_WRITE_CHAR2(buf, "</")
     }
 
     XH_BUFFER_WRITE_LONG_STRING(buf, name, name_len)
@@ -90,13 +192,20 @@ xh_xml_write_node(xh_writer_t *writer, char *name, size_t name_len, SV *value, x
 }
 
 XH_INLINE void
-xh_xml_write_empty_node(xh_writer_t *writer, char *name, size_t name_len)
+xh_xml_write_empty_node(pTHX_ xh_writer_t *writer, char *name, size_t name_len)
 {
     size_t       indent_len;
     xh_buffer_t *buf;
 
     buf = &writer->main_buf;
 
+    if (writer->count_only) {
+        /* "<" + "_" + "/>" + "\n" */
+        xh_xml_count(writer, xh_xml_count_indent(writer, writer->indent_count) + (writer->indent ? 1 : 0)
+            + 3 + XH_XML_NAME_PREFIX_LEN(name) + name_len);
+        return;
+    }
+
     if (writer->indent) {
         indent_len = writer->indent_count * writer->indent;
         if (indent_len > sizeof(indent_string)) {
@@ -113,10 +222,11 @@ xh_xml_write_empty_node(xh_writer_t *writer, char *name, size_t name_len)
         XH_WRITER_RESIZE_BUFFER(writer, buf, name_len + 5)
     }
 
-    XH_BUFFER_WRITE_CHAR(buf, '<')
-
-    if (name[0] >= '0' && name[0] <= '9') {
-        XH_BUFFER_WRITE_CHAR(buf, '_')
+    if (XH_XML_NAME_PREFIX_LEN(name)) {
+        XH_BUFFER_WRITE_CHAR2(buf, "<_")
+    }
+    else {
+        XH_BUFFER_WRITE_CHAR(buf, '<')
     }
 
     XH_BUFFER_WRITE_LONG_STRING(buf, name, name_len)
@@ -129,13 +239,21 @@ xh_xml_write_empty_node(xh_writer_t *writer, char *name, size_t name_len)
 }
 
 XH_INLINE void
-xh_xml_write_start_node(xh_writer_t *writer, char *name, size_t name_len)
+xh_xml_write_start_node(pTHX_ xh_writer_t *writer, char *name, size_t name_len)
 {
     size_t       indent_len;
     xh_buffer_t *buf;
 
     buf = &writer->main_buf;
 
+    if (writer->count_only) {
+        /* "<" + "_" + ">" + "\n" */
+        xh_xml_count(writer, xh_xml_count_indent(writer, writer->indent_count) + (writer->indent ? 1 : 0)
+            + 2 + XH_XML_NAME_PREFIX_LEN(name) + name_len);
+        if (writer->indent) writer->indent_count++;
+        return;
+    }
+
     if (writer->indent) {
         indent_len = writer->indent_count++ * writer->indent;
         if (indent_len > sizeof(indent_string)) {
@@ -152,10 +270,11 @@ xh_xml_write_start_node(xh_writer_t *writer, char *name, size_t name_len)
         XH_WRITER_RESIZE_BUFFER(writer, buf, name_len + 5)
     }
 
-    XH_BUFFER_WRITE_CHAR(buf, '<')
-
-    if (name[0] >= '0' && name[0] <= '9') {
-        XH_BUFFER_WRITE_CHAR(buf, '_')
+    if (XH_XML_NAME_PREFIX_LEN(name)) {
+        XH_BUFFER_WRITE_CHAR2(buf, "<_")
+    }
+    else {
+        XH_BUFFER_WRITE_CHAR(buf, '<')
     }
 
     XH_BUFFER_WRITE_LONG_STRING(buf, name, name_len)
@@ -168,13 +287,21 @@ xh_xml_write_start_node(xh_writer_t *writer, char *name, size_t name_len)
 }
 
 XH_INLINE void
-xh_xml_write_end_node(xh_writer_t *writer, char *name, size_t name_len)
+xh_xml_write_end_node(pTHX_ xh_writer_t *writer, char *name, size_t name_len)
 {
     size_t         indent_len;
     xh_buffer_t   *buf;
 
     buf = &writer->main_buf;
 
+    if (writer->count_only) {
+        /* "</" + "_" + ">" + "\n" */
+        if (writer->indent) writer->indent_count--;
+        xh_xml_count(writer, xh_xml_count_indent(writer, writer->indent_count) + (writer->indent ? 1 : 0)
+            + 3 + XH_XML_NAME_PREFIX_LEN(name) + name_len);
+        return;
+    }
+
     if (writer->indent) {
         indent_len = --writer->indent_count * writer->indent;
         if (indent_len > sizeof(indent_string)) {
@@ -191,10 +318,11 @@ xh_xml_write_end_node(xh_writer_t *writer, char *name, size_t name_len)
         XH_WRITER_RESIZE_BUFFER(writer, buf, name_len + 5)
     }
 
-    XH_BUFFER_WRITE_CHAR2(buf, "</")
-
-    if (name[0] >= '0' && name[0] <= '9') {
-        XH_BUFFER_WRITE_CHAR(buf, '_')
+    if (XH_XML_NAME_PREFIX_LEN(name)) {
+        XH_BUFFER_WRITE_CHAR3(buf, "</_")
+    }
+    else {
+        XH_BUFFER_WRITE_CHAR2(buf, "</")
     }
 
     XH_BUFFER_WRITE_LONG_STRING(buf, name, name_len)
@@ -207,9 +335,9 @@ xh_xml_write_end_node(xh_writer_t *writer, char *name, size_t name_len)
 }
 
 XH_INLINE void
-xh_xml_write_content(xh_writer_t *writer, SV *value)
+xh_xml_write_content(pTHX_ xh_writer_t *writer, SV *value)
 {
-    size_t         indent_len;
+    size_t         indent_len, escaped_len;
     xh_buffer_t   *buf;
     char          *content;
     size_t         content_len;
@@ -223,31 +351,77 @@ xh_xml_write_content(xh_writer_t *writer, SV *value)
         content = xh_str_trim(content, &content_len);
     }
 
+    if (writer->count_only) {
+        /* "\n" */
+        xh_xml_count(writer, xh_xml_count_indent(writer, writer->indent_count) + (writer->indent ? 1 : 0)
+            + xh_escape_text_len(content, content_len));
+        return;
+    }
+
+    if (XH_WRITER_IS_CHUNKED(writer, content_len)) {
+        escaped_len = 0;
+    }
+    else {
+        escaped_len = xh_escape_text_len(content, content_len);
+    }
+
     if (writer->indent) {
         indent_len = writer->indent_count * writer->indent;
         if (indent_len > sizeof(indent_string)) {
             indent_len = sizeof(indent_string);
         }
 
-        XH_WRITER_RESIZE_BUFFER(writer, buf, indent_len + content_len * 5)
+        /* "\n" */
+        XH_WRITER_RESIZE_BUFFER(writer, buf, indent_len + escaped_len + 1)
 
         XH_BUFFER_WRITE_LONG_STRING(buf, indent_string, indent_len);
     }
     else {
-        XH_WRITER_RESIZE_BUFFER(writer, buf, content_len * 5)
+        XH_WRITER_RESIZE_BUFFER(writer, buf, escaped_len)
     }
 
-    XH_BUFFER_WRITE_ESCAPE_STRING(buf, content, content_len);
+    if (XH_WRITER_IS_CHUNKED(writer, content_len)) {
+        xh_xml_write_chunked(aTHX_ writer, content, content_len, XH_XML_TEXT);
+
+        /* "\n" */
+        XH_WRITER_RESIZE_BUFFER(writer, buf, 1)
+    }
+    else {
+        xh_escape_write_text(buf, content, content_len);
+    }
 
     if (writer->indent) {
         XH_BUFFER_WRITE_CHAR(buf, '\n')
     }
 }
 
+/* a prepared fragment, written as is */
 XH_INLINE void
-xh_xml_write_comment(xh_writer_t *writer, SV *value)
+xh_xml_write_raw(pTHX_ xh_writer_t *writer, const char *content, size_t content_len)
 {
-    size_t         indent_len;
+    xh_buffer_t *buf;
+
+    buf = &writer->main_buf;
+
+    if (writer->count_only) {
+        xh_xml_count(writer, content_len);
+        return;
+    }
+
+    if (XH_WRITER_IS_CHUNKED(writer, content_len)) {
+        xh_xml_write_chunked(aTHX_ writer, content, content_len, XH_XML_RAW);
+        return;
+    }
+
+    XH_WRITER_RESIZE_BUFFER(writer, buf, content_len)
+
+    XH_BUFFER_WRITE_LONG_STRING(buf, content, content_len)
+}
+
+XH_INLINE void
+xh_xml_write_comment(pTHX_ xh_writer_t *writer, SV *value)
+{
+    size_t         indent_len, reserve_len;
     xh_buffer_t   *buf;
     char          *content;
     size_t         content_len;
@@ -268,6 +442,15 @@ xh_xml_write_comment(xh_writer_t *writer, SV *value)
         content = xh_str_trim(content, &content_len);
     }
 
+    if (writer->count_only) {
+        /* "<!--" + "-->" + "\n" */
+        xh_xml_count(writer, xh_xml_count_indent(writer, writer->indent_count) + (writer->indent ? 1 : 0)
+            + 7 + content_len);
+        return;
+    }
+
+    reserve_len = XH_WRITER_IS_CHUNKED(writer, content_len) ? 0 : content_len;
+
     if (writer->indent) {
         indent_len = writer->indent_count * writer->indent;
         if (indent_len > sizeof(indent_string)) {
@@ -275,17 +458,27 @@ xh_xml_write_comment(xh_writer_t *writer, SV *value)
         }
 
         /* "<!--" + "-->" */
-        XH_WRITER_RESIZE_BUFFER(writer, buf, indent_len + content_len + 7)
+        XH_WRITER_RESIZE_BUFFER(writer, buf, indent_len + reserve_len + 7)
 
         XH_BUFFER_WRITE_LONG_STRING(buf, indent_string, indent_len);
     }
     else {
         /* "<!--" + "-->" */
-        XH_WRITER_RESIZE_BUFFER(writer, buf, content_len + 7)
+        XH_WRITER_RESIZE_BUFFER(writer, buf, reserve_len + 7)
     }
 
     XH_BUFFER_WRITE_CHAR4(buf, "<!--")
-    XH_BUFFER_WRITE_LONG_STRING(buf, content, content_len);
+
+    if (XH_WRITER_IS_CHUNKED(writer, content_len)) {
+        xh_xml_write_chunked(aTHX_ writer, content, content_len, XH_XML_RAW);
+
+        /* "-->" + "\n" */
+        XH_WRITER_RESIZE_BUFFER(writer, buf, 4)
+    }
+    else {
+        XH_BUFFER_WRITE_LONG_STRING(buf, content, content_len);
+    }
+
     XH_BUFFER_WRITE_CHAR3(buf, "-->")
 
     if (writer->indent) {
@@ -294,9 +487,9 @@ xh_xml_write_comment(xh_writer_t *writer, SV *value)
 }
 
 XH_INLINE void
-xh_xml_write_cdata(xh_writer_t *writer, SV *value)
+xh_xml_write_cdata(pTHX_ xh_writer_t *writer, SV *value)
 {
-    size_t         indent_len;
+    size_t         indent_len, reserve_len;
     xh_buffer_t   *buf;
     char          *content;
     size_t         content_len;
@@ -317,6 +510,15 @@ xh_xml_write_cdata(xh_writer_t *writer, SV *value)
         content = xh_str_trim(content, &content_len);
     }
 
+    if (writer->count_only) {
+        /* "<![CDATA[" + "]]>" + "\n" */
+        xh_xml_count(writer, xh_xml_count_indent(writer, writer->indent_count) + (writer->indent ? 1 : 0)
+            + 12 + content_len);
+        return;
+    }
+
+    reserve_len = XH_WRITER_IS_CHUNKED(writer, content_len) ? 0 : content_len;
+
     if (writer->indent) {
         indent_len = writer->indent_count * writer->indent;
         if (indent_len > sizeof(indent_string)) {
@@ -324,17 +526,27 @@ xh_xml_write_cdata(xh_writer_t *writer, SV *value)
         }
 
         /* "<![CDATA[" + "]]>" */
-        XH_WRITER_RESIZE_BUFFER(writer, buf, indent_len + content_len + 12)
+        XH_WRITER_RESIZE_BUFFER(writer, buf, indent_len + reserve_len + 12)
 
         XH_BUFFER_WRITE_LONG_STRING(buf, indent_string, indent_len);
     }
     else {
         /* "<![CDATA[" + "]]>" */
-        XH_WRITER_RESIZE_BUFFER(writer, buf, content_len + 12)
+        XH_WRITER_RESIZE_BUFFER(writer, buf, reserve_len + 12)
     }
 
     XH_BUFFER_WRITE_CHAR9(buf, "<![CDATA[")
-    XH_BUFFER_WRITE_LONG_STRING(buf, content, content_len);
+
+    if (XH_WRITER_IS_CHUNKED(writer, content_len)) {
+        xh_xml_write_chunked(aTHX_ writer, content, content_len, XH_XML_RAW);
+
+        /* "]]>" + "\n" */
+        XH_WRITER_RESIZE_BUFFER(writer, buf, 4)
+    }
+    else {
+        XH_BUFFER_WRITE_LONG_STRING(buf, content, content_len);
+    }
+
     XH_BUFFER_WRITE_CHAR3(buf, "]]>")
 
     if (writer->indent) {
@@ -343,13 +555,20 @@ xh_xml_write_cdata(xh_writer_t *writer, SV *value)
 }
 
 XH_INLINE void
-xh_xml_write_start_tag(xh_writer_t *writer, char *name, size_t name_len)
+xh_xml_write_start_tag(pTHX_ xh_writer_t *writer, char *name, size_t name_len)
 {
     size_t       indent_len;
     xh_buffer_t *buf;
 
     buf = &writer->main_buf;
 
+    if (writer->count_only) {
+        /* "<" + "_" */
+        xh_xml_count(writer, xh_xml_count_indent(writer, writer->indent_count)
+            + 1 + XH_XML_NAME_PREFIX_LEN(name) + name_len);
+        return;
+    }
+
     if (writer->indent) {
         indent_len = writer->indent_count * writer->indent;
         if (indent_len > sizeof(indent_string)) {
@@ -366,22 +585,30 @@ xh_xml_write_start_tag(xh_writer_t *writer, char *name, size_t name_len)
         XH_WRITER_RESIZE_BUFFER(writer, buf, name_len + 2)
     }
 
-    XH_BUFFER_WRITE_CHAR(buf, '<')
-
-    if (name[0] >= '0' && name[0] <= '9') {
-        XH_BUFFER_WRITE_CHAR(buf, '_')
+    if (XH_XML_NAME_PREFIX_LEN(name)) {
+        XH_BUFFER_WRITE_CHAR2(buf, "<_")
+    }
+    else {
+        XH_BUFFER_WRITE_CHAR(buf, '<')
     }
 
     XH_BUFFER_WRITE_LONG_STRING(buf, name, name_len)
 }
 
 XH_INLINE void
-xh_xml_write_end_tag(xh_writer_t *writer)
+xh_xml_write_end_tag(pTHX_ xh_writer_t *writer)
 {
     xh_buffer_t *buf;
 
     buf = &writer->main_buf;
 
+    if (writer->count_only) {
+        /* ">" + "\n" */
+        xh_xml_count(writer, writer->indent ? 2 : 1);
+        if (writer->indent) writer->indent_count++;
+        return;
+    }
+
     XH_WRITER_RESIZE_BUFFER(writer, buf, 2)
 
     if (writer->indent) {
@@ -394,12 +621,18 @@ xh_xml_write_end_tag(xh_writer_t *writer)
 }
 
 XH_INLINE void
-xh_xml_write_closed_end_tag(xh_writer_t *writer)
+xh_xml_write_closed_end_tag(pTHX_ xh_writer_t *writer)
 {
     xh_buffer_t *buf;
 
     buf = &writer->main_buf;
 
+    if (writer->count_only) {
+        /* "/>" + "\n" */
+        xh_xml_count(writer, writer->indent ? 3 : 2);
+        return;
+    }
+
     XH_WRITER_RESIZE_BUFFER(writer, buf, 3)
 
     if (writer->indent) {
@@ -411,7 +644,7 @@ xh_xml_write_closed_end_tag(xh_writer_t *writer)
 }
 
 XH_INLINE void
-xh_xml_write_attribute(xh_writer_t *writer, char *name, size_t name_len, SV *value)
+xh_xml_write_attribute(pTHX_ xh_writer_t *writer, char *name, size_t name_len, SV *value)
 {
     xh_buffer_t   *buf;
     char          *content;
@@ -429,8 +662,29 @@ xh_xml_write_attribute(xh_writer_t *writer, char *name, size_t name_len, SV *val
         content_len = str_len;
     }
 
+    if (writer->count_only) {
+        /* " " + "=\"" + "\"" */
+        xh_xml_count(writer, name_len + 4 + xh_escape_attr_len(content, content_len));
+        return;
+    }
+
+    if (XH_WRITER_IS_CHUNKED(writer, content_len)) {
+        /* ' ="' */
+        XH_WRITER_RESIZE_BUFFER(writer, buf, name_len + 3)
+
+        XH_BUFFER_WRITE_CHAR(buf, ' ')
+        XH_BUFFER_WRITE_LONG_STRING(buf, name, name_len)
+        XH_BUFFER_WRITE_CHAR2(buf, "=\"");
+
+        xh_xml_write_chunked(aTHX_ writer, content, content_len, XH_XML_ATTR);
+
+        XH_WRITER_RESIZE_BUFFER(writer, buf, 1)
+        XH_BUFFER_WRITE_CHAR(buf, '"');
+        return;
+    }
+
     /* ' =""' */
-    XH_WRITER_RESIZE_BUFFER(writer, buf, name_len + content_len * 6 + 4)
+    XH_WRITER_RESIZE_BUFFER(writer, buf, name_len + xh_escape_attr_len(content, content_len) + 4)
 
     XH_BUFFER_WRITE_CHAR(buf, ' ')
 
@@ -441,7 +695,7 @@ xh_xml_write_attribute(xh_writer_t *writer, char *name, size_t name_len, SV *val
     }
     else {
         XH_BUFFER_WRITE_CHAR2(buf, "=\"");
-        XH_BUFFER_WRITE_ESCAPE_ATTR(buf, content, content_len);
+        xh_escape_write_attr(buf, content, content_len);
         XH_BUFFER_WRITE_CHAR(buf, '"');
     }
 }
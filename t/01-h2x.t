@@ -2,7 +2,7 @@
 use strict;
 use warnings;
 
-use Test::More tests => 23;
+use Test::More tests => 52;
 use File::Temp qw(tempfile);
 
 use XML::Hash::XS 'hash2xml';
@@ -146,6 +146,54 @@ SKIP: {
     ;
 }
 
+{
+    my $value = join('', map { "value $_ < > & \r \x{442}\x{435}\x{441}\x{442} " } 1 .. 20000);
+    (my $escaped = $value) =~ s/&/&amp;/g;
+    $escaped =~ s/</&lt;/g;
+    $escaped =~ s/>/&gt;/g;
+    $escaped =~ s/\r/&#13;/g;
+    (my $attr_escaped = $escaped) =~ s/"/&quot;/g;
+
+    my $data;
+    my $fh = tempfile();
+    binmode $fh, ':utf8';
+    hash2xml( { node1 => $value, node2 => \$value }, output => $fh, canonical => 1 );
+    seek($fh, 0, 0);
+    { local $/; $data = <$fh> }
+    is
+        $data,
+        qq{$xml_decl\n<root><node1>$escaped</node1><node2>$escaped</node2></root>},
+        'filehandle output of huge values',
+    ;
+
+    $fh = tempfile();
+    hash2xml( { node1 => $value }, output => $fh, use_attr => 1 );
+    seek($fh, 0, 0);
+    { local $/; $data = <$fh> }
+    utf8::decode($data);
+    is
+        $data,
+        qq{$xml_decl\n<root node1="$attr_escaped"/>},
+        'filehandle output of huge attribute',
+    ;
+
+    SKIP: {
+        my $fh = tempfile();
+        eval { hash2xml( { node1 => $value }, output => $fh, encoding => 'cp1251', xml_decl => 0 ) };
+        my $err = $@;
+        chomp $err;
+        skip $err, 1 if $err;
+        seek($fh, 0, 0);
+        { local $/; $data = <$fh> }
+        (my $expected = qq{<root><node1>$escaped</node1></root>}) =~ s/\x{442}\x{435}\x{441}\x{442}/\362\345\361\362/g;
+        is
+            $data,
+            $expected,
+            'filehandle output of huge value with encoding',
+        ;
+    }
+}
+
 {
     my $data = '';
     tie *STDOUT, "Trapper", \$data;
@@ -328,6 +376,230 @@ EOT
     ;
 }
 
+{
+    $XML::Hash::XS::indent    = 0;
+    $XML::Hash::XS::xml_decl  = 0;
+    {
+        local $XML::Hash::XS::root = 'local';
+        is hash2xml({ node => 1 }), '<local><node>1</node></local>', 'local global option';
+    }
+    is hash2xml({ node => 1 }), '<root><node>1</node></root>', 'global option restored after local';
+}
+
+{
+    my $saved = \$XML::Hash::XS::root;
+    *XML::Hash::XS::root = \'glob';
+    is hash2xml({ node => 1 }), '<glob><node>1</node></glob>', 'global option replaced through its glob';
+    {
+        local *XML::Hash::XS::root;
+        is hash2xml({ node => 1 }), '<root><node>1</node></root>', 'global option of a local glob';
+    }
+    *XML::Hash::XS::root = $saved;
+}
+
+{
+    my (undef, $name) = tempfile(UNLINK => 1);
+    {
+        open my $fh, '>:utf8', $name or die $!;
+        local $XML::Hash::XS::output = $fh;
+        hash2xml({ node => 1 });
+    }
+    is -s $name, length('<root><node>1</node></root>'), 'global output handle is closed with its scope';
+}
+
+{
+    my $root    = 'r' x 40;
+    my $content = 'c' x 40;
+    is
+        hash2xml({ $content => 'text', node => 1 }, root => $root, content => $content, use_attr => 1, xml_decl => 0, indent => 0),
+        qq{<$root node="1">text</$root>},
+        'names longer than 32 bytes',
+    ;
+}
+
+{
+    my $data = '';
+    tie *TRAP, 'Trapper', \$data;
+    local $XML::Hash::XS::output = \*TRAP;
+    hash2xml({ node => 1 });
+    is $data, '<root><node>1</node></root>', 'global output handle';
+}
+
+{
+    my $depth = 100_000;
+    my $data  = { n => 'x' };
+    $data = { n => $data } for 2 .. $depth;
+    my $xml = hash2xml($data, max_depth => 2 * $depth, xml_decl => 0, indent => 0);
+    is
+        length($xml),
+        length('<root></root>') + $depth * length('<n></n>') + 1,
+        'deep nesting',
+    ;
+    $xml = hash2xml($data, max_depth => 2 * $depth, xml_decl => 0, indent => 0, use_attr => 1);
+    is
+        length($xml),
+        length('<root></root>') + ($depth - 2) * length('<n></n>') + length('<n n="x"/>'),
+        'deep nesting, use_attr',
+    ;
+    eval { hash2xml($data, max_depth => $depth / 2) };
+    like $@, qr/^Maximum recursion depth exceeded/, 'max_depth';
+}
+
+{
+    my %data = (a => 1, b => 2, c => 3);
+    my ($first) = each %data;
+    hash2xml(\%data, xml_decl => 0, canonical => 0);
+    hash2xml(\%data, xml_decl => 0, canonical => 1, use_attr => 1);
+    my ($second) = each %data;
+    ok defined($second) && $second ne $first, 'each iterator of the hash is kept';
+    keys %data;
+}
+
+for my $canonical (0, 1) {
+    my %data = map { ("k$_" => $_) } 1..50;
+    $data{a} = sub { %data = (); 'x' };
+    my $xml = hash2xml(\%data, xml_decl => 0, indent => 0, canonical => $canonical);
+    like $xml, qr{<a>x</a>}, "callback deletes the keys of the hash, canonical $canonical";
+}
+
+{
+    my %data = map { ("k$_" => { v => $_ }) } 1..50;
+    $data{a} = { b => [ 1, sub { %data = (); 'x' } ] };
+    my $xml = hash2xml(\%data, xml_decl => 0, indent => 0);
+    like $xml, qr{<a><b>1</b><b>x</b></a>}, 'callback deletes the keys of the outer hash';
+}
+
+{
+    # keys of the freed records may be reused at the same addresses
+    my $conv = XML::Hash::XS->new(xml_decl => 0, indent => 0, canonical => 1);
+    my @bad;
+    for my $i (1 .. 500) {
+        my %record = map { ("$_$i" => $_) } (qw(a b c d))[0 .. $i % 3 + 1];
+        my $expected = join('', '<root>', (map { "<$_>$record{$_}</$_>" } sort keys %record), '</root>');
+        my $xml = $conv->hash2xml(\%record);
+        push @bad, $xml if $xml ne $expected;
+    }
+    is_deeply \@bad, [], 'canonical order while the keys change between records';
+}
+
+{
+    local %ENV = (XH_NODE => 1);
+    is
+        hash2xml(\%ENV, xml_decl => 0, indent => 0),
+        '<root><XH_NODE>1</XH_NODE></root>',
+        'magical hash',
+    ;
+}
+
+{
+    require Hash::Util;
+    my %data = (node1 => 1, node2 => 2);
+    Hash::Util::lock_keys(\%data);
+    delete $data{node1};
+    is
+        hash2xml(\%data, xml_decl => 0, indent => 0),
+        '<root><node2>2</node2></root>',
+        'restricted hash with a deleted key',
+    ;
+}
+
+{
+    my @sparse;
+    $sparse[2] = 'value';
+    is
+        hash2xml({ node => \@sparse }, xml_decl => 0, indent => 0),
+        '<root><node/><node/><node>value</node></root>',
+        'sparse array',
+    ;
+    is
+        hash2xml({ node => \@sparse }, xml_decl => 0, indent => 0, use_attr => 1),
+        '<root><node/><node/><node>value</node></root>',
+        'sparse array, use_attr',
+    ;
+}
+
+{
+    require Tie::Array;
+    tie my @data, 'Tie::StdArray';
+    @data = (1, { node2 => 2 });
+    is
+        hash2xml({ node => \@data }, xml_decl => 0, indent => 0),
+        '<root><node>1</node><node><node2>2</node2></node></root>',
+        'tied array',
+    ;
+}
+
+{
+    is
+        hash2xml({ "a\0b" => 1, "a\0a" => 2, a => 3 }, xml_decl => 0, indent => 0, canonical => 1),
+        "<root><a>3</a><a\0a>2</a\0a><a\0b>1</a\0b></root>",
+        'canonical, keys with NUL bytes',
+    ;
+    is
+        hash2xml({ prefix_b => 1, prefix_ab => 2, prefix_a => 3, prefix_ => 4, prefix => 5 }, xml_decl => 0, indent => 0, canonical => 1),
+        '<root><prefix>5</prefix><prefix_>4</prefix_><prefix_a>3</prefix_a><prefix_ab>2</prefix_ab><prefix_b>1</prefix_b></root>',
+        'canonical, keys with a common prefix',
+    ;
+}
+
+{
+    my @keys = map { "k$_" } 1 .. 40;
+    my @list = map {
+        my $i = $_;
+        +{ map { ($keys[($i + $_ * 7) % 40] => 1) } 0 .. ($i % 3 ? 5 : 35) }
+    } 1 .. 300;
+    my $expected = join '', map {
+        my $h = $_;
+        '<list>' . join('', map { "<$_>1</$_>" } sort keys %$h) . '</list>'
+    } @list;
+    is
+        hash2xml({ list => \@list }, xml_decl => 0, indent => 0, canonical => 1),
+        "<root>$expected</root>",
+        'canonical, records of different keys',
+    ;
+}
+{
+    my @list = map { +{ id => $_, name => "n<$_>", type => undef, '2x' => 'y' } } 1 .. 20;
+    my $nodes = join '', map {
+        qq{<list><_2x>y</_2x><id>$_->{id}</id><name>n&lt;$_->{id}&gt;</name><type/></list>}
+    } @list;
+    my $attrs = join '', map {
+        qq{<list 2x="y" id="$_->{id}" name="n&lt;$_->{id}&gt;" type=""/>}
+    } @list;
+    is
+        hash2xml({ list => \@list }, xml_decl => 0, canonical => 1)
+        . hash2xml({ list => \@list }, xml_decl => 0, canonical => 1, use_attr => 1),
+        "<root>$nodes</root><root>$attrs</root>",
+        'records of the same keys',
+    ;
+}
+{
+    my @list = (
+        { a => 1, b => 2 },
+        { a => 3, b => { c => 4 } },
+        { a => 5, b => 6, c => 7 },
+        { a => 8 },
+        bless({ a => 9, b => 10 }, 'Record'),
+        'x',
+        { a => 11, b => 12 },
+        { content => 13, b => 14 },
+    );
+    is
+        hash2xml({ list => \@list }, xml_decl => 0, canonical => 1)
+        . hash2xml({ list => \@list }, xml_decl => 0, canonical => 1, use_attr => 1, content => 'content'),
+        '<root><list><a>1</a><b>2</b></list><list><a>3</a><b><c>4</c></b></list>'
+        . '<list><a>5</a><b>6</b><c>7</c></list><list><a>8</a></list><list><a>9</a><b>10</b></list>'
+        . '<list>x</list><list><a>11</a><b>12</b></list><list><b>14</b><content>13</content></list></root>'
+        . '<root><list a="1" b="2"/><list a="3"><b c="4"/></list><list a="5" b="6" c="7"/><list a="8"/>'
+        . '<list a="9" b="10"/><list>x</list><list a="11" b="12"/><list b="14">13</list></root>',
+        'records of other keys and values',
+    ;
+}
+{
+    eval { hash2xml({ list => [ { a => 1 } ] }, max_depth => 1) };
+    like $@, qr/Maximum recursion depth exceeded/, 'records deeper than max_depth';
+}
+
 package Iterator;
 
 sub new {
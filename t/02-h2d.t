@@ -13,7 +13,7 @@ if ($@) {
     plan skip_all => "Option 'doc' is not supported";
 }
 else {
-    plan tests => 13;
+    plan tests => 14;
     require XML::LibXML;
 }
 
@@ -173,6 +173,17 @@ SKIP: {
     ;
 }
 
+{
+    my $depth = 10_000;
+    my $data  = { n => 'x' };
+    $data = { n => $data } for 2 .. $depth;
+    is
+        $c->hash2xml($data, max_depth => 2 * $depth)->findvalue('count(//n)'),
+        $depth,
+        'deep nesting',
+    ;
+}
+
 package Iterator;
 
 sub new {
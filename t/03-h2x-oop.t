@@ -2,7 +2,7 @@
 use strict;
 use warnings;
 
-use Test::More tests => 2;
+use Test::More tests => 10;
 
 use XML::Hash::XS qw();
 
@@ -24,3 +24,104 @@ our $xml_decl = qq{<?xml version="1.0" encoding="utf-8"?>};
         'code reference',
     ;
 }
+{
+    my $conv = XML::Hash::XS->new(xml_decl => 0, canonical => 1);
+    my $ok   = 1;
+    for my $n (1, 10, 5000, 3, 20000, 2) {
+        my $hash = { map { ("n$_" => "v$_ <&>") } 1 .. $n };
+        my $got  = $conv->hash2xml($hash);
+        my $exp  = XML::Hash::XS::hash2xml($hash, xml_decl => 0, canonical => 1);
+        $ok &&= $got eq $exp;
+    }
+    ok $ok, 'repeated calls with warm buffers';
+}
+
+{
+    my $conv = XML::Hash::XS->new(xml_decl => 0);
+    eval { $conv->hash2xml({ node1 => sub { die "oops\n" } }) };
+    is $@, "oops\n", 'exception inside of call';
+    is
+        $conv->hash2xml({ node1 => 'value1' }),
+        '<root><node1>value1</node1></root>',
+        'call after exception',
+    ;
+}
+
+{
+    my $conv = XML::Hash::XS->new(xml_decl => 0);
+    my $obj  = Nested->new($conv);
+    is
+        $conv->hash2xml({ node1 => $obj }),
+        '<root><node1><root><inner>value1</inner></root></node1></root>',
+        'nested call of the same object',
+    ;
+}
+
+SKIP: {
+    my $conv = XML::Hash::XS->new(xml_decl => 0, encoding => 'cp1251');
+    my $data;
+    eval { $data = $conv->hash2xml({ node1 => "\x{442}\x{435}\x{441}\x{442}" }) };
+    my $err = $@;
+    chomp $err;
+    skip $err, 1 if $err;
+    $data .= $conv->hash2xml({ node1 => "\x{442}" });
+    $data .= $conv->hash2xml({ node1 => "\x{442}" }, encoding => 'utf-8');
+    is
+        $data,
+        "<root><node1>\362\345\361\362</node1></root><root><node1>\362</node1></root>"
+            . "<root><node1>\x{442}</node1></root>",
+        'encoder reused between calls',
+    ;
+}
+
+{
+    my $conv = XML::Hash::XS->new(xml_decl => 0);
+    my $data = '';
+    for my $indent (0, 1, 0) {
+        $data .= $conv->hash2xml({ node1 => 1 }, indent => $indent);
+    }
+    is
+        $data,
+        "<root><node1>1</node1></root><root>\n <node1>1</node1>\n</root>\n<root><node1>1</node1></root>",
+        'per-call options with changing values',
+    ;
+}
+
+{
+    my $conv = XML::Hash::XS->new(xml_decl => 0);
+    my $data = '';
+    for my $root (qw(r1 r2 r3 r4 r5 r6 r1 r5)) {
+        $data .= $conv->hash2xml({}, root => $root);
+    }
+    is
+        $data,
+        '<r1/><r2/><r3/><r4/><r5/><r6/><r1/><r5/>',
+        'many per-call option lists',
+    ;
+}
+
+{
+    my $conv = XML::Hash::XS->new(xml_decl => 0);
+    my ($data1, $data2) = ('', '');
+    for my $buf (\$data1, \$data2, \$data1) {
+        open(my $fh, '>>', $buf) or die $!;
+        $conv->hash2xml({ node1 => 1 }, output => $fh);
+        close($fh);
+    }
+    is
+        "$data1|$data2",
+        '<root><node1>1</node1></root><root><node1>1</node1></root>|<root><node1>1</node1></root>',
+        'per-call output handles',
+    ;
+}
+
+package Nested;
+
+sub new {
+    my ($class, $conv) = @_;
+    return bless { conv => $conv }, $class;
+}
+
+sub toString {
+    return shift->{conv}->hash2xml({ inner => 'value1' });
+}
@@ -2,7 +2,7 @@
 use strict;
 use warnings;
 
-use Test::More tests => 12;
+use Test::More tests => 18;
 
 use XML::Hash::XS 'hash2xml';
 
@@ -98,3 +98,60 @@ SKIP: {
         'encoding support',
     ;
 }
+{
+    my $data = { root => { map { ("node$_" => { value => $_ }) } 1 .. 2000 } };
+    is
+        scalar(() = hash2xml($data, xml_decl => 0) =~ /<value>/g),
+        2000,
+        'many nested values',
+    ;
+}
+{
+    my $attr = '-' x 40;
+    my $text = '#' . ('text' x 10);
+    is
+        hash2xml( { node => { "${attr}id" => 1, $text => 'value', sub => 'test' } }, attr => $attr, text => $text, canonical => 1 ),
+        qq{$xml_decl<node id="1">value<sub>test</sub></node>},
+        'names longer than 32 bytes',
+    ;
+}
+{
+    is
+        hash2xml( { node => { '#textual' => 1, '#tex' => 2, '!-' => 3, '#cdata' => 'x' } }, cdata => '#cdata', canonical => 1 ),
+        qq{$xml_decl<node><!->3</!-><![CDATA[x]]><#tex>2</#tex><#textual>1</#textual></node>},
+        'keys similar to special ones',
+    ;
+}
+{
+    my $depth = 100_000;
+    my $data  = { n => 'x' };
+    $data = { n => $data } for 2 .. $depth;
+    is
+        length(hash2xml($data, max_depth => 2 * $depth)),
+        length($xml_decl) + $depth * length('<n></n>') + 1,
+        'deep nesting',
+    ;
+}
+{
+    my @sparse;
+    $sparse[2] = 'value';
+    is
+        hash2xml( { node => [ { sub => \@sparse } ] } ),
+        qq{$xml_decl<node><sub>value</sub></node>},
+        'sparse array',
+    ;
+}
+{
+    my @list = (
+        (map { +{ id => $_, name => undef } } 1 .. 3),
+        { id => 4, '-attr' => 'a' },
+        { id => 5, name => [ 'x', 'y' ] },
+        { id => 6, name => 'z' },
+    );
+    is
+        hash2xml( { node => { item => \@list } }, canonical => 1 ),
+        qq{$xml_decl<node><item attr="a"><id>1</id><name/><id>2</id><name/><id>3</id><name/>}
+        . qq{<id>4</id><id>5</id><name>xy</name><id>6</id><name>z</name></item></node>},
+        'records',
+    ;
+}
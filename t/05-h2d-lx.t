@@ -12,7 +12,7 @@ if ($@) {
     plan skip_all => "Option 'doc' is not supported";
 }
 else {
-    plan tests => 11;
+    plan tests => 12;
     require XML::LibXML;
 }
 
@@ -101,3 +101,13 @@ SKIP: {
         'encoding support',
     ;
 }
+{
+    my $depth = 10_000;
+    my $data  = { n => 'x' };
+    $data = { n => $data } for 2 .. $depth;
+    is
+        $c->hash2xml($data, max_depth => 2 * $depth)->findvalue('count(//n)'),
+        $depth,
+        'deep nesting',
+    ;
+}
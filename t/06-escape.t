@@ -0,0 +1,62 @@
+use strict;
+use warnings;
+
+use Test::More;
+
+use XML::Hash::XS qw();
+
+my @kernels = XML::Hash::XS::_escape_kernels();
+my @chars   = ("a", "b", " ", "\x{d0}", "\x{b9}", "<", ">", "&", "\"", "\r", "\n", "\t", "'", "]");
+
+my @strings = ('', 'plain', 'x' x 100);
+for my $len (0 .. 80, 127, 128, 129, 255, 256, 257, 1000) {
+    for my $density (0, 1, 8, 64) {
+        my $s = '';
+        for (1 .. $len) {
+            $s .= ($density && int(rand($density)) == 0)
+                ? $chars[rand @chars]
+                : chr(ord('a') + int(rand(26)));
+        }
+        push @strings, $s;
+    }
+}
+# special byte at every position of a vector and its tail
+for my $pos (0 .. 70) {
+    for my $ch ("<", ">", "&", "\"", "\r", "\n", "\t") {
+        my $s = 'y' x 71;
+        substr($s, $pos, 1, $ch);
+        push @strings, $s;
+    }
+}
+
+plan tests => 2 * scalar(@kernels) + 2;
+
+for my $kernel (@kernels) {
+    for my $attr (0, 1) {
+        my $failed = 0;
+        for my $s (@strings) {
+            my $expected = XML::Hash::XS::_escape($s, $attr);
+            my $got      = XML::Hash::XS::_escape($s, $attr, $kernel);
+            if ($got ne $expected) {
+                diag("mismatch for '$s': '$got' ne '$expected'");
+                $failed++;
+                last;
+            }
+        }
+        ok(!$failed, "$kernel kernel is equal to macros, " . ($attr ? 'attributes' : 'text'));
+    }
+}
+
+{
+    my $value = join('', map { ('x' x 1000) . "<&>\r\"" } 1 .. 1000);
+    is
+        XML::Hash::XS::hash2xml({ node => $value }, xml_decl => 0),
+        '<root><node>' . XML::Hash::XS::_escape($value, 0) . '</node></root>',
+        'large text value',
+    ;
+    is
+        XML::Hash::XS::hash2xml({ node => $value }, xml_decl => 0, use_attr => 1),
+        '<root node="' . XML::Hash::XS::_escape($value, 1) . '"/>',
+        'large attribute value',
+    ;
+}
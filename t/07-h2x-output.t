@@ -0,0 +1,218 @@
+package Raw;
+
+sub new      { bless { s => $_[1] }, $_[0] }
+sub toString { $_[0]{s} }
+
+package main;
+
+use strict;
+use warnings;
+
+use Test::More tests => 41;
+use File::Temp qw(tempfile);
+
+use XML::Hash::XS qw(hash2xml hash2xml_checksum);
+
+sub slurp {
+    my ($name) = @_;
+    open(my $fh, '<', $name) or die "Can't open '$name': $!";
+    local $/;
+    return scalar <$fh>;
+}
+
+my $data     = { node1 => 'value1', node2 => [ 'a', 'b<' ] };
+my $expected = hash2xml($data, canonical => 1);
+
+{
+    my ($fh, $name) = tempfile(UNLINK => 1);
+    my $res = hash2xml($data, canonical => 1, output_fd => fileno($fh));
+    close($fh);
+    ok(!defined $res, 'output_fd returns undef');
+    is(slurp($name), $expected, 'output_fd');
+}
+
+{
+    my (undef, $name) = tempfile(UNLINK => 1);
+    hash2xml($data, canonical => 1, output_file => $name);
+    is(slurp($name), $expected, 'output_file');
+    hash2xml({ a => 1 }, output_file => $name, xml_decl => 0);
+    is(slurp($name), '<root><a>1</a></root>', 'output_file truncates the file');
+}
+
+{
+    my $big = { item => [ map { { id => $_, name => "name $_ & co" } } 1 .. 5000 ] };
+    my $str = hash2xml($big, buf_size => 256);
+    my (undef, $name) = tempfile(UNLINK => 1);
+    hash2xml($big, buf_size => 256, output_file => $name, output_size => length($str));
+    is(slurp($name), $str, 'small buffer and size hint');
+    is(-s $name, length($str), 'size hint does not change the file size');
+}
+
+{
+    my $value = join('', map { ('x' x 1000) . "<&>" } 1 .. 1000);
+    my ($fh, $name) = tempfile(UNLINK => 1);
+    hash2xml({ raw => Raw->new($value) }, xml_decl => 0, output_fd => fileno($fh));
+    close($fh);
+    is(slurp($name), "<root><raw>$value</raw></root>", 'large raw value via output_fd');
+}
+
+{
+    my (undef, $name) = tempfile(UNLINK => 1);
+    my $conv = XML::Hash::XS->new(output_file => $name, canonical => 1);
+    $conv->hash2xml($data);
+    is(slurp($name), $expected, 'object with output_file');
+}
+
+{
+    eval { hash2xml($data, buf_size => 10) };
+    ok($@, 'too small buf_size');
+}
+
+{
+    my ($fh, $name) = tempfile(UNLINK => 1);
+    print $fh 'head';
+    hash2xml($data, canonical => 1, output => $fh);
+    is(tell($fh), 4 + length($expected), 'raw handle position is synced');
+    print $fh 'tail';
+    close($fh);
+    is(slurp($name), "head${expected}tail", 'raw handle keeps the order of writes');
+}
+
+{
+    my ($fh, $name) = tempfile(UNLINK => 1);
+    binmode($fh, ':crlf');
+    hash2xml({ a => "1\n2" }, xml_decl => 0, output => $fh);
+    close($fh);
+    is(slurp($name), "<root><a>1\r\n2</a></root>", 'crlf layer is applied');
+}
+
+{
+    my $str = '';
+    open(my $fh, '>', \$str) or die $!;
+    hash2xml($data, canonical => 1, output => $fh);
+    close($fh);
+    is($str, $expected, 'in-memory handle');
+}
+
+{
+    my $big = { item => [ map { { id => $_, name => "name $_ & co" } } 1 .. 5000 ] };
+    my $str = hash2xml($big, buf_size => 256);
+    my (undef, $name) = tempfile(UNLINK => 1);
+    hash2xml($big, buf_size => 256, output_file => $name, async => 1);
+    is(slurp($name), $str, 'async output_file');
+
+    my $conv = XML::Hash::XS->new(buf_size => 1024, async => 1);
+    for my $n (1 .. 2) {
+        my ($fh, $fname) = tempfile(UNLINK => 1);
+        $conv->hash2xml($big, output => $fh);
+        close($fh);
+        is(slurp($fname), $str, "async object, call $n");
+    }
+
+    SKIP: {
+        my $enc = eval { hash2xml({ a => 1 }, encoding => 'cp1251') };
+        skip 'encoding is not supported', 1 unless defined $enc;
+        my $exp = hash2xml($big, buf_size => 256, encoding => 'cp1251');
+        hash2xml($big, buf_size => 256, encoding => 'cp1251', output_file => $name, async => 1);
+        is(slurp($name), $exp, 'async with encoding');
+    }
+}
+
+SKIP: {
+    eval { hash2xml({ a => 1 }, compress => 'gzip') };
+    skip 'compression is not supported', 7 if $@;
+    require IO::Uncompress::Gunzip;
+
+    my $gunzip = sub {
+        my ($in) = @_;
+        my $out;
+        IO::Uncompress::Gunzip::gunzip(\$in => \$out) or die "gunzip failed";
+        return $out;
+    };
+
+    my $big = { item => [ map { { id => $_, name => "name $_ & co" } } 1 .. 5000 ] };
+    my $str = hash2xml($big, buf_size => 256);
+
+    my $gz = hash2xml($big, compress => 'gzip');
+    ok(length($gz) < length($str) / 4, 'gzip result is compressed');
+    is($gunzip->($gz), $str, 'gzip string result');
+    is($gunzip->(hash2xml({}, compress => 'gzip', compress_level => 0)), hash2xml({}), 'gzip level 0');
+
+    my (undef, $name) = tempfile(UNLINK => 1);
+    hash2xml($big, buf_size => 256, compress => 'gzip', output_file => $name);
+    is($gunzip->(slurp($name)), $str, 'gzip output_file');
+
+    hash2xml($big, buf_size => 256, compress => 'gzip', output_file => $name, async => 1);
+    is($gunzip->(slurp($name)), $str, 'gzip async output_file');
+
+    my $conv = XML::Hash::XS->new(compress => 'gzip', compress_level => 9);
+    is($gunzip->($conv->hash2xml($big)) . $gunzip->($conv->hash2xml($big)), $str x 2, 'gzip object reuse');
+
+    eval { hash2xml($big, compress => 'lzma') };
+    like($@, qr/Unsupported compression/, 'unsupported compression');
+}
+
+{
+    my ($xml, $sum, $bytes) = hash2xml_checksum({ a => 1 }, checksum => 'xxh64');
+    is($sum, '11dae564c2b1b203', 'xxh64 checksum');
+    is($bytes, length($xml), 'byte count');
+
+    my $big = { item => [ map { { id => $_, name => "name $_ & co" } } 1 .. 5000 ] };
+    my $str = hash2xml($big);
+    my (undef, $name) = tempfile(UNLINK => 1);
+    my (undef, $fsum, $fbytes) = hash2xml_checksum($big, checksum => 'xxh64', buf_size => 300, output_file => $name);
+    is_deeply([ $fsum, $fbytes ], [ (hash2xml_checksum($big, checksum => 'xxh64'))[1], length($str) ], 'checksum of a stream');
+
+    my $conv = XML::Hash::XS->new(checksum => 'xxh64', buf_size => 300, async => 1, output_file => $name);
+    $conv->hash2xml($big);
+    is_deeply([ $conv->checksum, $conv->bytes ], [ $fsum, $fbytes ], 'checksum of the object');
+
+    my (undef, $none) = hash2xml_checksum({ a => 1 });
+    ok(!defined $none, 'no checksum by default');
+
+    my @list = hash2xml({ a => 1 }, checksum => 'xxh64');
+    is(scalar(@list), 1, 'hash2xml returns the document only in list context');
+
+    SKIP: {
+        eval { hash2xml({ a => 1 }, checksum => 'crc32') };
+        skip 'crc32 is not supported', 2 if $@;
+        require Compress::Zlib;
+
+        my ($xml, $sum) = hash2xml_checksum($big, checksum => 'crc32');
+        is($sum, sprintf('%08x', Compress::Zlib::crc32($xml)), 'crc32 checksum');
+
+        my ($gz, $gzsum, $gzbytes) = hash2xml_checksum($big, checksum => 'crc32', compress => 'gzip');
+        is_deeply([ $gzsum, $gzbytes ], [ sprintf('%08x', Compress::Zlib::crc32($gz)), length($gz) ], 'checksum of compressed output');
+    }
+}
+
+{
+    my $segments = hash2xml($data, canonical => 1, output => 'segments');
+    is_deeply($segments, [ $expected ], 'small document is one segment');
+
+    my $big = { item => [ map { { id => $_, name => "\x{442}\x{435}\x{441}\x{442} $_ & co" } } 1 .. 50000 ] };
+    my $str = hash2xml($big);
+    $segments = hash2xml($big, output => 'segments');
+    ok(@$segments > 2, 'big document is split into segments');
+    is(join('', @$segments), $str, 'segments are joined into the document');
+    ok(!grep({ !utf8::is_utf8($_) } @$segments), 'segments are utf8 strings');
+
+    my $conv = XML::Hash::XS->new(output => 'segments');
+    is(join('', @{ $conv->hash2xml($big) }), $str, 'segments of the object');
+
+    SKIP: {
+        my $enc = eval { hash2xml($big, encoding => 'cp1251') };
+        skip 'encoding is not supported', 1 unless defined $enc;
+        is(join('', @{ hash2xml($big, encoding => 'cp1251', output => 'segments') }), $enc, 'encoded segments');
+    }
+
+    local $XML::Hash::XS::output = 'segments';
+    is(ref(hash2xml($data)), 'ARRAY', 'global output option');
+}
+
+{
+    my $big = { item => [ map { { id => $_, value => 'x' x 100 } } 1 .. 50000 ] };
+    my $str = hash2xml($big);
+    ok(length($str) > 4 * 1024 * 1024, 'document is larger than two huge pages');
+    is(hash2xml($big, huge_size => 1), $str, 'huge_size does not change the document');
+}
@@ -0,0 +1,68 @@
+package Raw;
+
+sub new      { bless { s => $_[1] }, $_[0] }
+sub toString { $_[0]{s} }
+
+package main;
+
+use strict;
+use warnings;
+
+use Test::More tests => 12;
+
+use XML::Hash::XS qw(hash2xml hash2xml_size);
+
+sub bytes_length { use bytes; length($_[0]) }
+
+my $data = {
+    node1 => 'value1 & <value2>',
+    node2 => [ 'a', { node22 => "b\r\n\t\"c\"" }, {} ],
+    node3 => \'value3',
+    '4node' => '',
+    node5 => Raw->new('<raw/>'),
+    node6 => "\x{442}\x{435}\x{441}\x{442}",
+    node7 => '  trimmed  ',
+};
+
+for my $opts (
+    [],
+    [ indent => 2 ],
+    [ use_attr => 1 ],
+    [ use_attr => 1, indent => 4, trim => 1 ],
+    [ xml_decl => 0, root => 'r' ],
+    [ method => 'LX', indent => 2 ],
+) {
+    is(
+        hash2xml_size($data, canonical => 1, @$opts),
+        bytes_length(hash2xml($data, canonical => 1, @$opts)),
+        "size with options: @$opts",
+    );
+}
+
+{
+    my $value = join('', map { ('x' x 1000) . "<&>\r\"" } 1 .. 200);
+    is(hash2xml_size({ v => $value }, use_attr => 1), bytes_length(hash2xml({ v => $value }, use_attr => 1)), 'size of a huge value');
+}
+
+{
+    my $conv = XML::Hash::XS->new(indent => 2, canonical => 1);
+    my $size = $conv->hash2xml_size($data);
+    is($size, bytes_length($conv->hash2xml($data)), 'size of the object');
+    is($conv->hash2xml_size($data), $size, 'repeated size of the object');
+}
+
+{
+    is(hash2xml_size($data, output_fd => 1), bytes_length(hash2xml($data)), 'output options are ignored');
+}
+
+SKIP: {
+    my $enc = eval { hash2xml($data, encoding => 'cp1251', canonical => 1) };
+    skip 'encoding is not supported', 1 unless defined $enc;
+    is(hash2xml_size($data, encoding => 'cp1251', canonical => 1), length($enc), 'size after encoding');
+}
+
+SKIP: {
+    my $gz = eval { hash2xml($data, compress => 'gzip', canonical => 1) };
+    skip 'compression is not supported', 1 unless defined $gz;
+    is(hash2xml_size($data, compress => 'gzip', canonical => 1), length($gz), 'size after compression');
+}
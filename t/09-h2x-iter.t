@@ -0,0 +1,101 @@
+package Iter;
+
+sub new      { my ($class, @items) = @_; bless { items => \@items }, $class }
+sub iternext { shift @{ $_[0]{items} } }
+
+package main;
+
+use strict;
+use warnings;
+
+use Test::More tests => 20;
+
+use XML::Hash::XS qw(hash2xml);
+
+sub bytes_of { my $s = shift; utf8::encode($s) if utf8::is_utf8($s); $s }
+
+sub drain {
+    my ($it, $size) = @_;
+    my ($doc, $max) = ('', 0);
+    while (defined(my $chunk = $size ? $it->next($size) : $it->next)) {
+        $max = length($chunk) if length($chunk) > $max;
+        $doc .= $chunk;
+    }
+    return wantarray ? ($doc, $max) : $doc;
+}
+
+sub data { +{
+    node1 => 'value1 & <value2>',
+    node2 => [ 'a', { node22 => "b\r\n\t\"c\"" }, {}, Iter->new('i1', { i2 => 2 }) ],
+    node3 => \'value3',
+    node4 => sub { 'code' },
+    node5 => "\x{442}\x{435}\x{441}\x{442}",
+    node6 => { '-attr' => 'a', '#text' => 'text', child => [ 1, 2 ] },
+} }
+
+for my $opts (
+    [],
+    [ indent => 2 ],
+    [ use_attr => 1 ],
+    [ method => 'LX' ],
+    [ canonical => 1, use_attr => 1 ],
+) {
+    my $conv = XML::Hash::XS->new(canonical => 1, @$opts);
+    is(drain($conv->hash2xml_iter(data()), 7), bytes_of($conv->hash2xml(data())), "chunks are joined into the document (@$opts)");
+}
+
+{
+    my $conv = XML::Hash::XS->new();
+    my $big  = { item => [ map { { id => $_, name => "name $_" } } 1 .. 20000 ] };
+    my $it   = $conv->hash2xml_iter($big);
+    my ($doc, $max) = drain($it, 4096);
+    is($doc, $conv->hash2xml($big), 'big document');
+    is($max, 4096, 'chunks are not larger than the size');
+    ok(!defined($it->next), 'iterator is exhausted');
+
+    $it = $conv->hash2xml_iter($big, root => 'list');
+    my $first = $it->next(100);
+    is(length($first), 100, 'first chunk');
+    undef $big;
+    like($first . drain($it), qr{<list><item>.*</item></list>$}s, 'iterator keeps the hash and takes per call options');
+}
+
+{
+    my $conv = XML::Hash::XS->new(encoding => 'cp1251', canonical => 1);
+    SKIP: {
+        my $expected = eval { $conv->hash2xml(data()) };
+        skip 'encoding is not supported', 1 unless defined $expected;
+        is(drain($conv->hash2xml_iter(data()), 3), $expected, 'encoded chunks');
+    }
+}
+
+{
+    my $conv = XML::Hash::XS->new();
+    my $it   = $conv->hash2xml_iter({ node => [ 1, sub { die "oops\n" } ] });
+    eval { 1 while defined $it->next(1) };
+    is($@, "oops\n", 'error is raised from next');
+    ok(!defined($it->next), 'iterator is stopped after an error');
+}
+
+{
+    my $conv = XML::Hash::XS->new();
+    open(my $fh, '>', \my $buf) or die;
+    for my $opt (
+        [ output      => $fh ],
+        [ output      => 'segments' ],
+        [ output_fd   => fileno(STDERR) ],
+        [ output_file => '/nonexistent/iter.xml' ],
+        [ async       => 1 ],
+    ) {
+        my $name = $opt->[0];
+        eval { $conv->hash2xml_iter({ a => 1 }, @$opt) };
+        like($@, qr/^Option '$name' is not supported by hash2xml_iter/, "$name is rejected per call");
+    }
+
+    eval { XML::Hash::XS->new(output => 'segments')->hash2xml_iter({ a => 1 }) };
+    like($@, qr/^Option 'output' is not supported by hash2xml_iter/, 'output of the object is rejected');
+
+    local $XML::Hash::XS::async = 1;
+    eval { XML::Hash::XS->new()->hash2xml_iter({ a => 1 }) };
+    like($@, qr/^Option 'async' is not supported by hash2xml_iter/, 'global option is rejected');
+}
@@ -0,0 +1,88 @@
+use strict;
+use warnings;
+
+use Test::More tests => 12;
+
+use XML::Hash::XS qw(hash2xml);
+use File::Temp qw(tempfile);
+
+my @records = map { { id => $_, name => "name $_ & co", list => [ 1, 2 ] } } 1 .. 3;
+
+{
+    my $w = XML::Hash::XS::Writer->new(canonical => 1);
+    $w->start('root');
+    $w->add(item => $_) for @records;
+    is($w->end, hash2xml({ item => \@records }, canonical => 1), 'records are written as one document');
+}
+
+{
+    my $w = XML::Hash::XS::Writer->new(indent => 2, xml_decl => 0, canonical => 1);
+    $w->start('export', date => '2024-01-01', note => '"quoted"');
+    $w->add(item => { id => 1 });
+    $w->raw("<!-- raw -->\n");
+    $w->add(item => [ { id => 2 }, { id => 3 } ]);
+    is(
+        $w->end,
+        qq{<export date="2024-01-01" note="&quot;quoted&quot;">\n  <item>\n    <id>1</id>\n  </item>\n<!-- raw -->\n}
+        . qq{  <item>\n    <id>2</id>\n  </item>\n  <item>\n    <id>3</id>\n  </item>\n</export>\n},
+        'attributes of the root, indent and raw content',
+    );
+}
+
+{
+    my $w = XML::Hash::XS::Writer->new(method => 'LX', xml_decl => 0);
+    $w->start('root');
+    $w->add(item => { '-id' => 1, '#text' => 'text' });
+    is($w->end, '<root><item id="1">text</item></root>', 'LX method');
+
+    $w = XML::Hash::XS::Writer->new(use_attr => 1, xml_decl => 0);
+    $w->start('root');
+    $w->add(item => { id => 1 });
+    is($w->end, '<root><item id="1"/></root>', 'attributes mode');
+}
+
+{
+    my $w = XML::Hash::XS::Writer->new(xml_decl => 0);
+    $w->start('root');
+    $w->add(node => "\x{442}\x{435}\x{441}\x{442}");
+    my $doc = $w->end;
+    ok(utf8::is_utf8($doc), 'string result is utf8');
+
+    $w->start('again');
+    is($w->end, '<again></again>', 'writer is reusable');
+}
+
+{
+    my ($fh, $file) = tempfile(UNLINK => 1);
+    my $w = XML::Hash::XS::Writer->new(output => $fh, canonical => 1);
+    $w->start('root');
+    $w->add(item => $_) for @records;
+    ok(!defined($w->end), 'nothing is returned for a filehandle');
+    close $fh;
+
+    open $fh, '<', $file or die $!;
+    my $content = do { local $/; <$fh> };
+    is($content, hash2xml({ item => \@records }, canonical => 1), 'document in the file');
+}
+
+SKIP: {
+    my $w = XML::Hash::XS::Writer->new(encoding => 'cp1251', xml_decl => 0);
+    eval { $w->start('root') };
+    skip 'encoding is not supported', 1 if $@;
+    $w->add(node => "\x{442}\x{435}\x{441}\x{442}");
+    is($w->end, "<root><node>\362\345\361\362</node></root>", 'encoding');
+}
+
+{
+    my $w = XML::Hash::XS::Writer->new();
+    eval { $w->add(item => {}) };
+    like($@, qr/not started/, 'add before start');
+
+    $w->start('root');
+    eval { $w->start('root') };
+    like($@, qr/already started/, 'start twice');
+
+    eval { $w->add(item => { node => sub { die "oops\n" } }) };
+    eval { $w->end };
+    like($@, qr/not started/, 'writer is stopped after an error');
+}
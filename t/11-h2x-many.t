@@ -0,0 +1,72 @@
+package Raw;
+
+sub new      { bless { s => $_[1] }, $_[0] }
+sub toString { $_[0]{s} }
+
+package main;
+
+use strict;
+use warnings;
+
+use Test::More tests => 13;
+
+use XML::Hash::XS qw(hash2xml hash2xml_many);
+use File::Temp qw(tempfile);
+
+my @hashes = (
+    { id => 1, name => 'a & b' },
+    { id => 2, list => [ 1, 2 ], raw => Raw->new('<raw/>') },
+    { id => 3, name => "\x{442}\x{435}\x{441}\x{442}" },
+    {},
+);
+my @docs = map { scalar hash2xml($_, canonical => 1) } @hashes;
+
+is_deeply(scalar hash2xml_many(\@hashes, canonical => 1), \@docs, 'array of documents');
+ok(utf8::is_utf8(scalar hash2xml_many(\@hashes)->[2]), 'documents are utf8 strings');
+is_deeply(scalar hash2xml_many([]), [], 'empty array');
+
+is(scalar hash2xml_many(\@hashes, canonical => 1, separator => "\n"), join("\n", @docs), 'stream with a separator');
+is(scalar hash2xml_many(\@hashes, canonical => 1, separator => ''), join('', @docs), 'stream without a separator');
+
+{
+    my $conv = XML::Hash::XS->new(canonical => 1, use_attr => 1, xml_decl => 0);
+    is_deeply(
+        scalar $conv->hash2xml_many(\@hashes),
+        [ map { scalar $conv->hash2xml($_) } @hashes ],
+        'object options',
+    );
+    is_deeply(scalar $conv->hash2xml_many(\@hashes, root => 'msg'), [ map { scalar $conv->hash2xml($_, root => 'msg') } @hashes ], 'per call options');
+}
+
+{
+    my ($fh, $file) = tempfile(UNLINK => 1);
+    hash2xml_many(\@hashes, canonical => 1, output => $fh, separator => "\n");
+    close $fh;
+
+    open $fh, '<', $file or die $!;
+    my $content = do { local $/; <$fh> };
+    utf8::decode($content);
+    is($content, join("\n", @docs), 'stream to a filehandle');
+}
+
+SKIP: {
+    my $enc = eval { [ map { scalar hash2xml($_, canonical => 1, encoding => 'cp1251') } @hashes ] };
+    skip 'encoding is not supported', 1 unless $enc;
+    is_deeply(scalar hash2xml_many(\@hashes, canonical => 1, encoding => 'cp1251'), $enc, 'encoding');
+}
+
+eval { hash2xml_many([ {}, [] ]) };
+like($@, qr/not hash reference/, 'not a hash in the array');
+
+eval { hash2xml_many({}) };
+like($@, qr/not array reference/, 'not an array');
+
+eval { hash2xml_many(\@hashes, checksum => 'xxh64') };
+like($@, qr/requires a separator or an output/, 'checksum of an array of documents');
+
+{
+    my $conv   = XML::Hash::XS->new(checksum => 'xxh64');
+    my $stream = $conv->hash2xml_many(\@hashes, separator => "\n");
+    utf8::encode($stream);
+    ok(defined $conv->checksum && $conv->bytes == length($stream), 'checksum of a stream');
+}